@@ -64,6 +64,7 @@ SOURCES += ../../speccy.cpp \
 	../../speccy_handler.cpp \
 	../../file_type.cpp \
 	../../file_type_zip.cpp \
+	../../library.cpp \
 	../../snapshot/rzx.cpp
 
 HEADERS  += \
@@ -126,6 +127,7 @@ HEADERS  += \
 	../../platform/qt/qt_control.h \
 	../../platform/qt/qt_view.h \
 	../../file_type.h \
+	../../library.h \
 	../../snapshot/rzx.h
 
 RESOURCES += unreal_speccy_portable.qrc
@@ -21,12 +21,175 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 DECLARE_OPTION_ACCESSOR_NULL(eOptionBool, op_devices);
 
+//=============================================================================
+//	eIoDecoder::eIoDecoder
+//-----------------------------------------------------------------------------
+eIoDecoder::eIoDecoder() : rules(NULL), rules_count(0), rules_alloc(0)
+	, devices(NULL), devices_count(0), devices_alloc(0)
+	, pages(NULL), pages_alloc(0), lists(NULL), lists_size(0), lists_alloc(0)
+{
+	Begin();
+	End();
+}
+//=============================================================================
+//	eIoDecoder::~eIoDecoder
+//-----------------------------------------------------------------------------
+eIoDecoder::~eIoDecoder()
+{
+	free(rules);
+	free(devices);
+	free(pages);
+	free(lists);
+}
+//=============================================================================
+//	eIoDecoder::Begin
+//-----------------------------------------------------------------------------
+void eIoDecoder::Begin()
+{
+	rules_count = 0;
+	devices_count = 0;
+	lists_size = 0;
+}
+//=============================================================================
+//	eIoDecoder::Device
+//-----------------------------------------------------------------------------
+void eIoDecoder::Device(eDevice* d)
+{
+	if(devices_count == devices_alloc)
+	{
+		devices_alloc = devices_alloc ? devices_alloc*2 : 16;
+		devices = (eDevice**)realloc(devices, devices_alloc*sizeof(eDevice*));
+	}
+	devices[devices_count++] = d;
+}
+//=============================================================================
+//	eIoDecoder::AddRule
+//-----------------------------------------------------------------------------
+void eIoDecoder::AddRule(word mask, word value, bool except)
+{
+	assert(devices_count && (value&~mask) == 0);
+	if(rules_count == rules_alloc)
+	{
+		rules_alloc = rules_alloc ? rules_alloc*2 : 32;
+		rules = (eRule*)realloc(rules, rules_alloc*sizeof(eRule));
+	}
+	eRule& r = rules[rules_count++];
+	r.mask_hi = mask >> 8;
+	r.value_hi = value >> 8;
+	r.mask_lo = (byte)mask;
+	r.value_lo = (byte)value;
+	r.except = except;
+	r.device = devices_count - 1;
+}
+//=============================================================================
+//	ListEq
+//-----------------------------------------------------------------------------
+static bool ListEq(eDevice* const* stored, eDevice* const* list, int count)
+{
+	for(int i = 0; i < count; ++i)
+	{
+		if(stored[i] != list[i])
+			return false;
+	}
+	return !stored[count];
+}
+//=============================================================================
+//	eIoDecoder::List
+//	offset of NULL terminated device list, equal lists are stored once
+//-----------------------------------------------------------------------------
+word eIoDecoder::List(eDevice** list, int count)
+{
+	int o = 0;
+	while(o < lists_size)
+	{
+		if(ListEq(lists + o, list, count))
+			return o;
+		while(lists[o++])
+			;
+	}
+	if(lists_size + count + 1 > lists_alloc)
+	{
+		lists_alloc = (lists_size + count + 1)*2;
+		lists = (eDevice**)realloc(lists, lists_alloc*sizeof(eDevice*));
+	}
+	memcpy(lists + o, list, count*sizeof(eDevice*));
+	lists[o + count] = NULL;
+	lists_size = o + count + 1;
+	assert(lists_size <= 0x10000);
+	return o;
+}
+//=============================================================================
+//	eIoDecoder::End
+//	high bytes matching the same rules share one page of 256 low bytes,
+//	so rules are evaluated once per distinct page instead of once per port
+//-----------------------------------------------------------------------------
+void eIoDecoder::End()
+{
+	int sig_size = (rules_count + 31)/32 + 1;
+	dword* sigs = (dword*)malloc(0x100*sig_size*sizeof(dword));
+	int pages_count = 0;
+	for(int h = 0; h < 0x100; ++h)
+	{
+		dword* sig = sigs + pages_count*sig_size;
+		memset(sig, 0, sig_size*sizeof(dword));
+		for(int r = 0; r < rules_count; ++r)
+		{
+			if((h&rules[r].mask_hi) == rules[r].value_hi)
+				sig[r >> 5] |= 1u << (r&31);
+		}
+		int p = 0;
+		while(p < pages_count && memcmp(sigs + p*sig_size, sig, sig_size*sizeof(dword)))
+			++p;
+		if(p == pages_count)
+			++pages_count;
+		pages_hi[h] = p;
+	}
+	if(pages_count*0x100 > pages_alloc)
+	{
+		pages_alloc = pages_count*0x100;
+		pages = (word*)realloc(pages, pages_alloc*sizeof(word));
+	}
+	eDevice** list = (eDevice**)malloc((devices_count + 1)*sizeof(eDevice*));
+	for(int p = 0; p < pages_count; ++p)
+	{
+		const dword* sig = sigs + p*sig_size;
+		for(int l = 0; l < 0x100; ++l)
+		{
+			int count = 0;
+			int r = 0;
+			for(int d = 0; d < devices_count; ++d)
+			{
+				bool port = false, except = false;
+				for(; r < rules_count && rules[r].device == d; ++r)
+				{
+					const eRule& x = rules[r];
+					if((sig[r >> 5]&(1u << (r&31))) && (l&x.mask_lo) == x.value_lo)
+					{
+						if(x.except)
+							except = true;
+						else
+							port = true;
+					}
+				}
+				if(port && !except)
+					list[count++] = devices[d];
+			}
+			word* e = pages + (p << 8) + l;
+			if(l && ListEq(lists + e[-1], list, count)) // neighbour ports are mostly decoded alike
+				*e = e[-1];
+			else
+				*e = List(list, count);
+		}
+	}
+	free(list);
+	free(sigs);
+}
+
 //=============================================================================
 //	eDevices::eDevices
 //-----------------------------------------------------------------------------
 eDevices::eDevices()
 {
-	OPTION_GET(op_devices) = this;
 	storeable = false;
 	memset(items, 0, sizeof(items));
 	Set(true);
@@ -36,6 +199,8 @@ eDevices::eDevices()
 //-----------------------------------------------------------------------------
 eDevices::~eDevices()
 {
+	if(OPTION_GET(op_devices) == this)
+		BindOptions(false);
 	for(int i = 0; i < D_COUNT; ++i)
 	{
 		SAFE_DELETE(items[i]);
@@ -44,76 +209,31 @@ eDevices::~eDevices()
 //=============================================================================
 //	eDevices::Init
 //-----------------------------------------------------------------------------
-void eDevices::Init()
+void eDevices::Init(dword io_need)
 {
-	memset(items_io_read, 0, sizeof(items_io_read));
-	memset(items_io_write, 0, sizeof(items_io_write));
+	if(io_need&eDevice::ION_READ)
+		InitIo(eDevice::ION_READ, &io_read);
+	if(io_need&eDevice::ION_WRITE)
+		InitIo(eDevice::ION_WRITE, &io_write);
+}
+//=============================================================================
+//	eDevices::InitIo
+//-----------------------------------------------------------------------------
+void eDevices::InitIo(dword need, eIoDecoder* io)
+{
+	io->Begin();
 	for(int i = 0; i < D_COUNT; ++i)
 	{
 		eDevice* d = items[i];
-		if(!*d)
+		if(!*d || !(d->IoNeed()&need))
 			continue;
-		if(d->IoNeed()&eDevice::ION_READ)
-		{
-			eDevice** dl = items_io_read;
-			while(*dl)
-				++dl;
-			*dl = d;
-		}
-		if(d->IoNeed()&eDevice::ION_WRITE)
-		{
-			eDevice** dl = items_io_write;
-			while(*dl)
-				++dl;
-			*dl = d;
-		}
-	}
-	int io_read_count = 0;
-	for(; items_io_read[io_read_count]; ++io_read_count);
-	int io_write_count = 0;
-	for(; items_io_write[io_write_count]; ++io_write_count);
-	assert(io_read_count <= 8 && io_write_count <= 8); //only 8 devs max supported
-
-	for(int port = 0; port < 0x10000; ++port)
-	{
-		byte devs = 0;
-		for(int d = 0; d < io_read_count; ++d)
-		{
-			if(items_io_read[d]->IoRead(port))
-				devs |= 1 << d;
-		}
-		io_read_map[port] = devs;
-		devs = 0;
-		for(int d = 0; d < io_write_count; ++d)
-		{
-			if(items_io_write[d]->IoWrite(port))
-				devs |= 1 << d;
-		}
-		io_write_map[port] = devs;
-	}
-
-	int size = 1 << io_read_count;
-	for(int i = 0; i < size; ++i)
-	{
-		eDevice** dl = io_read_cache[i];
-		for(int d = 0; d < io_read_count; ++d)
-		{
-			if((byte)i&(1 << d))
-				*dl++ = items_io_read[d];
-		}
-		*dl = NULL;
-	}
-	size = 1 << io_write_count;
-	for(int i = 0; i < size; ++i)
-	{
-		eDevice** dl = io_write_cache[i];
-		for(int d = 0; d < io_write_count; ++d)
-		{
-			if((byte)i&(1 << d))
-				*dl++ = items_io_write[d];
-		}
-		*dl = NULL;
+		io->Device(d);
+		if(need == eDevice::ION_READ)
+			d->IoReadDecode(io);
+		else
+			d->IoWriteDecode(io);
 	}
+	io->End();
 }
 //=============================================================================
 //	eDevices::Reset
@@ -146,6 +266,16 @@ void eDevices::FrameUpdate()
 	}
 }
 //=============================================================================
+//	eDevices::FrameSlice
+//-----------------------------------------------------------------------------
+void eDevices::FrameSlice(dword tacts)
+{
+	for(int i = 0; i < D_COUNT; ++i)
+	{
+		items[i]->FrameSlice(tacts);
+	}
+}
+//=============================================================================
 //	eDevices::FrameEnd
 //-----------------------------------------------------------------------------
 void eDevices::FrameEnd(dword tacts)
@@ -164,21 +294,36 @@ void eDevices::_Add(eDeviceId id, eDevice* d)
 	d->Init();
 	items[id] = d;
 }
+//=============================================================================
+//	eDevices::BindOptions
+//-----------------------------------------------------------------------------
+void eDevices::BindOptions(bool bind)
+{
+	OPTION_GET(op_devices) = bind ? this : NULL;
+	for(int i = 0; i < D_COUNT; ++i)
+	{
+		items[i]->BindOptions(bind);
+	}
+}
+//=============================================================================
+//	eDevices::OnOption
+//	only port decoding of toggled devices is rebuilt
+//-----------------------------------------------------------------------------
 void eDevices::OnOption()
 {
-	bool items_changed = false;
+	dword io_need = 0;
 	bool on = false;
 	for(int i = 0; i < D_COUNT; ++i)
 	{
-		eOptionBool* o = items[i];
+		eDevice* d = items[i];
 		if(changed)
-			o->Set(value);
-		if(Option(o))
-			items_changed = true;
-		if(*o)
+			d->Set(value);
+		if(Option(d))
+			io_need |= d->IoNeed();
+		if(*d)
 			on = true;
 	}
 	Set(on);
-	if(items_changed)
-		Init();
+	if(io_need)
+		Init(io_need);
 }
@@ -23,6 +23,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+class eIoDecoder;
+
 //*****************************************************************************
 //	eDevice
 //-----------------------------------------------------------------------------
@@ -35,14 +37,16 @@ public:
 	virtual void Reset() {}
 	virtual void FrameStart(dword tacts) {}
 	virtual void FrameUpdate() {}
+	virtual void FrameSlice(dword tacts) {} // part of frame done (up to tacts)
 	virtual void FrameEnd(dword tacts) {}
 
 	enum eIoNeed { ION_READ = 0x01, ION_WRITE = 0x02 };
-	virtual bool IoRead(word port) const { return false; }
-	virtual bool IoWrite(word port) const { return false; }
+	virtual void IoReadDecode(eIoDecoder* d) const {} // ports declared with (mask, value) rules
+	virtual void IoWriteDecode(eIoDecoder* d) const {}
 	virtual void IoRead(word port, byte* v, int tact) {}
 	virtual void IoWrite(word port, byte v, int tact) {}
 	virtual dword IoNeed() const { return 0; }
+	virtual void BindOptions(bool bind) {} // configured by user options (observes them)
 protected:
 	virtual const char** Values() const { static const char* vs[] = { "[ ]", "[x]", NULL }; return vs; }
 	virtual void OnOption()
@@ -53,6 +57,48 @@ protected:
 	virtual void _OnOption() {}
 };
 
+//*****************************************************************************
+//	eIoDecoder
+//	port -> devices lookup compiled from (mask, value) rules of devices,
+//	two-level table: high byte selects page shared by equally decoded high bytes
+//-----------------------------------------------------------------------------
+class eIoDecoder
+{
+public:
+	eIoDecoder();
+	~eIoDecoder();
+	void Begin();
+	void Device(eDevice* d); // following rules are for d
+	void Port(word mask, word value) { AddRule(mask, value, false); } // (port&mask) == value decoded
+	void Except(word mask, word value) { AddRule(mask, value, true); } // unless any except rule matches
+	void End();
+
+	// NULL terminated list
+	eDevice** Devices(word port) const { return lists + pages[(pages_hi[port >> 8] << 8)|(port&0xff)]; }
+protected:
+	void AddRule(word mask, word value, bool except);
+	word List(eDevice** list, int count);
+	struct eRule
+	{
+		byte mask_hi, value_hi;
+		byte mask_lo, value_lo;
+		byte except;
+		int device;
+	};
+	eRule* rules;
+	int rules_count;
+	int rules_alloc;
+	eDevice** devices;
+	int devices_count;
+	int devices_alloc;
+	byte pages_hi[0x100];
+	word* pages;
+	int pages_alloc;
+	eDevice** lists;
+	int lists_size;
+	int lists_alloc;
+};
+
 enum eDeviceId { D_MEMORY, D_ULA, D_KEYBOARD, D_KEMPSTON_JOY, D_KEMPSTON_MOUSE, D_BEEPER, D_AY, D_WD1793, D_TAPE, D_COUNT };
 
 //*****************************************************************************
@@ -64,9 +110,10 @@ public:
 	eDevices();
 	~eDevices();
 
-	void Init();
+	void Init(dword io_need = eDevice::ION_READ|eDevice::ION_WRITE); // port decoding of devices is built
 	void Update();
 	void Reset();
+	void BindOptions(bool bind); // only one machine is configured by user options
 
 	template<class T> void Add(T* d) { _Add(T::Id(), d); }
 	template<class T> T* Get() const { return (T*)_Get(T::Id()); }
@@ -74,34 +121,32 @@ public:
 	byte IoRead(word port, int tact)
 	{
 		byte v = 0xff;
-		eDevice** dl = io_read_cache[io_read_map[port]];
+		eDevice** dl = io_read.Devices(port);
 		while(*dl)
 			(*dl++)->IoRead(port, &v, tact);
 		return v;
 	}
 	void IoWrite(word port, byte v, int tact)
 	{
-		eDevice** dl = io_write_cache[io_write_map[port]];
+		eDevice** dl = io_write.Devices(port);
 		while(*dl)
 			(*dl++)->IoWrite(port, v, tact);
 	}
 
 	void FrameStart(dword tacts);
 	void FrameUpdate();
+	void FrameSlice(dword tacts);
 	void FrameEnd(dword tacts);
 	virtual const char* Name() const { return "hardware"; }
 protected:
 	virtual const char** Values() const { static const char* vs[] = { "[ ]", "[x]", NULL }; return vs; }
 	virtual void OnOption();
 	void _Add(eDeviceId id, eDevice* d);
+	void InitIo(dword need, eIoDecoder* io);
 	eDevice* _Get(eDeviceId id) const { return items[id]; }
 	eDevice* items[D_COUNT];
-	eDevice* items_io_read[D_COUNT + 1];
-	eDevice* items_io_write[D_COUNT + 1];
-	byte io_read_map[0x10000];
-	byte io_write_map[0x10000];
-	eDevice* io_read_cache[0x100][9];
-	eDevice* io_write_cache[0x100][9];
+	eIoDecoder io_read;
+	eIoDecoder io_write;
 };
 
 #endif//__DEVICE_H__
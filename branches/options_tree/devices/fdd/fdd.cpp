@@ -17,12 +17,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "../../std.h"
+#include "../../tools/thread.h"
+#include "../../tools/file_data.h"
 
 #include "fdd.h"
 
 const int trdos_interleave = 1;
 
 #define Min(o, p)	(o < p ? o : p)
+#define Max(o, p)	(o > p ? o : p)
 
 //=============================================================================
 //	eUdi::eTrack::Marker
@@ -38,6 +41,7 @@ void eUdi::eTrack::Write(int pos, byte v, bool marker)
 {
 	if(data)
 	{
+		dirty = true;
 		data[pos] = v;
 		if(marker)
 		{
@@ -50,90 +54,748 @@ void eUdi::eTrack::Write(int pos, byte v, bool marker)
 	}
 }
 //=============================================================================
+//	eUdi::eTrack::WriteBlock
+//-----------------------------------------------------------------------------
+void eUdi::eTrack::WriteBlock(int& pos, byte v, int amount, bool marker)
+{
+	if(amount <= 0)
+		return;
+	if(!data)
+	{
+		pos += amount;
+		return;
+	}
+	dirty = true;
+	memset(data + pos, v, amount);
+	int end = pos + amount;
+	for(; pos < end && (pos & 7); ++pos)
+	{
+		Write(pos, v, marker);
+	}
+	int bytes = (end - pos) / 8;
+	memset(id + pos / 8, marker ? 0xff : 0, bytes);
+	for(pos += bytes * 8; pos < end; ++pos)
+	{
+		Write(pos, v, marker);
+	}
+}
+//=============================================================================
+//	eUdi::eTrack::NextMarker
+//-----------------------------------------------------------------------------
+int eUdi::eTrack::NextMarker(int pos, int end) const
+{
+	while(pos < end)
+	{
+		dword m = Dword(id + pos / 8) >> (pos & 7);
+		if(!m)
+		{
+			pos = (pos & ~7) + 32; // no markers in whole dword
+			continue;
+		}
+		for(; !(m & 1); m >>= 1)
+		{
+			++pos;
+		}
+		return Min(pos, end);
+	}
+	return end;
+}
+//=============================================================================
 //	eUdi::eTrack::Update
 //-----------------------------------------------------------------------------
-void eUdi::eTrack::Update()
+void eUdi::eTrack::Update(int from, int to)
 {
+	enum { ID_SIZE = 8, DATA_MARGIN = 43 }; // data marker margin 30-SD, 43-DD
 	byte* src = data;
 	int len = data_len - 8;
-	sectors_amount = 0;
-	int i = 0;
-	while(i < len)
+	if(from >= to) // wrapped around index
+	{
+		from = 0;
+		to = len;
+	}
+	// rescan sectors which markers can be affected by changes in [from, to)
+	from = Max(0, from - (ID_SIZE + DATA_MARGIN + 1));
+	int scan_end = Min(len, to);
+
+	eSector updated[MAX_SEC];
+	int amount = 0;
+	for(int s = 0; s < sectors_amount; ++s)
 	{
-		for(; i < len; ++i)
+		if(sectors[s].id - 2 - src < from)
+			updated[amount++] = sectors[s];
+	}
+	int i = from;
+	while((i = NextMarker(i, scan_end)) < scan_end)
+	{
+		if(src[i] != 0xa1 || src[i+1] != 0xfe) //find index data marker
 		{
-			if(src[i] == 0xa1 && src[i+1] == 0xfe && Marker(i)) //find index data marker
-			{
-				sectors[sectors_amount].id = src + i + 2;
-				sectors[sectors_amount].data = NULL;
-				i += 8;
-				break;
-			}
+			++i;
+			continue;
 		}
-		int end = Min(len, i + 43); // data marker margin 30-SD, 43-DD
-		for(; i < end; ++i)
+		if(amount == MAX_SEC)
 		{
-			if(src[i] == 0xa1 && Marker(i) && !Marker(i + 1)) //find data marker
+			assert(0); //too many sectors
+			break;
+		}
+		eSector& sec = updated[amount++];
+		sec.id = src + i + 2;
+		sec.data = NULL;
+		i += ID_SIZE;
+		int end = Min(len, i + DATA_MARGIN);
+		for(; (i = NextMarker(i, end)) < end; ++i)
+		{
+			if(src[i] == 0xa1 && !Marker(i + 1)) //find data marker
 			{
-				if((i < len && src[i+1] == 0xf8) || src[i+1] == 0xfb)
+				if(src[i+1] == 0xf8 || src[i+1] == 0xfb)
 				{
-					sectors[sectors_amount].data = src + i + 2;
+					sec.data = src + i + 2;
 				}
 				break;
 			}
 		}
-		if(sectors_amount++ >= MAX_SEC)
+	}
+	for(int s = 0; s < sectors_amount && amount < MAX_SEC; ++s)
+	{
+		if(sectors[s].id - 2 - src >= to)
+			updated[amount++] = sectors[s];
+	}
+	memcpy(sectors, updated, amount * sizeof(eSector));
+	sectors_amount = amount;
+}
+
+//=============================================================================
+//	Crc16
+//-----------------------------------------------------------------------------
+static word Crc16(const byte* src, int size)
+{
+	dword crc = 0xcdb4;
+	while(size--)
+	{
+		crc ^= (*src++) << 8;
+		for(int i = 8; i; --i)
 		{
-			assert(0); //too many sectors
+			if((crc *= 2) & 0x10000)
+			{
+				crc ^= 0x1021; // bit representation of x^12+x^5+1
+			}
 		}
 	}
+	return crc;
 }
 
 //=============================================================================
 //	eUdi::eUdi
 //-----------------------------------------------------------------------------
-eUdi::eUdi(int _cyls, int _sides) : raw(NULL)
+eUdi::eUdi(int _cyls, int _sides, size_t _image_size) : source(NULL), image_size(_image_size)
 {
 	cyls = _cyls; sides = _sides;
-	const int max_track_len = 6250;
-	int data_len = max_track_len;
-	int udi_track_len = data_len + data_len / 8 + ((data_len & 7) ? 1 : 0);
-	int size = cyls * sides * udi_track_len;
-	raw = new byte[size];
-	memset(raw, 0, size);
-	for(int i = 0; i < cyls; ++i)
+	memset(image, 0, sizeof(image));
+}
+//=============================================================================
+//	eUdi::~eUdi
+//-----------------------------------------------------------------------------
+eUdi::~eUdi()
+{
+	for(int i = 0; i < MAX_CYL; ++i)
 	{
-		for(int j = 0; j < sides; ++j)
+		for(int j = 0; j < MAX_SIDE; ++j)
 		{
-			eTrack& t = tracks[i][j];
-			t.data_len = data_len;
-			t.data = raw + udi_track_len * (i * sides + j);
-			t.id = t.data + data_len;
+			SAFE_DELETE_ARRAY(tracks[i][j].data);
 		}
 	}
+	ImageSource(NULL);
+}
+//=============================================================================
+//	eUdi::ImageSize
+//-----------------------------------------------------------------------------
+void eUdi::ImageSize(size_t size)
+{
+	if(size > image_size)
+		image_size = size; // sectors past the source read as zeros
+}
+//=============================================================================
+//	eUdi::ImageSource
+//-----------------------------------------------------------------------------
+void eUdi::ImageSource(xIo::eFileData* _source)
+{
+	for(int i = 0; i < MAX_CYL; ++i)
+	{
+		for(int j = 0; j < MAX_SIDE; ++j)
+		{
+			SAFE_DELETE_ARRAY(image[i][j]);
+		}
+	}
+	if(_source)
+		_source->AddRef();
+	if(source)
+		source->Release();
+	source = _source;
+}
+//=============================================================================
+//	eUdi::StoreImage
+//-----------------------------------------------------------------------------
+void eUdi::StoreImage(byte* dst) const
+{
+	for(size_t offs = 0; offs < image_size; offs += 0x100)
+	{
+		int track = int(offs / 0x1000);
+		int sec = int(offs / 0x100) % 16 + 1;
+		const byte* s = ImageSector(track / sides, track % sides, sec);
+		size_t len = Min(size_t(0x100), image_size - offs);
+		if(s)
+			memcpy(dst + offs, s, len);
+		else
+			memset(dst + offs, 0, len);
+	}
+}
+//=============================================================================
+//	eUdi::ImageSector
+//-----------------------------------------------------------------------------
+const byte* eUdi::ImageSector(int cyl, int side, int sec) const
+{
+	static const byte blank[0x100] = { 0 };
+	size_t offs = ((cyl * sides + side) * 16 + sec - 1) * 0x100;
+	if(cyl >= MAX_CYL || side >= MAX_SIDE || sec < 1 || sec > 16 || offs + 0x100 > image_size)
+		return NULL;
+	if(image[cyl][side])
+		return image[cyl][side] + (sec - 1) * 0x100;
+	if(source && offs + 0x100 <= source->Size())
+		return source->Data() + offs;
+	return blank;
+}
+//=============================================================================
+//	eUdi::WritableSector
+//-----------------------------------------------------------------------------
+byte* eUdi::WritableSector(int cyl, int side, int sec)
+{
+	if(!ImageSector(cyl, side, sec))
+		return NULL;
+	byte*& t = image[cyl][side];
+	if(!t)
+	{
+		t = new byte[16 * 0x100];
+		for(int i = 0; i < 16; ++i)
+		{
+			const byte* s = ImageSector(cyl, side, i + 1);
+			if(s)
+				memcpy(t + i * 0x100, s, 0x100);
+			else
+				memset(t + i * 0x100, 0, 0x100);
+		}
+	}
+	return t + (sec - 1) * 0x100;
+}
+//=============================================================================
+//	eUdi::CreateTrack
+//-----------------------------------------------------------------------------
+void eUdi::CreateTrack(int cyl, int side, int data_len)
+{
+	eTrack& t = tracks[cyl][side];
+	SAFE_DELETE_ARRAY(t.data);
+	t.data_len = data_len;
+	t.sectors_amount = 0;
+	int udi_track_len = t.data_len + t.data_len / 8 + ((t.data_len & 7) ? 1 : 0);
+	udi_track_len += sizeof(dword); // marker scan reads dwords
+	t.data = new byte[udi_track_len];
+	memset(t.data, 0, udi_track_len);
+	t.id = t.data + t.data_len;
+	if(!image_size) // blank track to be filled by image reader
+		return;
+
+	int pos = 0;
+	t.WriteBlock(pos, 0x4e, 80);		//gap4a
+	t.WriteBlock(pos, 0, 12);			//sync
+	t.WriteBlock(pos, 0xc2, 3, true);	//iam
+	t.Write(pos++, 0xfc);
+
+	const int max_trd_sectors = 16;
+	static const byte lv[3][max_trd_sectors] =
+	{
+		{ 1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16 },
+		{ 1,9,2,10,3,11,4,12,5,13,6,14,7,15,8,16 },
+		{ 1,12,7,2,13,8,3,14,9,4,15,10,5,16,11,6 }
+	};
+	t.sectors_amount = max_trd_sectors;
+	for(int i = 0; i < max_trd_sectors; ++i)
+	{
+		t.WriteBlock(pos, 0x4e, 40);		//gap1 50 fixme: recalculate gap1 only for non standard formats
+		t.WriteBlock(pos, 0, 12);			//sync
+		t.WriteBlock(pos, 0xa1, 3, true);	//id am
+		t.Write(pos++, 0xfe);
+		eTrack::eSector& sec = t.sectors[i];
+		sec.id = t.data + pos;
+		t.Write(pos++, cyl);
+		t.Write(pos++, side);
+		t.Write(pos++, lv[trdos_interleave][i]);
+		t.Write(pos++, 1); //256byte
+		word crc = Crc16(t.data + pos - 5, 5);
+		t.Write(pos++, crc >> 8);
+		t.Write(pos++, (byte)crc);
+
+		t.WriteBlock(pos, 0x4e, 22);		//gap2
+		t.WriteBlock(pos, 0, 12);			//sync
+		t.WriteBlock(pos, 0xa1, 3, true);	//data am
+		t.Write(pos++, 0xfb);
+		sec.data = t.data + pos;
+		int len = sec.Len();
+		const byte* src = ImageSector(cyl, side, sec.Sec());
+		if(src)
+			memcpy(sec.data, src, len);
+		crc = Crc16(t.data + pos - 1, len + 1);
+		pos += len;
+		t.Write(pos++, crc >> 8);
+		t.Write(pos++, (byte)crc);
+	}
+	if(pos > t.data_len)
+	{
+		assert(0); //track too long
+	}
+	t.WriteBlock(pos, 0x4e, t.data_len - pos - 1); //gap3
+	t.dirty = false;
+}
+
+//*****************************************************************************
+//	eFddWriter
+//	writes disk image to temporary file in background, then renames it over
+//	original one, so image file is always consistent
+//-----------------------------------------------------------------------------
+struct eFddWriter
+{
+	eFddWriter() : data(NULL), size(0), alloc(0), udi_crc(false), ok(false), busy(false) { *name = 0; }
+	~eFddWriter() { thread.Wait(); SAFE_DELETE_ARRAY(data); }
+	bool Busy() const { return busy; }
+	void Wait() { thread.Wait(); }
+	byte* Buffer(size_t _size)
+	{
+		if(_size > alloc)
+		{
+			SAFE_DELETE_ARRAY(data);
+			data = new byte[_size];
+			alloc = _size;
+		}
+		size = _size;
+		return data;
+	}
+	void Start(const char* _name, bool _udi_crc)
+	{
+		strcpy(name, _name);
+		udi_crc = _udi_crc;
+		busy = true;
+		ThreadFence();
+		thread.Start(Proc, this);
+	}
+	static void Proc(void* arg)
+	{
+		eFddWriter* w = (eFddWriter*)arg;
+		w->ok = w->Write();
+		ThreadFence();
+		w->busy = false;
+	}
+	bool Write();
+
+	eThread	thread;
+	char	name[xIo::MAX_PATH_LEN];
+	byte*	data;
+	size_t	size;
+	size_t	alloc;
+	bool	udi_crc;
+	bool	ok;
+	volatile bool busy;
+};
+//=============================================================================
+//	UdiCrc
+//-----------------------------------------------------------------------------
+//	crc32 variant used by udi format (one's complement of each step)
+static dword UdiCrc(const byte* src, size_t size)
+{
+	dword crc = 0xffffffff;
+	while(size--)
+	{
+		crc ^= ~dword(*src++);
+		for(int k = 8; k--;)
+		{
+			dword temp = dword(-int(crc & 1));
+			crc = (crc >> 1) | (crc & 0x80000000); // arithmetic shift as in original implementation
+			crc ^= 0xedb88320 & temp;
+		}
+		crc = ~crc;
+	}
+	return crc;
+}
+static inline void SetDword(byte* ptr, dword d)
+{
+	ptr[0] = d & 0xff;
+	ptr[1] = (d >> 8) & 0xff;
+	ptr[2] = (d >> 16) & 0xff;
+	ptr[3] = d >> 24;
+}
+//=============================================================================
+//	eFddWriter::Write
+//-----------------------------------------------------------------------------
+bool eFddWriter::Write()
+{
+	if(udi_crc)
+		SetDword(data + size - 4, UdiCrc(data, size - 4));
+	char tmp[xIo::MAX_PATH_LEN + 4];
+	strcpy(tmp, name);
+	strcat(tmp, ".tmp");
+	FILE* f = fopen(tmp, "wb");
+	if(!f)
+		return false;
+	bool r = fwrite(data, 1, size, f) == size;
+	r = (fclose(f) == 0) && r;
+#ifdef _WINDOWS
+	if(r)
+		remove(name); // rename doesn't replace files here
+#endif//_WINDOWS
+	if(!r || rename(tmp, name) != 0)
+	{
+		remove(tmp);
+		return false;
+	}
+	return true;
 }
 
 //=============================================================================
 //	eFdd::eFdd
 //-----------------------------------------------------------------------------
 eFdd::eFdd() : motor(0), cyl(0), side(0), ts_byte(0), write_protect(false), disk(NULL)
+	, udi(NULL), udi_size(0), writing(false), write_error(false)
+{
+	*file = 0;
+	*file_type = 0;
+	writer = new eFddWriter;
+}
+//=============================================================================
+//	eFdd::~eFdd
+//-----------------------------------------------------------------------------
+eFdd::~eFdd()
 {
+	Flush(true);
+	SAFE_DELETE(writer);
+	SAFE_DELETE_ARRAY(udi);
+	SAFE_DELETE(disk);
 }
 //=============================================================================
 //	eFdd::Open
 //-----------------------------------------------------------------------------
-bool eFdd::Open(const char* type, const void* data, size_t data_size)
+bool eFdd::Open(const char* type, xIo::eFileData* image, const char* name)
 {
+	const void* data = image->Data();
+	size_t data_size = image->Size();
+	Flush(true);
+	*file = 0;
+	SAFE_DELETE_ARRAY(udi);
 	Motor(0);
+	bool ok = false;
 	if(!strcmp(type, "trd"))
-		return ReadTrd(data, data_size);
-	if(!strcmp(type, "scl"))
-		return ReadScl(data, data_size);
-	if(!strcmp(type, "fdi"))
-		return ReadFdi(data, data_size);
+		ok = ReadTrd(image);
+	else if(!strcmp(type, "scl"))
+		ok = ReadScl(data, data_size);
+	else if(!strcmp(type, "fdi"))
+		ok = ReadFdi(data, data_size);
+	else if(!strcmp(type, "udi"))
+		ok = ReadUdi(data, data_size);
+	if(ok && name && strlen(name) < sizeof(file) - 4)
+	{
+		strcpy(file, name);
+		strcpy(file_type, type);
+	}
+	return ok;
+}
+//=============================================================================
+//	eFdd::Insert
+//	disk is parsed by standalone instance (off the emulation thread)
+//-----------------------------------------------------------------------------
+void eFdd::Insert(eFdd* image)
+{
+	Flush(true);
+	eUdi* d = disk;
+	disk = image->disk;
+	image->disk = d;
+	byte* u = udi;
+	udi = image->udi;
+	image->udi = u;
+	size_t s = udi_size;
+	udi_size = image->udi_size;
+	image->udi_size = s;
+	strcpy(file, image->file);
+	strcpy(file_type, image->file_type);
+	*image->file = 0; // previous disk is already written back
+	Motor(0);
+}
+//-----------------------------------------------------------------------------
+bool eFdd::Flush(bool wait)
+{
+	if(!disk || !*file)
+		return true;
+	if(wait)
+		writer->Wait();
+	if(writer->Busy())
+		return false;
+	Written();
+	bool trd = !udi && (!strcmp(file_type, "trd") || !strcmp(file_type, "scl"));
+	bool dirty = false;
+	for(int i = 0; i < disk->Cyls(); ++i)
+	{
+		for(int j = 0; j < disk->Sides(); ++j)
+		{
+			eUdi::eTrack* t = disk->Created(i, j);
+			if(!t || !t->dirty)
+				continue;
+			dirty = true;
+			t->dirty = false;
+			t->writing = true;
+			if(trd && !StoreTrd(i, j)) // copy protected, keep it in udi
+				trd = false;
+			if(udi)
+			{
+				size_t offs = 16;
+				for(int k = 0; k < i * disk->Sides() + j; ++k)
+				{
+					offs += StoreUdi(NULL, k / disk->Sides(), k % disk->Sides());
+				}
+				StoreUdi(udi + offs, i, j);
+			}
+		}
+	}
+	if(!dirty)
+		return true;
+	if(!trd && !udi)
+		CreateUdi();
+	if(udi)
+	{
+		char name[xIo::MAX_PATH_LEN];
+		strcpy(name, file);
+		char* ext = strrchr(name, '.');
+		if(ext)
+			strcpy(ext, ".udi");
+		memcpy(writer->Buffer(udi_size), udi, udi_size);
+		writer->Start(name, true);
+	}
+	else
+	{
+		Prepare(file_type, false);
+		if(!strcmp(file_type, "trd")) // stop referring the image file being replaced
+		{
+			xIo::eFileData* d = xIo::eFileData::Copy(writer->data, writer->size);
+			disk->ImageSource(d);
+			d->Release();
+		}
+		writer->Start(file, false);
+	}
+	writing = true;
+	return true;
+}
+//=============================================================================
+//	eFdd::Written
+//-----------------------------------------------------------------------------
+bool eFdd::Written()
+{
+	if(!writing || writer->Busy())
+		return true;
+	ThreadFence();
+	writing = false;
+	bool ok = writer->ok;
+	for(int i = 0; disk && i < disk->Cyls(); ++i)
+	{
+		for(int j = 0; j < disk->Sides(); ++j)
+		{
+			eUdi::eTrack* t = disk->Created(i, j);
+			if(!t || !t->writing)
+				continue;
+			t->writing = false;
+			if(!ok)
+				t->dirty = true;
+		}
+	}
+	if(!ok)
+		write_error = true;
+	return ok;
+}
+//=============================================================================
+//	eFdd::Store
+//-----------------------------------------------------------------------------
+bool eFdd::Store(const char* type, const char* name)
+{
+	if(!disk)
+		return false;
+	writer->Wait();
+	Written();
+	if(!Prepare(type, true))
+		return false;
+	writer->Start(name, !strcmp(type, "udi"));
+	writer->Wait();
+	return writer->ok;
+}
+//=============================================================================
+//	eFdd::Prepare
+//-----------------------------------------------------------------------------
+//	puts disk image in required format to writer buffer
+bool eFdd::Prepare(const char* type, bool all)
+{
+	bool trd = !strcmp(type, "trd");
+	bool scl = !strcmp(type, "scl");
+	if(trd || scl)
+	{
+		for(int i = 0; all && i < disk->Cyls(); ++i)
+		{
+			for(int j = 0; j < disk->Sides(); ++j)
+			{
+				if((disk->Created(i, j) || !disk->ImageSize()) && !StoreTrd(i, j))
+					return false;
+			}
+		}
+		if(scl)
+		{
+			StoreScl(writer->Buffer(StoreScl(NULL)));
+			return true;
+		}
+		disk->StoreImage(writer->Buffer(disk->ImageSize()));
+		return true;
+	}
+	if(!strcmp(type, "udi"))
+	{
+		if(!udi)
+			CreateUdi();
+		memcpy(writer->Buffer(udi_size), udi, udi_size);
+		return true;
+	}
 	return false;
 }
 //=============================================================================
+//	eFdd::StoreTrd
+//-----------------------------------------------------------------------------
+//	copies track sectors into trd image, false for non trd format track
+bool eFdd::StoreTrd(int cyl, int side)
+{
+	eUdi::eTrack& t = disk->Track(cyl, side);
+	if(t.sectors_amount != 16)
+		return false;
+	disk->ImageSize(((cyl * disk->Sides() + side) + 1) * 16 * 0x100);
+	dword found = 0;
+	for(int i = 0; i < t.sectors_amount; ++i)
+	{
+		eUdi::eTrack::eSector& s = t.sectors[i];
+		if(!s.data || s.Len() != 0x100 || s.Sec() < 1 || s.Sec() > 16 || s.data[-1] != 0xfb)
+			return false;
+		if(Crc(s.id - 1, 5) != s.IdCrc() || Crc(s.data - 1, s.Len() + 1) != s.DataCrc())
+			return false;
+		found |= 1 << s.Sec();
+		memcpy(disk->WritableSector(cyl, side, s.Sec()), s.data, 0x100);
+	}
+	return found == 0x1fffe;
+}
+//=============================================================================
+//	eFdd::StoreScl
+//-----------------------------------------------------------------------------
+//	makes scl from trd image catalog, returns size (dst may be NULL)
+size_t eFdd::StoreScl(byte* dst)
+{
+	byte img[128 * 16]; // catalog, sectors 1-8 of track 0
+	for(int i = 0; i < 8; ++i)
+	{
+		const byte* s = disk->ImageSector(0, 0, i + 1);
+		if(s)
+			memcpy(img + i * 0x100, s, 0x100);
+		else
+			memset(img + i * 0x100, 0, 0x100);
+	}
+	size_t size = 9;
+	int files = 0;
+	for(int i = 0; i < 128 && img[i * 16]; ++i)
+	{
+		if(img[i * 16] == 1) // deleted
+			continue;
+		size += 14 + img[i * 16 + 13] * 0x100;
+		++files;
+	}
+	if(!dst)
+		return size + 4;
+	memcpy(dst, "SINCLAIR", 8);
+	dst[8] = files;
+	byte* hdr = dst + 9;
+	byte* d = hdr + 14 * files;
+	for(int i = 0; files--; ++i)
+	{
+		const byte* e = img + i * 16;
+		if(e[0] == 1)
+		{
+			++files;
+			continue;
+		}
+		memcpy(hdr, e, 14);
+		hdr += 14;
+		int pos = e[15] * 16 + e[14];
+		for(int j = 0; j < e[13]; ++j, ++pos, d += 0x100)
+		{
+			int track = pos / 16;
+			const byte* s = disk->ImageSector(track / disk->Sides(), track % disk->Sides(), (pos & 0x0f) + 1);
+			if(s)
+				memcpy(d, s, 0x100);
+			else
+				memset(d, 0, 0x100);
+		}
+	}
+	dword sum = 0;
+	for(size_t i = 0; i < size; ++i)
+	{
+		sum += dst[i];
+	}
+	SetDword(dst + size, sum);
+	return size + 4;
+}
+//=============================================================================
+//	eFdd::StoreUdi
+//-----------------------------------------------------------------------------
+//	stores track in udi format, returns size (dst may be NULL)
+size_t eFdd::StoreUdi(byte* dst, int cyl, int side)
+{
+	eUdi::eTrack& t = disk->Track(cyl, side);
+	int id_len = t.data_len / 8 + ((t.data_len & 7) ? 1 : 0);
+	if(dst)
+	{
+		dst[0] = 0; // MFM
+		dst[1] = t.data_len & 0xff;
+		dst[2] = t.data_len >> 8;
+		memcpy(dst + 3, t.data, t.data_len + id_len);
+	}
+	return 3 + t.data_len + id_len;
+}
+//=============================================================================
+//	eFdd::CreateUdi
+//-----------------------------------------------------------------------------
+void eFdd::CreateUdi()
+{
+	size_t size = 16;
+	for(int i = 0; i < disk->Cyls(); ++i)
+	{
+		for(int j = 0; j < disk->Sides(); ++j)
+		{
+			size += StoreUdi(NULL, i, j);
+		}
+	}
+	SAFE_DELETE_ARRAY(udi);
+	udi_size = size + 4; // crc
+	udi = new byte[udi_size];
+	memcpy(udi, "UDI!", 4);
+	SetDword(udi + 4, size);
+	udi[8] = 0; // version
+	udi[9] = disk->Cyls() - 1;
+	udi[10] = disk->Sides() - 1;
+	udi[11] = 0;
+	SetDword(udi + 12, 0); // extended header size
+	byte* p = udi + 16;
+	for(int i = 0; i < disk->Cyls(); ++i)
+	{
+		for(int j = 0; j < disk->Sides(); ++j)
+		{
+			p += StoreUdi(p, i, j);
+		}
+	}
+	SetDword(p, 0); // calculated by writer
+}
+//=============================================================================
 //	eFdd::BootExist
 //-----------------------------------------------------------------------------
 static const char* boot_sign = "boot    B";
@@ -165,47 +827,18 @@ void eFdd::Seek(int _cyl, int _side)
 	const int FDD_RPS = 5; // rotation speed
 	ts_byte = Z80FQ / (Track().data_len * FDD_RPS);
 }
-// data misalignment on ARM fighting functions
-static inline word SectorDataW(eUdi::eTrack::eSector* s, size_t offset)
-{
-	return Word(s->data + offset);
-}
-static inline void SectorDataW(eUdi::eTrack::eSector* s, size_t offset, word d)
+// data misalignment on ARM fighting function
+static inline void SetWord(byte* ptr, word d)
 {
-	s->data[offset] = d & 0xff;
-	s->data[offset + 1] = d >> 8;
+	ptr[0] = d & 0xff;
+	ptr[1] = d >> 8;
 }
 //=============================================================================
 //	eFdd::Crc
 //-----------------------------------------------------------------------------
 word eFdd::Crc(byte* src, int size) const
 {
-	dword crc = 0xcdb4;
-	while(size--)
-	{
-		crc ^= (*src++) << 8;
-		for(int i = 8; i; --i)
-		{
-			if((crc *= 2) & 0x10000)
-			{
-				crc ^= 0x1021; // bit representation of x^12+x^5+1
-			}
-		}
-	}
-	return crc;
-}
-//=============================================================================
-//	eFdd::WriteSector
-//-----------------------------------------------------------------------------
-bool eFdd::WriteSector(int cyl, int side, int sec, const byte* data)
-{
-	eUdi::eTrack::eSector* s = GetSector(cyl, side, sec);
-	if(!s || !s->data)
-		return false;
-	int len = s->Len();
-	memcpy(s->data, data, len);
-	UpdateCRC(s);
-	return true;
+	return Crc16(src, size);
 }
 //=============================================================================
 //	eFdd::GetSector
@@ -226,116 +859,48 @@ eUdi::eTrack::eSector* eFdd::GetSector(int cyl, int side, int sec)
 //=============================================================================
 //	eFdd::CreateTrd
 //-----------------------------------------------------------------------------
-void eFdd::CreateTrd()
+void eFdd::CreateTrd(size_t image_size)
 {
 	SAFE_DELETE(disk);
-	disk = new eUdi(eUdi::MAX_CYL, eUdi::MAX_SIDE);
-	for(int i = 0; i < disk->Cyls(); ++i)
-	{
-		for(int j = 0; j < disk->Sides(); ++j)
-		{
-			Seek(i, j);
-
-			int id_len = Track().data_len / 8 + ((Track().data_len & 7) ? 1 : 0);
-			memset(Track().data, 0, Track().data_len + id_len);
-
-			int pos = 0;
-			WriteBlock(pos, 0x4e, 80);		//gap4a
-			WriteBlock(pos, 0, 12);			//sync
-			WriteBlock(pos, 0xc2, 3, true);	//iam
-			Write(pos++, 0xfc);
-
-			const int max_trd_sectors = 16;
-			static const byte lv[3][max_trd_sectors] =
-			{
-				{ 1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16 },
-				{ 1,9,2,10,3,11,4,12,5,13,6,14,7,15,8,16 },
-				{ 1,12,7,2,13,8,3,14,9,4,15,10,5,16,11,6 }
-			};
-			Track().sectors_amount = max_trd_sectors;
-			for(int i = 0; i < max_trd_sectors; ++i)
-			{
-				WriteBlock(pos, 0x4e, 40);		//gap1 50 fixme: recalculate gap1 only for non standard formats
-				WriteBlock(pos, 0, 12);			//sync
-				WriteBlock(pos, 0xa1, 3, true);	//id am
-				Write(pos++, 0xfe);
-				eUdi::eTrack::eSector& sec = Sector(i);
-				sec.id = Track().data + pos;
-				Write(pos++, cyl);
-				Write(pos++, side);
-				Write(pos++, lv[trdos_interleave][i]);
-				Write(pos++, 1); //256byte
-				word crc = Crc(Track().data + pos - 5, 5);
-				Write(pos++, crc >> 8);
-				Write(pos++, (byte)crc);
-
-				WriteBlock(pos, 0x4e, 22);		//gap2
-				WriteBlock(pos, 0, 12);			//sync
-				WriteBlock(pos, 0xa1, 3, true);	//data am
-				Write(pos++, 0xfb);
-				sec.data = Track().data + pos;
-				int len = sec.Len();
-				crc = Crc(Track().data + pos - 1, len + 1);
-				pos += len;
-				Write(pos++, crc >> 8);
-				Write(pos++, (byte)crc);
-			}
-			if(pos > Track().data_len)
-			{
-				assert(0); //track too long
-			}
-			WriteBlock(pos, 0x4e, Track().data_len - pos - 1); //gap3
-		}
-	}
-	eUdi::eTrack::eSector* s = GetSector(0, 0, 9);
-	if(!s)
-		return;
-	s->data[0xe2] = 1;					// first free track
-	s->data[0xe3] = 0x16;				// 80T,DS
-	SectorDataW(s, 0xe5, 2544);			// free sec
-	s->data[0xe7] = 0x10;				// trdos flag
-	UpdateCRC(s);
-}
-//=============================================================================
-//	eFdd::UpdateCRC
-//-----------------------------------------------------------------------------
-void eFdd::UpdateCRC(eUdi::eTrack::eSector* s) const
-{
-	int len = s->Len();
-	SectorDataW(s, len, swap_byte_order(Crc(s->data - 1, len + 1)));
+	enum { TRD_INFO_SIZE = 9 * 0x100 };
+	disk = new eUdi(eUdi::MAX_CYL, eUdi::MAX_SIDE, Max(image_size, size_t(TRD_INFO_SIZE)));
+	byte* s = disk->WritableSector(0, 0, 9);
+	s[0xe2] = 1;					// first free track
+	s[0xe3] = 0x16;				// 80T,DS
+	SetWord(s + 0xe5, 2544);		// free sec
+	s[0xe7] = 0x10;				// trdos flag
 }
 //=============================================================================
 //	eFdd::AddFile
 //-----------------------------------------------------------------------------
 bool eFdd::AddFile(const byte* hdr, const byte* data)
 {
-	eUdi::eTrack::eSector* s = GetSector(0, 0, 9);
+	byte* s = disk->WritableSector(0, 0, 9);
 	if(!s)
 		return false;
 	int len = hdr[13];
-	int pos = s->data[0xe4] * 0x10;
-	eUdi::eTrack::eSector* dir = GetSector(0, 0, 1 + pos / 0x100);
+	int pos = s[0xe4] * 0x10;
+	byte* dir = disk->WritableSector(0, 0, 1 + pos / 0x100);
 	if(!dir)
 		return false;
-	if(SectorDataW(s, 0xe5) < len) //disk full
+	if(Word(s + 0xe5) < len) //disk full
 		return false;
-	memcpy(dir->data + (pos & 0xff), hdr, 14);
-	SectorDataW(dir, (pos & 0xff) + 14, SectorDataW(s, 0xe1));
-	UpdateCRC(dir);
+	memcpy(dir + (pos & 0xff), hdr, 14);
+	SetWord(dir + (pos & 0xff) + 14, Word(s + 0xe1));
 
-	pos = s->data[0xe1] + 16 * s->data[0xe2];
-	s->data[0xe1] = (pos + len) & 0x0f, s->data[0xe2] = (pos + len) >> 4;
-	s->data[0xe4]++;
-	SectorDataW(s, 0xe5, SectorDataW(s, 0xe5) - len);
-	UpdateCRC(s);
+	pos = s[0xe1] + 16 * s[0xe2];
+	s[0xe1] = (pos + len) & 0x0f, s[0xe2] = (pos + len) >> 4;
+	s[0xe4]++;
+	SetWord(s + 0xe5, Word(s + 0xe5) - len);
 
-	// goto next track. s8 become invalid
 	for(int i = 0; i < len; ++i, ++pos)
 	{
 		int cyl = pos / 32;
 		int side = (pos / 16) & 1;
-		if(!WriteSector(cyl, side, (pos & 0x0f) + 1, data + i * 0x100))
+		byte* d = disk->WritableSector(cyl, side, (pos & 0x0f) + 1);
+		if(!d)
 			return false;
+		memcpy(d, data + i * 0x100, 0x100);
 	}
 	return true;
 }
@@ -350,17 +915,16 @@ bool eFdd::ReadScl(const void* data, size_t data_size)
 	if(memcmp(data, "SINCLAIR", 8) || int(data_size) < 9 + (0x100 + 14)*buf[8])
 		return false;
 
-	CreateTrd();
 	int size = 0;
 	for(int i = 0; i < buf[8]; ++i)
 	{
 		size += buf[9 + 14 * i + 13];
 	}
+	CreateTrd((16 + size) * 0x100); // files start from track 1
 	if(size > 2544)
 	{
-		eUdi::eTrack::eSector* s = GetSector(0, 0, 9);
-		SectorDataW(s, 0xe5, size);			// free sec
-		UpdateCRC(s);
+		byte* s = disk->WritableSector(0, 0, 9);
+		SetWord(s + 0xe5, size);		// free sec
 	}
 	const byte* d = buf + 9 + 14 * buf[8];
 	for(int i = 0; i < buf[8]; ++i)
@@ -374,16 +938,22 @@ bool eFdd::ReadScl(const void* data, size_t data_size)
 //=============================================================================
 //	eFdd::ReadTrd
 //-----------------------------------------------------------------------------
-bool eFdd::ReadTrd(const void* data, size_t data_size)
+bool eFdd::ReadTrd(xIo::eFileData* data)
 {
-	CreateTrd();
 	enum { TRD_SIZE = 655360 };
-	if(data_size > TRD_SIZE)
-		data_size = TRD_SIZE;
-	for(size_t i = 0; i < data_size; i += 0x100)
+	size_t data_size = Min(data->Size(), size_t(TRD_SIZE));
+	SAFE_DELETE(disk);
+	disk = new eUdi(eUdi::MAX_CYL, eUdi::MAX_SIDE, Max(data_size, size_t(9 * 0x100)));
+	if(data_size & 0xff) // sectors are read from source as whole
 	{
-		WriteSector(i >> 13, (i >> 12) & 1, ((i >> 8) & 0x0f) + 1, (const byte*)data + i);
+		xIo::eFileData* d = xIo::eFileData::Alloc((data_size + 0xff) & ~0xff);
+		memset(d->Buffer(), 0, d->Size());
+		memcpy(d->Buffer(), data->Data(), data_size);
+		disk->ImageSource(d);
+		d->Release();
 	}
+	else
+		disk->ImageSource(data);
 	return true;
 }
 //=============================================================================
@@ -463,6 +1033,44 @@ bool eFdd::ReadFdi(const void* _data, size_t data_size)
 				assert(0); //track too long
 			}
 			WriteBlock(pos, 0x4e, Track().data_len - pos - 1); //gap3
+			Track().dirty = false;
+		}
+	}
+	return true;
+}
+//=============================================================================
+//	eFdd::ReadUdi
+//-----------------------------------------------------------------------------
+bool eFdd::ReadUdi(const void* data, size_t data_size)
+{
+	const byte* buf = (const byte*)data;
+	if(data_size < 16 || memcmp(buf, "UDI!", 4) || buf[8] != 0)
+		return false;
+	int cyls = buf[9] + 1;
+	int sides = buf[10] + 1;
+	if(cyls > eUdi::MAX_CYL || sides > eUdi::MAX_SIDE)
+		return false;
+	SAFE_DELETE(disk);
+	disk = new eUdi(cyls, sides);
+
+	const byte* end = buf + Min(data_size, size_t(Dword(buf + 4)));
+	const byte* trk = buf + 16 + Dword(buf + 12);
+	for(int i = 0; i < cyls; ++i)
+	{
+		for(int j = 0; j < sides; ++j)
+		{
+			if(trk + 3 > end || trk[0] != 0) // MFM tracks only
+				return false;
+			int len = Word(trk + 1);
+			int id_len = len / 8 + ((len & 7) ? 1 : 0);
+			trk += 3;
+			if(trk + len + id_len > end)
+				return false;
+			disk->CreateTrack(i, j, len);
+			eUdi::eTrack& t = disk->Track(i, j);
+			memcpy(t.data, trk, len + id_len);
+			t.Update();
+			trk += len + id_len;
 		}
 	}
 	return true;
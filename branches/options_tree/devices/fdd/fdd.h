@@ -20,6 +20,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define	__FDD_H__
 
 #include "../../platform/endian.h"
+#include "../../platform/io.h"
+
+namespace xIo { class eFileData; }
 
 #pragma once
 
@@ -29,18 +32,27 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 class eUdi
 {
 public:
-	eUdi(int cyls, int sides);
-	~eUdi() { SAFE_DELETE_ARRAY(raw); }
+	eUdi(int cyls, int sides, size_t image_size = 0);
+	~eUdi();
 	int Cyls() const	{ return cyls; }
 	int Sides() const	{ return sides; }
+	size_t ImageSize() const { return image_size; }
+	void ImageSize(size_t size); // grow only
+	void ImageSource(xIo::eFileData* source); // drops written tracks, source is referenced
+	void StoreImage(byte* dst) const; // ImageSize() bytes
+	const byte* ImageSector(int cyl, int side, int sec) const;
+	byte* WritableSector(int cyl, int side, int sec); // track is copied from source on first write
 
 	enum { MAX_CYL = 86, MAX_SIDE = 2, MAX_SEC = 32 };
 	struct eTrack
 	{
-		eTrack() : data_len(6400), data(NULL), id(NULL), sectors_amount(0) {}
+		eTrack() : data_len(6400), data(NULL), id(NULL), sectors_amount(0), dirty(false), writing(false) {}
 		bool Marker(int pos) const;
+		int NextMarker(int pos, int end) const;
 		void Write(int pos, byte v, bool marker = false);
-		void Update(); //on raw changed
+		void WriteBlock(int& pos, byte v, int amount, bool marker = false);
+		void Update() { Update(0, data_len); } //on raw changed
+		void Update(int from, int to); //on raw [from, to) changed
 
 		int		data_len;
 		byte*	data;
@@ -61,14 +73,27 @@ public:
 		};
 		eSector	sectors[MAX_SEC];
 		int		sectors_amount;
+		bool	dirty; // written since created
+		bool	writing; // being written back, dirty again if write back fails
 	};
-	eTrack& Track(int cyl, int side) { return tracks[cyl][side]; }
+	eTrack& Track(int cyl, int side)
+	{
+		eTrack& t = tracks[cyl][side];
+		if(!t.data && cyl < cyls && side < sides)
+			CreateTrack(cyl, side);
+		return t;
+	}
+	eTrack* Created(int cyl, int side) { return tracks[cyl][side].data ? &tracks[cyl][side] : NULL; }
+	void CreateTrack(int cyl, int side, int data_len = 6250);
 
 protected:
 	int		cyls;
 	int		sides;
 	eTrack	tracks[MAX_CYL][MAX_SIDE];
-	byte*	raw;
+	// trd sectors, tracks are formatted from it on first access
+	xIo::eFileData* source;	// opened image, read only
+	byte*	image[MAX_CYL][MAX_SIDE];	// tracks written since opened
+	size_t	image_size;
 };
 
 //*****************************************************************************
@@ -78,7 +103,7 @@ class eFdd
 {
 public:
 	eFdd();
-	~eFdd() { SAFE_DELETE(disk); }
+	~eFdd();
 	qword Motor() const { return motor; }
 	void Motor(qword v) { motor = v; }
 	void Seek(int _cyl, int _side);
@@ -91,26 +116,30 @@ public:
 
 	bool DiskPresent() const	{ return disk != NULL; }
 	bool WriteProtect() const	{ return write_protect; }
-	bool Open(const char* type, const void* data, size_t data_size);
+	bool Open(const char* type, xIo::eFileData* data, const char* name = NULL);
+	void Insert(eFdd* image); // takes disk over, previous one goes to image
+	bool Store(const char* type, const char* name);
+	bool Flush(bool wait = false); // write back modified tracks, false if writer is busy
+	bool Written(); // false once write back has failed (its tracks are dirty again)
+	bool WriteError() { bool e = write_error; write_error = false; return e; }
 	bool BootExist();
 
 protected:
 	word Crc(byte* src, int size) const;
 	eUdi::eTrack::eSector* GetSector(int cyl, int side, int sec);
-	bool WriteSector(int cyl, int side, int sec, const byte* data);
-	void WriteBlock(int& pos, byte v, int amount, bool marker = false)
-	{
-		for(int i = 0; i < amount; ++i)
-		{
-			Track().Write(pos++, v, marker);
-		}
-	}
-	void CreateTrd();
+	void WriteBlock(int& pos, byte v, int amount, bool marker = false) { Track().WriteBlock(pos, v, amount, marker); }
+	void CreateTrd(size_t image_size);
 	bool AddFile(const byte* hdr, const byte* data);
 	bool ReadScl(const void* data, size_t data_size);
-	bool ReadTrd(const void* data, size_t data_size);
+	bool ReadTrd(xIo::eFileData* data);
 	bool ReadFdi(const void* data, size_t data_size);
-	void UpdateCRC(eUdi::eTrack::eSector* s) const;
+	bool ReadUdi(const void* data, size_t data_size);
+
+	bool StoreTrd(int cyl, int side);
+	size_t StoreScl(byte* dst);
+	size_t StoreUdi(byte* dst, int cyl, int side);
+	void CreateUdi();
+	bool Prepare(const char* type, bool all);
 
 protected:
 	qword	motor;	// 0 - not spinning, >0 - time when it'll stop
@@ -119,6 +148,14 @@ protected:
 	int		ts_byte; // cpu.t per byte
 	bool	write_protect;
 	eUdi*	disk;
+
+	char	file[xIo::MAX_PATH_LEN];	// image to write back modified tracks to
+	char	file_type[4];
+	byte*	udi;		// write back copy protected disks as udi
+	size_t	udi_size;
+	struct eFddWriter* writer;
+	bool	writing;		// write back in progress
+	bool	write_error;	// write back failed, not reported yet
 };
 
 #endif//__FDD_H__
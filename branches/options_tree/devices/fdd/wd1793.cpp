@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "../../std.h"
 #include "../../speccy.h"
+#include "../../z80/z80.h"
 #include "wd1793.h"
 #include "../memory.h"
 
@@ -44,6 +45,75 @@ static struct eOptionDrive : public xOptions::eOptionInt
 } op_drive;
 DECLARE_OPTION_ACCESSOR(eOptionInt, op_drive);
 
+static struct eOptionFddFast : public xOptions::eOptionBool
+{
+	eOptionFddFast() { Set(true); }
+	virtual const char* Name() const { return "fast disk"; }
+} op_fdd_fast;
+DECLARE_OPTION_ACCESSOR(eOptionBool, op_fdd_fast);
+
+namespace xZ80
+{
+
+//*****************************************************************************
+//	eZ80_FastDisk
+//-----------------------------------------------------------------------------
+class eZ80_FastDisk : public eZ80
+{
+public:
+	void StepSector();
+};
+//=============================================================================
+//	eZ80_FastDisk::StepSector
+//-----------------------------------------------------------------------------
+//	TR-DOS sector read/write (entries used by #3D13 functions 5, 6 and by
+//	all file commands): (#5D00) - address, (#5CFF) - sector - 1, track and
+//	side are selected already
+void eZ80_FastDisk::StepSector()
+{
+	word addr = pc;
+	if((addr != 0x3F0A && addr != 0x3F0E) || !memory->DosSelected())
+		return;
+	static const byte rw_sector[] =
+	{
+		0x3E, 0xA0, 0x18, 0x02, 0x3E, 0x80, 0x32, 0xFE, 0x5C, 0x16, 0x0A, 0xD5,
+		0xF3, 0x3A, 0xFF, 0x5C, 0x3C, 0xD3, 0x5F, 0x2A, 0x00, 0x5D, 0x0E, 0x7F,
+		0x3A, 0xFE, 0x5C, 0xD3, 0x1F, 0xFE, 0xA0, 0xF5, 0xCC, 0xBA, 0x3F, 0xF1,
+		0xC4, 0xD5, 0x3F, 0xD1, 0xFB, 0xDB, 0x1F, 0x47, 0xE6, 0x7F, 0xC8
+	};
+	for(dword i = 0; i < sizeof(rw_sector); ++i)
+	{
+		if(memory->Read(0x3F0A + i) != rw_sector[i])
+			return;
+	}
+	bool write = addr == 0x3F0A;
+	word buf = memory->Read(0x5D00) | memory->Read(0x5D01) << 8;
+	byte sec = memory->Read(0x5CFF) + 1;
+	eWD1793* wd = devices->Get<eWD1793>();
+	if(!wd->FastSector(buf, sec, write, t)) // let controller do it
+		return;
+	memory->Write(0x5CFE, write ? 0xA0 : 0x80);
+	hl = (buf + 0x100) & 0xFFFF;
+	c = 0x7F;
+	d = 0x0A;
+	a = b = 0;
+	f = ZF|HF|PV;
+	iff1 = iff2 = 1;
+	pc = memory->Read(sp) | memory->Read(sp + 1) << 8;
+	sp = (sp + 2) & 0xFFFF;
+}
+
+}
+//namespace xZ80
+
+static class eFastDiskEmul : public xZ80::eZ80::eHandlerStep
+{
+	virtual void Z80_Step(xZ80::eZ80* z80)
+	{
+		((xZ80::eZ80_FastDisk*)z80)->StepSector();
+	}
+} fde;
+
 //=============================================================================
 //	eWD1793::eWD1793
 //-----------------------------------------------------------------------------
@@ -51,6 +121,7 @@ eWD1793::eWD1793(eSpeccy* _speccy, eMemory* _memory) : speccy(_speccy), memory(_
 	, next(0), tshift(0), state(S_IDLE), state_next(S_IDLE), cmd(0), data(0)
 	, track(0), side(0), sector(0), direction(0), rqs(R_NONE), status(0)
 	, system(0), end_waiting_am(0), found_sec(NULL), rwptr(0), rwlen(0), crc(0), start_crc(-1)
+	, fast(false), last_cmd(0), flushed(0), retry(0)
 {
 }
 //=============================================================================
@@ -61,11 +132,40 @@ void eWD1793::Init()
 	fdd = fdds;
 }
 //=============================================================================
-//	eWD1793::Open
+//	eWD1793::GetRegs
 //-----------------------------------------------------------------------------
-bool eWD1793::Open(const char* type, const void* data, size_t data_size)
+void eWD1793::GetRegs(byte* regs) const
 {
-	int drive = *OPTION_GET(op_drive);
+	regs[0] = system;
+	regs[1] = track;
+	regs[2] = sector;
+	regs[3] = data;
+	regs[4] = status;
+}
+//=============================================================================
+//	eWD1793::SetRegs
+//	idle controller is restored, commands in progress aren't kept by snapshots
+//-----------------------------------------------------------------------------
+void eWD1793::SetRegs(const byte* regs)
+{
+	system = regs[0];
+	fdd = &fdds[system & 3];
+	side = 1 & ~(system >> 4);
+	track = regs[1];
+	sector = regs[2];
+	data = regs[3];
+	status = regs[4] & ~ST_BUSY;
+	state = S_IDLE;
+	rqs = R_INTRQ;
+}
+//=============================================================================
+//	eWD1793::Change
+//	controller is reset if disk is changed in current drive
+//-----------------------------------------------------------------------------
+int eWD1793::Change(int drive)
+{
+	if(drive < 0)
+		drive = *OPTION_GET(op_drive);
 	assert(drive >= 0 && drive < FDD_COUNT);
 	int current_fdd;
 	for(current_fdd = FDD_COUNT; --current_fdd >= 0;)
@@ -80,7 +180,30 @@ bool eWD1793::Open(const char* type, const void* data, size_t data_size)
 		rqs = R_INTRQ;
 		state = S_IDLE;
 	}
-	return fdds[drive].Open(type, data, data_size);
+	return drive;
+}
+//=============================================================================
+//	eWD1793::Open
+//-----------------------------------------------------------------------------
+bool eWD1793::Open(const char* type, xIo::eFileData* data, const char* name, int drive)
+{
+	return fdds[Change(drive)].Open(type, data, name);
+}
+//=============================================================================
+//	eWD1793::Insert
+//-----------------------------------------------------------------------------
+void eWD1793::Insert(eFdd* image, int drive)
+{
+	fdds[Change(drive)].Insert(image);
+}
+//=============================================================================
+//	eWD1793::Store
+//-----------------------------------------------------------------------------
+bool eWD1793::Store(const char* type, const char* name)
+{
+	int drive = *OPTION_GET(op_drive);
+	assert(drive >= 0 && drive < FDD_COUNT);
+	return fdds[drive].Store(type, name);
 }
 //=============================================================================
 //	eWD1793::BootExist
@@ -120,6 +243,108 @@ word eWD1793::Crc(byte v, word prev_crc = crc_initial) const
 	return crc;
 }
 //=============================================================================
+//	eWD1793::FastSector
+//-----------------------------------------------------------------------------
+//	whole sector transfer at once, false if it needs full controller emulation
+//	(no disk, not found, crc error, deleted data, write protect)
+bool eWD1793::FastSector(word addr, byte sec, bool write, int tact)
+{
+	Process(tact);
+	if(state != S_IDLE || !fdd->DiskPresent() || (write && fdd->WriteProtect()))
+		return false;
+	Load();
+	eUdi::eTrack::eSector* s = NULL;
+	for(int i = 0; i < fdd->Track().sectors_amount; ++i)
+	{
+		eUdi::eTrack::eSector& t = fdd->Sector(i);
+		if(t.Cyl() == track && t.Sec() == sec)
+		{
+			s = &t;
+			break;
+		}
+	}
+	if(!s || !s->data || s->Len() != 0x100 || s->data[-1] != 0xfb
+		|| Crc(s->id - 1, 5) != s->IdCrc())
+		return false;
+	if(write)
+	{
+		int pos = s->data - fdd->Track().data;
+		crc = Crc(0xfb);
+		for(int i = 0; i < 0x100; ++i)
+		{
+			data = memory->Read(addr + i);
+			crc = Crc(data, crc);
+			fdd->Write(pos++, data);
+		}
+		fdd->Write(pos++, crc >> 8);
+		fdd->Write(pos, (byte)crc);
+	}
+	else
+	{
+		if(Crc(s->data - 1, 0x101) != s->DataCrc())
+			return false;
+		for(int i = 0; i < 0x100; ++i)
+		{
+			memory->Write(addr + i, s->data[i]);
+		}
+		data = s->data[0xff];
+	}
+	found_sec = s;
+	sector = sec;
+	cmd = write ? 0xa0 : 0x80;
+	status = 0;
+	rqs = R_INTRQ;
+	next = last_cmd = speccy->T() + tact;
+	fdd->Motor(next + 2*Z80FQ);
+	return true;
+}
+//=============================================================================
+//	eWD1793::FrameEnd
+//-----------------------------------------------------------------------------
+void eWD1793::FrameEnd(dword tacts)
+{
+	if(fast && speccy->T() + tacts - last_cmd > Z80FQ/10)
+	{
+		fast = false;
+		if(speccy->CPU()->HandlerStep() == &fde)
+			speccy->CPU()->HandlerStep(NULL);
+	}
+	// write back modified disks in a second after last command, failed one in 10 seconds
+	qword time = speccy->T() + tacts;
+	for(int i = 0; i < FDD_COUNT; ++i)
+	{
+		if(!fdds[i].Written())
+			retry = time;
+	}
+	if((flushed != last_cmd && time - last_cmd > Z80FQ) || (retry && time - retry > Z80FQ*10))
+	{
+		bool done = true;
+		for(int i = 0; i < FDD_COUNT; ++i)
+		{
+			if(!fdds[i].Flush())
+				done = false;
+		}
+		if(done)
+		{
+			flushed = last_cmd;
+			retry = 0;
+		}
+	}
+}
+//=============================================================================
+//	eWD1793::WriteError
+//-----------------------------------------------------------------------------
+bool eWD1793::WriteError()
+{
+	bool e = false;
+	for(int i = 0; i < FDD_COUNT; ++i)
+	{
+		if(fdds[i].WriteError())
+			e = true;
+	}
+	return e;
+}
+//=============================================================================
 //	eWD1793::Process
 //-----------------------------------------------------------------------------
 void eWD1793::Process(int tact)
@@ -374,6 +599,7 @@ void eWD1793::Process(int tact)
 				fdd->Write(rwptr++, crc >> 8);
 				fdd->Write(rwptr++, (byte)crc);
 				fdd->Write(rwptr, 0xff);
+				fdd->Track().Update(found_sec->id + 6 + 22 - fdd->Track().data, rwptr + 1);
 				if(cmd & CB_MULTIPLE)
 				{
 					sector++;
@@ -640,24 +866,22 @@ void eWD1793::Load()
 	fdd->Seek(fdd->Cyl(), side);
 }
 //=============================================================================
-//	eWD1793::IoRead
+//	eWD1793::IoReadDecode
 //-----------------------------------------------------------------------------
-bool eWD1793::IoRead(word port) const
+void eWD1793::IoReadDecode(eIoDecoder* d) const
 {
-	if((port&0x1f) != 0x1f)
-		return false;
-	byte p = (byte)port;
-	return p == 0x1f || p == 0x3f || p == 0x5f || p == 0x7f || p & 0x80;
+	d->Port(0x00ff, 0x1f);
+	d->Port(0x00ff, 0x3f);
+	d->Port(0x00ff, 0x5f);
+	d->Port(0x00ff, 0x7f);
+	d->Port(0x009f, 0x9f);
 }
 //=============================================================================
-//	eWD1793::IoWrite
+//	eWD1793::IoWriteDecode
 //-----------------------------------------------------------------------------
-bool eWD1793::IoWrite(word port) const
+void eWD1793::IoWriteDecode(eIoDecoder* d) const
 {
-	if((port&0x1f) != 0x1f)
-		return false;
-	byte p = (byte)port;
-	return p == 0x1f || p == 0x3f || p == 0x5f || p == 0x7f || p & 0x80;
+	IoReadDecode(d);
 }
 //=============================================================================
 //	eWD1793::IoRead
@@ -705,7 +929,13 @@ void eWD1793::IoWrite(word port, byte v, int tact)
 		if(status & ST_BUSY)
 			return;
 		cmd = v;
-		next = speccy->T() + tact;
+		next = last_cmd = speccy->T() + tact;
+		// catch rom sector read/write from now, the trap can't be recorded or replayed
+		if(*OPTION_GET(op_fdd_fast) && !speccy->CPU()->HandlerStep() && !speccy->CPU()->HandlerIo())
+		{
+			speccy->CPU()->HandlerStep(&fde);
+			fast = true;
+		}
 		status |= ST_BUSY;
 		rqs = R_NONE;
 		if(cmd & 0x80) //read/write command
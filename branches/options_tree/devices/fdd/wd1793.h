@@ -25,26 +25,40 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 class eSpeccy;
+namespace xZ80 { class eZ80_FastDisk; }
 
 //*****************************************************************************
 //	WD1793
 //-----------------------------------------------------------------------------
 class eWD1793 : public eDevice
 {
+	friend class xZ80::eZ80_FastDisk;
 public:
 	eWD1793(eSpeccy* _speccy, eMemory* _memory);
 	virtual void Init();
-	virtual bool IoRead(word port) const;
-	virtual bool IoWrite(word port) const;
+	virtual void IoReadDecode(eIoDecoder* d) const;
+	virtual void IoWriteDecode(eIoDecoder* d) const;
 	virtual void IoRead(word port, byte* v, int tact);
 	virtual void IoWrite(word port, byte v, int tact);
-	bool Open(const char* type, const void* data, size_t data_size);
+	virtual void FrameEnd(dword tacts);
+	// drive < 0 is the selected one (op_drive)
+	bool Open(const char* type, xIo::eFileData* data, const char* name = NULL, int drive = -1);
+	// disk opened by standalone drive (parsed off the emulation thread), previous one goes to it
+	void Insert(eFdd* image, int drive = -1);
+	bool Store(const char* type, const char* name);
 	bool BootExist();
+	bool WriteError(); // true once modified disk write back has failed
+	bool Busy() const { return state != S_IDLE || (status & ST_BUSY); }
+	// system, track, sector, data & status registers (snapshot state)
+	void GetRegs(byte* regs) const;
+	void SetRegs(const byte* regs);
+	enum { FDD_COUNT = 4 };
 
 	static eDeviceId Id() { return D_WD1793; }
 	virtual dword IoNeed() const { return ION_WRITE|ION_READ; }
 	virtual const char* Name() const { return "wd1793"; }
 protected:
+	int		Change(int drive);
 	void	Process(int tact);
 	void	ReadFirstByte();
 	void	FindMarker();
@@ -53,6 +67,7 @@ protected:
 	void	GetIndex();
 	word	Crc(byte* src, int size) const;
 	word	Crc(byte v, word prev) const;
+	bool	FastSector(word addr, byte sec, bool write, int tact);
 
 	enum eCmdBit
 	{
@@ -120,7 +135,11 @@ protected:
 	word	crc;
 	int		start_crc;
 
-	enum { FDD_COUNT = 4 };
+	bool	fast;				// fast disk step handler set
+	qword	last_cmd;
+	qword	flushed;			// last_cmd when modified disks were written back
+	qword	retry;				// time of failed write back, it's retried later
+
 	eFdd*	fdd;
 	eFdd	fdds[FDD_COUNT];
 };
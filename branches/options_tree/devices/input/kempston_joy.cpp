@@ -23,17 +23,15 @@ void eKempstonJoy::Init() { Reset(); }
 void eKempstonJoy::Reset() { state = 0; }
 
 //=============================================================================
-//	eKempstonJoy::IoRead
+//	eKempstonJoy::IoReadDecode
 //-----------------------------------------------------------------------------
-bool eKempstonJoy::IoRead(word port) const
+void eKempstonJoy::IoReadDecode(eIoDecoder* d) const
 {
-	if(port&0x20)
-		return false;
-	// skip kempston mouse ports
-	port |= 0xfa00; // A13,A15 not used in decoding
-	if((port == 0xfadf || port == 0xfbdf || port == 0xffdf))
-		return false;
-	return true;
+	d->Port(0x0020, 0);
+	// skip kempston mouse ports, A9,A11-A15 not used in decoding
+	d->Except(0x05ff, 0x00df);
+	d->Except(0x05ff, 0x01df);
+	d->Except(0x05ff, 0x05df);
 }
 //=============================================================================
 //	eKempstonJoy::IoRead
@@ -28,7 +28,7 @@ class eKempstonJoy : public eDevice
 public:
 	virtual void Init();
 	virtual void Reset();
-	virtual bool IoRead(word port) const;
+	virtual void IoReadDecode(eIoDecoder* d) const;
 	virtual void IoRead(word port, byte* v, int tact);
 	void OnKey(char key, bool down);
 
@@ -30,16 +30,14 @@ void eKempstonMouse::Reset()
     buttons = 0xFF;
 }
 //=============================================================================
-//	eKempstonMouse::IoRead
+//	eKempstonMouse::IoReadDecode
 //-----------------------------------------------------------------------------
-bool eKempstonMouse::IoRead(word port) const
+void eKempstonMouse::IoReadDecode(eIoDecoder* d) const
 {
-	if(port&0x20)
-		return false;
-	port |= 0xfa00; // A13,A15 not used in decoding
-	if(port != 0xfadf && port != 0xfbdf && port != 0xffdf)
-		return false;
-	return true;
+	// A9,A11-A15 not used in decoding
+	d->Port(0x05ff, 0x00df);
+	d->Port(0x05ff, 0x01df);
+	d->Port(0x05ff, 0x05df);
 }
 //=============================================================================
 //	eKempstonMouse::IoRead
@@ -34,11 +34,11 @@ void eKeyboard::Reset()
 	memset(kbd, 0xff, sizeof(kbd));
 }
 //=============================================================================
-//	eKeyboard::IoRead
+//	eKeyboard::IoReadDecode
 //-----------------------------------------------------------------------------
-bool eKeyboard::IoRead(word port) const
+void eKeyboard::IoReadDecode(eIoDecoder* d) const
 {
-	return !(port&1);
+	d->Port(0x0001, 0);
 }
 //=============================================================================
 //	eKeyboard::IoRead
@@ -21,23 +21,41 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "../../z80/z80.h"
 #include "../memory.h"
 #include "tape.h"
+#include "../../tools/file_data.h"
+
+namespace xPlatform { OPTION_USING(eOptionBool, op_tape_fast); }
 
 //=============================================================================
-//	eTape::Init
+//	eTape::eTape
 //-----------------------------------------------------------------------------
-void eTape::Init()
+eTape::eTape(eSpeccy* s) : speccy(s)
 {
-	eInherited::Init();
-	max_pulses = 0;
-	tape_err = 0;
-
-	tape_image = NULL;
-	tape_imagesize = 0;
+	memset(&tape, 0, sizeof(tape));
+	tape_data = NULL;
+	tape_blocks = NULL;
+	tape_blocksize = 0;
 
 	tapeinfo = NULL;
 	tape_infosize = 0;
 
 	appendable = 0;
+
+	memset(edge_loops, 0, sizeof(edge_loops));
+	edge_loop_next = 0;
+	prev_pc = 0;
+	loaders = 0;
+
+	memset(loader_stats, 0, sizeof(loader_stats));
+
+	memset(&rec, 0, sizeof(rec));
+	rec.block = -1;
+}
+//=============================================================================
+//	eTape::Init
+//-----------------------------------------------------------------------------
+void eTape::Init()
+{
+	eInherited::Init();
 }
 //=============================================================================
 //	eTape::Reset
@@ -66,21 +84,21 @@ void eTape::Stop()
 //-----------------------------------------------------------------------------
 bool eTape::Started() const
 {
-	return tape.play_pointer != NULL;
+	return tape.play;
 }
 //=============================================================================
 //	eTape::Inserted
 //-----------------------------------------------------------------------------
 bool eTape::Inserted() const
 {
-	return tape_image != NULL;
+	return tape_blocks != NULL;
 }
 //=============================================================================
-//	eTape::IoRead
+//	eTape::IoReadDecode
 //-----------------------------------------------------------------------------
-bool eTape::IoRead(word port) const
+void eTape::IoReadDecode(eIoDecoder* d) const
 {
-	return !(port&1);
+	d->Port(0x0001, 0);
 }
 //=============================================================================
 //	eTape::IoRead
@@ -90,25 +108,35 @@ void eTape::IoRead(word port, byte* v, int tact)
 	*v |= TapeBit(tact) & 0x40;
 }
 //=============================================================================
-//	eTape::FindPulse
+//	eTape::IoWriteDecode
+//-----------------------------------------------------------------------------
+void eTape::IoWriteDecode(eIoDecoder* d) const
+{
+	d->Port(0x0001, 0);
+}
+//=============================================================================
+//	eTape::IoWrite
+//-----------------------------------------------------------------------------
+void eTape::IoWrite(word port, byte v, int tact)
+{
+	byte mic = (v & 0x08) ? 1 : 0;
+	if(mic == rec.mic)
+		return;
+	RecordEdge(speccy->T() + tact);
+	rec.mic = mic;
+}
+//=============================================================================
+//	eTape::FrameEnd
 //-----------------------------------------------------------------------------
-dword eTape::FindPulse(dword t)
+void eTape::FrameEnd(dword tacts)
 {
-	if(max_pulses < 0x100)
+	eInherited::FrameEnd(tacts);
+	if(rec.armed && speccy->T() + tacts - rec.edge > REC_GAP)
 	{
-		for(dword i = 0; i < max_pulses; i++)
-			if(tape_pulse[i] == t)
-				return i;
-		tape_pulse[max_pulses] = t;
-		return max_pulses++;
+		rec.armed = false;
+		if(!tape.play)
+			speccy->CPU()->HandlerStep(NULL);
 	}
-	tape_err = 1;
-	dword nearest = 0;
-	int delta = 0x7FFFFFFF;
-	for(dword i = 0; i < 0x100; i++)
-		if(delta > abs((int)t - (int)tape_pulse[i]))
-			nearest = i, delta = abs((int)t - (int)tape_pulse[i]);
-	return nearest;
 }
 //=============================================================================
 //	eTape::FindTapeIndex
@@ -116,23 +144,36 @@ dword eTape::FindPulse(dword t)
 void eTape::FindTapeIndex()
 {
 	for(dword i = 0; i < tape_infosize; i++)
-		if(tape.play_pointer >= tape_image + tapeinfo[i].pos)
+		if(tape.block >= tapeinfo[i].pos)
 			tape.index = i;
 }
 //=============================================================================
 //	eTape::FindTapeSizes
 //-----------------------------------------------------------------------------
-void eTape::FindTapeSizes()
+dword eTape::FindTapeSizes()
 {
 	for(dword i = 0; i < tape_infosize; i++)
+		tapeinfo[i].t_size = 0;
+	SeekTape(0);
+	dword pulse = 0, last = 0;
+	dword block = -1, cell = -1;
+	bool edge;
+	while(RawPulse(&pulse, &edge))
 	{
-		dword end = (i == tape_infosize - 1) ? tape_imagesize
-				: tapeinfo[i + 1].pos;
-		dword sz = 0;
-		for(dword j = tapeinfo[i].pos; j < end; j++)
-			sz += tape_pulse[tape_image[j]];
-		tapeinfo[i].t_size = sz;
+		if(tape.block != block)
+		{
+			block = tape.block;
+			cell = -1;
+			for(dword i = 0; i < tape_infosize; i++)
+				if(block >= tapeinfo[i].pos)
+					cell = i;
+		}
+		if(cell != (dword)-1 && pulse != (dword)-1)
+			tapeinfo[cell].t_size += pulse;
+		last = pulse;
 	}
+	SeekTape(0);
+	return last;
 }
 //=============================================================================
 //	eTape::StopTape
@@ -140,9 +181,9 @@ void eTape::FindTapeSizes()
 void eTape::StopTape()
 {
 	FindTapeIndex();
-	if(tape.play_pointer >= tape.end_of_tape)
+	if(!tape.next_ok)
 		tape.index = 0;
-	tape.play_pointer = 0;
+	tape.play = false;
 	tape.edge_change = 0x7FFFFFFFFFFFFFFFLL;
 	tape.tape_bit = -1;
 	speccy->CPU()->HandlerStep(NULL);
@@ -153,7 +194,7 @@ void eTape::StopTape()
 void eTape::ResetTape()
 {
 	tape.index = 0;
-	tape.play_pointer = 0;
+	tape.play = false;
 	tape.edge_change = 0x7FFFFFFFFFFFFFFFLL;
 	tape.tape_bit = -1;
 	speccy->CPU()->HandlerStep(NULL);
@@ -163,11 +204,10 @@ void eTape::ResetTape()
 //-----------------------------------------------------------------------------
 void eTape::StartTape()
 {
-	if(!tape_image)
+	if(!tape_blocks)
 		return;
-	tape.play_pointer = tape_image + tapeinfo[tape.index].pos;
-	tape.end_of_tape = tape_image + tape_imagesize;
-	tape.edge_change = speccy->T();
+	PlayFrom(tape_infosize ? tapeinfo[tape.index].pos : 0, 0);
+	tape.play = true;
 	tape.tape_bit = -1;
 //	speccy->CPU()->FastEmul(FastTapeEmul);
 }
@@ -176,36 +216,415 @@ void eTape::StartTape()
 //-----------------------------------------------------------------------------
 void eTape::CloseTape()
 {
-	if(tape_image)
+	if(tape_data)
+	{
+		tape_data->Release();
+		tape_data = 0;
+	}
+	if(tape_blocks)
 	{
-		free(tape_image);
-		tape_image = 0;
+		free(tape_blocks);
+		tape_blocks = 0;
 	}
 	if(tapeinfo)
 	{
 		free(tapeinfo);
 		tapeinfo = 0;
 	}
-	tape.play_pointer = 0; // stop tape
+	tape.play = false; // stop tape
 	tape.index = 0; // rewind tape
-	tape_err = max_pulses = tape_imagesize = tape_infosize = 0;
+	tape_blocksize = tape_infosize = 0;
+	loaders = 0;
+	memset(edge_loops, 0, sizeof(edge_loops)); // decoded again with new stats
+	edge_loop_next = 0;
 	tape.edge_change = 0x7FFFFFFFFFFFFFFFLL;
 	tape.tape_bit = -1;
 }
+//=============================================================================
+//	eTape::SeekTape
+//-----------------------------------------------------------------------------
+void eTape::SeekTape(dword block)
+{
+	tape.block = block;
+	tape.stage = 0;
+	tape.sym = NULL;
+	tape.level = 1; // first edge falls to low level
+	tape.loop_left = 0;
+	tape.next_ok = false;
+}
+//=============================================================================
+//	eTape::PlayFrom
+//-----------------------------------------------------------------------------
+void eTape::PlayFrom(dword block, int tact)
+{
+	SeekTape(block);
+	bool edge;
+	tape.next_ok = RawPulse(&tape.next, &edge); // decode ahead to merge pulses without edge
+	tape.edge_change = speccy->T() + tact;
+}
+//=============================================================================
+//	eTape::FindDataBlock
+//-----------------------------------------------------------------------------
+//	data block ROM loader is about to read (pilot not passed yet) or -1
+//	if tape plays anything else before it
+int eTape::FindDataBlock() const
+{
+	if(!tape.play || !tape.next_ok)
+		return -1;
+	dword i = tape.block;
+	if(tape_blocks[i].type == TB_DATA && tape.stage > 1)
+		++i; // block data is playing already
+	bool pilot = false;
+	for(; i < tape_blocksize; ++i)
+	{
+		const eTapeBlock& b = tape_blocks[i];
+		switch(b.type)
+		{
+		case TB_DATA:
+			if(b.pilot_len == (dword)-1 && !pilot)
+				return -1;
+			return i;
+		case TB_TONE:
+		case TB_PULSES: // pilot & sync of pure data block
+			pilot = true;
+			break;
+		case TB_PAUSE:
+			pilot = false;
+			break;
+		default:
+			return -1;
+		}
+	}
+	return -1;
+}
+//=============================================================================
+//	eTape::NextPulse
+//-----------------------------------------------------------------------------
+//	next pulse between two edges or -1 at the end of tape / on stop command
+dword eTape::NextPulse()
+{
+	if(!tape.next_ok)
+		return -1;
+	dword pulse = tape.next;
+	bool edge;
+	while((tape.next_ok = RawPulse(&tape.next, &edge)) && !edge
+			&& pulse != (dword)-1 && tape.next != (dword)-1)
+	{
+		pulse += tape.next;
+	}
+	return pulse;
+}
+//=============================================================================
+//	eTape::RawPulse
+//-----------------------------------------------------------------------------
+bool eTape::RawPulse(dword* pulse, bool* edge)
+{
+	while(tape.block < tape_blocksize)
+	{
+		*edge = true;
+		if(BlockPulse(pulse, edge))
+		{
+			if(*edge)
+				tape.level ^= 1;
+			return true;
+		}
+		++tape.block;
+		tape.stage = 0;
+		tape.sym = NULL;
+	}
+	return false;
+}
+
+static dword LastBits(byte last) { return last > 8 ? 8 : last; }
+static dword SampleBit(const byte* data, dword i) { return (data[i >> 3] >> (~i & 7)) & 1; }
+
+//=============================================================================
+//	eTape::BlockPulse
+//-----------------------------------------------------------------------------
+bool eTape::BlockPulse(dword* pulse, bool* edge)
+{
+	const eTapeBlock& b = tape_blocks[tape.block];
+	switch(b.type)
+	{
+	case TB_DATA:
+		switch(tape.stage)
+		{
+		case 0:
+			tape.stage = 1;
+			tape.pos = 0;
+			tape.count = (b.pilot_len != (dword)-1) ? b.pilot_len + 2 : 0;
+			// fallthrough
+		case 1: // pilot tone & sync pulses
+			if(tape.pos < tape.count)
+			{
+				dword i = tape.pos++;
+				*pulse = (i < b.pilot_len) ? b.pilot_t : (i == b.pilot_len) ? b.s1_t : b.s2_t;
+				return true;
+			}
+			tape.stage = 2;
+			tape.pos = 0;
+			tape.count = b.size ? ((b.size - 1) * 8 + LastBits(b.last)) * 2 : 0;
+			// fallthrough
+		case 2: // two pulses per bit
+			if(tape.pos < tape.count)
+			{
+				*pulse = SampleBit(b.data, tape.pos++ >> 1) ? b.one_t : b.zero_t;
+				return true;
+			}
+			tape.stage = 3;
+			if(b.pause)
+			{
+				*pulse = b.pause * 3500;
+				return true;
+			}
+		}
+		return false;
+	case TB_TONE:
+		if(tape.stage == 0)
+			tape.stage = 1, tape.pos = 0;
+		if(tape.pos >= b.pilot_len)
+			return false;
+		tape.pos++;
+		*pulse = b.pilot_t;
+		return true;
+	case TB_PULSES:
+		if(tape.stage == 0)
+			tape.stage = 1, tape.pos = 0;
+		if(tape.pos >= b.size)
+			return false;
+		*pulse = Word(b.data + tape.pos++ * 2);
+		return true;
+	case TB_DIRECT:
+		switch(tape.stage)
+		{
+		case 0:
+			tape.stage = 1;
+			tape.pos = 0;
+			tape.count = b.size ? (b.size - 1) * 8 + LastBits(b.last) : 0;
+			tape.t = 0;
+			tape.sample = 0;
+			// fallthrough
+		case 1: // pulse lasts until sample changes
+			while(tape.pos < tape.count)
+			{
+				byte s = SampleBit(b.data, tape.pos++);
+				tape.t += b.zero_t;
+				if(s != tape.sample)
+				{
+					tape.sample = s;
+					*pulse = tape.t;
+					tape.t = 0;
+					return true;
+				}
+			}
+			tape.stage = 2;
+			*pulse = tape.t; // last pulse ???
+			return true;
+		case 2:
+			tape.stage = 3;
+			if(b.pause)
+			{
+				*pulse = b.pause * 3500;
+				return true;
+			}
+		}
+		return false;
+	case TB_CSW:
+		switch(tape.stage)
+		{
+		case 0:
+			tape.stage = 1;
+			tape.ptr = b.data;
+			if(!(b.last & 1))
+			{
+				*pulse = 1;
+				return true;
+			}
+			// fallthrough
+		case 1: // RLE samples
+			if(tape.ptr < b.data + b.size)
+			{
+				dword len = *tape.ptr++ * b.pilot_t;
+				if(!len)
+				{
+					len = Dword(tape.ptr) / b.pilot_t;
+					tape.ptr += 4;
+				}
+				*pulse = len;
+				return true;
+			}
+			tape.stage = 2;
+			*pulse = 3500000 / 10;
+			return true;
+		}
+		return false;
+	case TB_GENERAL:
+		return GeneralPulse(pulse, edge);
+	case TB_PAUSE:
+		if(tape.stage)
+			return false;
+		tape.stage = 1;
+		*pulse = b.pause;
+		return true;
+	case TB_STOP: // at least 1ms pulse as specified in TZX 1.13
+		switch(tape.stage++)
+		{
+		case 0:	*pulse = 3500;	return true;
+		case 1:	*pulse = -1;	return true;
+		}
+		return false;
+	case TB_LOOP_START:
+		tape.loop_start = tape.block + 1;
+		tape.loop_left = b.size;
+		return false;
+	case TB_LOOP_END:
+		if(tape.loop_left && --tape.loop_left)
+			tape.block = tape.loop_start - 1;
+		return false;
+	}
+	return false;
+}
 
-#define align_by(a,b) (((dword)(a) + ((b)-1)) & ~((b)-1))
+//*****************************************************************************
+//	eGeneralHeader - TZX generalized data block (0x19) layout
+//-----------------------------------------------------------------------------
+struct eGeneralHeader
+{
+	enum { SIZE = 14 };
+	// size - block length, tables & data stream beyond it make header invalid
+	eGeneralHeader(const byte* h, dword size) : totp(0), npp(0), asp(0),
+		totd(0), npd(0), asd(0), nb(0), valid(false)
+	{
+		pilot_sym = prle = data_sym = stream = h;
+		if(size < SIZE)
+			return;
+		totp = Dword(h + 2);
+		npp = h[6];
+		asp = h[7] ? h[7] : 256;
+		totd = Dword(h + 8);
+		npd = h[12];
+		asd = h[13] ? h[13] : 256;
+		for(nb = 0; (1u << nb) < asd; ++nb)
+			;
+		qword prle_offs = SIZE + (totp ? asp * (1 + 2 * npp) : 0);
+		qword data_offs = prle_offs + 3 * (qword)totp;
+		qword stream_offs = data_offs + (totd ? asd * (1 + 2 * npd) : 0);
+		qword end = stream_offs + ((qword)totd * nb + 7) / 8;
+		if(end > size)
+			return;
+		valid = true;
+		pilot_sym = h + SIZE;
+		prle = h + prle_offs;
+		data_sym = h + data_offs;
+		stream = h + stream_offs;
+	}
+	dword totp, npp, asp;
+	dword totd, npd, asd, nb;
+	bool valid;
+	const byte* pilot_sym;
+	const byte* prle;
+	const byte* data_sym;
+	const byte* stream;
+};
 
 //=============================================================================
-//	eTape::Reserve
+//	eTape::GeneralPulse
+//-----------------------------------------------------------------------------
+bool eTape::GeneralPulse(dword* pulse, bool* edge)
+{
+	const eTapeBlock& b = tape_blocks[tape.block];
+	eGeneralHeader h(b.data, b.size);
+	if(!h.valid)
+		return false;
+	const byte* end = b.data + b.size;
+	for(;;)
+	{
+		if(tape.sym)
+		{
+			dword n = (tape.stage == 1) ? h.npp : h.npd;
+			if(tape.sym_pulse < n && (*pulse = Word(tape.sym + 1 + tape.sym_pulse * 2)) != 0)
+			{
+				if(!tape.sym_pulse++)
+				{
+					switch(*tape.sym & 3)
+					{
+					case 1: *edge = false;				break; // keep level
+					case 2: *edge = tape.level != 0;	break; // force low
+					case 3: *edge = tape.level == 0;	break; // force high
+					}
+				}
+				return true;
+			}
+			if(tape.sym_rep)
+			{
+				--tape.sym_rep;
+				tape.sym_pulse = 0;
+				continue;
+			}
+			tape.sym = NULL;
+		}
+		switch(tape.stage)
+		{
+		case 0:
+			tape.stage = 1;
+			tape.ptr = h.prle;
+			tape.count = h.totp;
+			// fallthrough
+		case 1: // pilot & sync symbols, run-length encoded
+			if(tape.count && tape.ptr + 3 <= end)
+			{
+				--tape.count;
+				dword s = tape.ptr[0];
+				dword rep = Word(tape.ptr + 1);
+				tape.ptr += 3;
+				if(rep && s < h.asp)
+				{
+					tape.sym = h.pilot_sym + s * (1 + 2 * h.npp);
+					tape.sym_pulse = 0;
+					tape.sym_rep = rep - 1;
+				}
+				continue;
+			}
+			tape.stage = 2;
+			tape.pos = 0;
+			tape.count = h.totd;
+			// fallthrough
+		case 2: // data symbols, nb bits each
+			if(tape.count && (qword)tape.pos + h.nb <= (qword)(end - h.stream) * 8)
+			{
+				--tape.count;
+				dword s = 0;
+				for(dword i = 0; i < h.nb; ++i)
+					s = (s << 1) | SampleBit(h.stream, tape.pos++);
+				if(s < h.asd)
+				{
+					tape.sym = h.data_sym + s * (1 + 2 * h.npd);
+					tape.sym_pulse = 0;
+					tape.sym_rep = 0;
+				}
+				continue;
+			}
+			tape.stage = 3;
+			if(b.pause)
+			{
+				*pulse = b.pause * 3500;
+				return true;
+			}
+		}
+		return false;
+	}
+}
+//=============================================================================
+//	eTape::AddBlock
 //-----------------------------------------------------------------------------
-void eTape::Reserve(dword datasize)
+eTape::eTapeBlock* eTape::AddBlock(byte type)
 {
-	const int blocksize = 16384;
-	dword newsize = align_by(datasize+tape_imagesize+1, blocksize);
-	if(!tape_image)
-		tape_image = (byte*)malloc(newsize);
-	if(align_by(tape_imagesize, blocksize) < newsize)
-		tape_image = (byte*)realloc(tape_image, newsize);
+	tape_blocks = (eTapeBlock*)realloc(tape_blocks, (tape_blocksize + 1)
+			* sizeof(eTapeBlock));
+	eTapeBlock* b = tape_blocks + tape_blocksize++;
+	memset(b, 0, sizeof(eTapeBlock));
+	b->type = type;
+	return b;
 }
 //=============================================================================
 //	eTape::MakeBlock
@@ -214,25 +633,17 @@ void eTape::MakeBlock(const byte* data, dword size, dword pilot_t, dword s1_t,
 		dword s2_t, dword zero_t, dword one_t, dword pilot_len, dword pause,
 		byte last)
 {
-	Reserve(size * 16 + pilot_len + 3);
-	if(pilot_len != (dword)-1)
-	{
-		dword t = FindPulse(pilot_t);
-		for(dword i = 0; i < pilot_len; i++)
-			tape_image[tape_imagesize++] = t;
-		tape_image[tape_imagesize++] = FindPulse(s1_t);
-		tape_image[tape_imagesize++] = FindPulse(s2_t);
-	}
-	dword t0 = FindPulse(zero_t), t1 = FindPulse(one_t);
-	for(; size > 1; size--, data++)
-		for(byte j = 0x80; j; j >>= 1)
-			tape_image[tape_imagesize++] = (*data & j) ? t1 : t0, tape_image[tape_imagesize++]
-					= (*data & j) ? t1 : t0;
-	for(byte j = 0x80; j != (byte)(0x80 >> last); j >>= 1) // last byte
-		tape_image[tape_imagesize++] = (*data & j) ? t1 : t0, tape_image[tape_imagesize++]
-				= (*data & j) ? t1 : t0;
-	if(pause)
-		tape_image[tape_imagesize++] = FindPulse(pause * 3500);
+	eTapeBlock* b = AddBlock(TB_DATA);
+	b->data = data;
+	b->size = size;
+	b->pilot_t = pilot_t;
+	b->s1_t = s1_t;
+	b->s2_t = s2_t;
+	b->zero_t = zero_t;
+	b->one_t = one_t;
+	b->pilot_len = pilot_len;
+	b->pause = pause;
+	b->last = last;
 }
 //=============================================================================
 //	eTape::Desc
@@ -267,7 +678,7 @@ void eTape::AllocInfocell()
 {
 	tapeinfo = (TAPEINFO*)realloc(tapeinfo, (tape_infosize + 1)
 			* sizeof(TAPEINFO));
-	tapeinfo[tape_infosize].pos = tape_imagesize;
+	tapeinfo[tape_infosize].pos = tape_blocksize;
 	appendable = 0;
 }
 //=============================================================================
@@ -286,15 +697,36 @@ void eTape::NamedCell(const void* nm, dword sz)
 //=============================================================================
 //	eTape::Open
 //-----------------------------------------------------------------------------
-bool eTape::Open(const char* type, const void* data, size_t data_size)
+bool eTape::Open(const char* type, xIo::eFileData* data)
 {
+	if(strcmp(type, "tap") && strcmp(type, "csw") && strcmp(type, "tzx"))
+		return false;
+	CloseTape();
+	tape_data = data;
+	tape_data->AddRef();
 	if(!strcmp(type, "tap"))
-		return ParseTAP(data, data_size);
+		return ParseTAP(tape_data->Data(), tape_data->Size());
 	else if(!strcmp(type, "csw"))
-		return ParseCSW(data, data_size);
-	else if(!strcmp(type, "tzx"))
-		return ParseTZX(data, data_size);
-	return false;
+		return ParseCSW(tape_data->Data(), tape_data->Size());
+	return ParseTZX(tape_data->Data(), tape_data->Size());
+}
+//=============================================================================
+//	eTape::Insert
+//-----------------------------------------------------------------------------
+void eTape::Insert(eTape* image)
+{
+	CloseTape();
+	tape_data = image->tape_data;
+	tape_blocks = image->tape_blocks;
+	tape_blocksize = image->tape_blocksize;
+	tapeinfo = image->tapeinfo;
+	tape_infosize = image->tape_infosize;
+	appendable = image->appendable;
+	tape = image->tape; // rewound by FindTapeSizes() after parsing
+	image->tape_data = NULL;
+	image->tape_blocks = NULL;
+	image->tapeinfo = NULL;
+	image->CloseTape();
 }
 //=============================================================================
 //	eTape::ParseTAP
@@ -302,7 +734,6 @@ bool eTape::Open(const char* type, const void* data, size_t data_size)
 bool eTape::ParseTAP(const void* data, size_t data_size)
 {
 	const byte* ptr = (const byte*)data;
-	CloseTape();
 	while(ptr < (const byte*)data + data_size)
 	{
 		dword size = Word(ptr);
@@ -326,27 +757,17 @@ bool eTape::ParseCSW(const void* data, size_t data_size)
 {
 	const byte* buf = (const byte*)data;
 	const dword Z80FQ = 3500000;
-	CloseTape();
 	NamedCell("CSW tape image");
 	if(buf[0x1B] != 1)
 		return false; // unknown compression type
 	dword rate = Z80FQ / Word(buf + 0x19); // usually 3.5mhz / 44khz
-	if(!rate)
+	if(!rate || data_size < 0x20)
 		return false;
-	Reserve(data_size - 0x18);
-	if(!(buf[0x1C] & 1))
-		tape_image[tape_imagesize++] = FindPulse(1);
-	for(const byte* ptr = (const byte*)data + 0x20; ptr < (const byte*)data + data_size;)
-	{
-		dword len = *ptr++ * rate;
-		if(!len)
-		{
-			len = Dword(ptr) / rate;
-			ptr += 4;
-		}
-		tape_image[tape_imagesize++] = FindPulse(len);
-	}
-	tape_image[tape_imagesize++] = FindPulse(Z80FQ / 10);
+	eTapeBlock* b = AddBlock(TB_CSW);
+	b->data = buf + 0x20;
+	b->size = data_size - 0x20;
+	b->pilot_t = rate;
+	b->last = buf[0x1C];
 	FindTapeSizes();
 	return true;
 }
@@ -556,12 +977,10 @@ void eTape::ParseHardware(const byte* ptr)
 //-----------------------------------------------------------------------------
 bool eTape::ParseTZX(const void* data, size_t data_size)
 {
-	byte* ptr = (byte*)data;
-	CloseTape();
-	dword size, pause, i, j, n, t, t0;
-	byte pl, last, *end;
-	byte* p;
-	dword loop_n = 0, loop_p = 0;
+	const byte* ptr = (const byte*)data; // image is read only
+	dword size, pause, i, j, n, t;
+	const byte* p;
+	eTapeBlock* b;
 	char nm[512];
 	while(ptr < (const byte*)data + data_size)
 	{
@@ -591,19 +1010,17 @@ bool eTape::ParseTZX(const void* data, size_t data_size)
 			break;
 		case 0x12: // pure tone
 			CreateAppendableBlock();
-			pl = FindPulse(Word(ptr));
-			n = Word(ptr + 2);
-			Reserve(n);
-			for(i = 0; i < n; i++)
-				tape_image[tape_imagesize++] = pl;
+			b = AddBlock(TB_TONE);
+			b->pilot_t = Word(ptr);
+			b->pilot_len = Word(ptr + 2);
 			ptr += 4;
 			break;
 		case 0x13: // sequence of pulses of different lengths
 			CreateAppendableBlock();
-			n = *ptr++;
-			Reserve(n);
-			for(i = 0; i < n; i++, ptr += 2)
-				tape_image[tape_imagesize++] = FindPulse(Word(ptr));
+			b = AddBlock(TB_PULSES);
+			b->size = *ptr++;
+			b->data = ptr;
+			ptr += b->size * 2;
 			break;
 		case 0x14: // pure data block
 			CreateAppendableBlock();
@@ -613,62 +1030,54 @@ bool eTape::ParseTZX(const void* data, size_t data_size)
 			ptr += size + 0x0A;
 			break;
 		case 0x15: // direct recording
-			size = 0xFFFFFF & Dword(ptr + 5);
-			t0 = Word(ptr);
-			pause = Word(ptr + 2);
-			last = ptr[4];
 			NamedCell("direct recording");
-			ptr += 8;
-			pl = 0;
-			n = 0;
-			for(i = 0; i < size; i++) // count number of pulses
-				for(j = 0x80; j; j >>= 1)
-					if((ptr[i] ^ pl) & j)
-						n++, pl ^= -1;
-			t = 0;
-			pl = 0;
-			Reserve(n + 2);
-			for(i = 1; i < size; i++, ptr++) // find pulses
-				for(j = 0x80; j; j >>= 1)
-				{
-					t += t0;
-					if((*ptr ^ pl) & j)
-					{
-						tape_image[tape_imagesize++] = FindPulse(t);
-						pl ^= -1;
-						t = 0;
-					}
-				}
-			// find pulses - last byte
-			for(j = 0x80; j != (byte)(0x80 >> last); j >>= 1)
+			b = AddBlock(TB_DIRECT);
+			b->zero_t = Word(ptr);
+			b->pause = Word(ptr + 2);
+			b->last = ptr[4];
+			b->size = 0xFFFFFF & Dword(ptr + 5);
+			b->data = ptr + 8;
+			ptr += b->size + 8;
+			break;
+		case 0x19: // generalized data block
+			{
+				size_t left = (const byte*)data + data_size - ptr;
+				left = (left > 4) ? left - 4 : 0;
+				size = left ? Dword(ptr) : 0;
+				if(size > left)
+					size = dword(left);
+			}
+			AllocInfocell();
 			{
-				t += t0;
-				if((*ptr ^ pl) & j)
+				eGeneralHeader h(ptr + 4, size);
+				if(!h.valid)
+					sprintf(tapeinfo[tape_infosize].desc, "generalized data, broken");
+				else if(h.asd == 2 && h.totd >= 16)
+					Desc(h.stream, h.totd / 8, tapeinfo[tape_infosize].desc);
+				else
+					sprintf(tapeinfo[tape_infosize].desc, "generalized data, %d symbols", h.totd);
+				tape_infosize++;
+				if(!h.valid)
 				{
-					tape_image[tape_imagesize++] = FindPulse(t);
-					pl ^= -1;
-					t = 0;
+					ptr += size + 4;
+					break;
 				}
 			}
-			ptr++;
-			tape_image[tape_imagesize++] = FindPulse(t); // last pulse ???
-			if(pause)
-				tape_image[tape_imagesize++] = FindPulse(pause * 3500);
+			b = AddBlock(TB_GENERAL);
+			b->data = ptr + 4;
+			b->size = size;
+			b->pause = Word(ptr + 4);
+			ptr += size + 4;
 			break;
 		case 0x20: // pause (silence) or 'stop the tape' command
 			pause = Word(ptr);
 			sprintf(nm, pause ? "pause %d ms" : "stop the tape", pause);
 			NamedCell(nm);
-			Reserve(2);
 			ptr += 2;
-			if(!pause)
-			{ // at least 1ms pulse as specified in TZX 1.13
-				tape_image[tape_imagesize++] = FindPulse(3500);
-				pause = -1;
-			}
+			if(pause)
+				AddBlock(TB_PAUSE)->pause = pause * 3500;
 			else
-				pause *= 3500;
-			tape_image[tape_imagesize++] = FindPulse(pause);
+				AddBlock(TB_STOP);
 			break;
 		case 0x21: // group start
 			n = *ptr++;
@@ -683,20 +1092,11 @@ bool eTape::ParseTZX(const void* data, size_t data_size)
 			ptr += 2;
 			break;
 		case 0x24: // loop start
-			loop_n = Word(ptr);
-			loop_p = tape_imagesize;
+			AddBlock(TB_LOOP_START)->size = Word(ptr);
 			ptr += 2;
 			break;
 		case 0x25: // loop end
-			if(!loop_n)
-				break;
-			size = tape_imagesize - loop_p;
-			Reserve((loop_n - 1) * size);
-			for(i = 1; i < loop_n; i++)
-				memcpy(tape_image + loop_p + i * size, tape_image + loop_p,
-						size);
-			tape_imagesize += (loop_n - 1) * size;
-			loop_n = 0;
+			AddBlock(TB_LOOP_END);
 			break;
 		case 0x26: // call
 			NamedCell("* call");
@@ -732,18 +1132,17 @@ bool eTape::ParseTZX(const void* data, size_t data_size)
 			ptr += n;
 			appendable = 1;
 			break;
-		case 0x31: // message block
+		case 0x31: // message block, lines are split in local copy (image is read only)
 			NamedCell("- MESSAGE BLOCK ");
-			end = ptr + 2 + ptr[1];
-			pl = *end;
-			*end = 0;
-			for(p = ptr + 2; p < end; p++)
-				if(*p == 0x0D)
-					*p = 0;
-			for(p = ptr + 2; p < end; p += strlen((char*)p) + 1)
-				NamedCell(p);
-			*end = pl;
-			ptr = end;
+			n = ptr[1];
+			memcpy(nm, ptr + 2, n);
+			nm[n] = 0;
+			for(i = 0; i < n; i++)
+				if(nm[i] == 0x0D)
+					nm[i] = 0;
+			for(i = 0; i < n; i += strlen(nm + i) + 1)
+				NamedCell(nm + i);
+			ptr += 2 + n;
 			NamedCell("-");
 			break;
 		case 0x32: // archive info
@@ -788,11 +1187,11 @@ bool eTape::ParseTZX(const void* data, size_t data_size)
 					info = "info";
 					break;
 				}
-				dword size = *p + 1;
-				char tmp = p[size];
-				p[size] = 0;
-				sprintf(nm, "%s: %s", info, p + 1);
-				p[size] = tmp;
+				char text[256];
+				dword size = *p++;
+				memcpy(text, p, size);
+				text[size] = 0;
+				sprintf(nm, "%s: %s", info, text);
 				p += size;
 				NamedCell(nm);
 			}
@@ -838,7 +1237,7 @@ bool eTape::ParseTZX(const void* data, size_t data_size)
 				nm[3] = 0;
 			}
 			else
-				sprintf(nm, "* custom info: %s", ptr), nm[15 + 16] = 0;
+				sprintf(nm, "* custom info: %.16s", ptr);
 			NamedCell(nm);
 			ptr += 0x14 + Dword(ptr + 0x10);
 			break;
@@ -861,12 +1260,218 @@ bool eTape::ParseTZX(const void* data, size_t data_size)
 			while(strlen(tapeinfo[i].desc) < sizeof(tapeinfo[i].desc) - 1)
 				strcat(tapeinfo[i].desc, "-");
 	}
-	if(tape_imagesize && tape_pulse[tape_image[tape_imagesize - 1]] < 350000)
-		Reserve(1), tape_image[tape_imagesize++] = FindPulse(350000); // small pause [rqd for 3ddeathchase]
-	FindTapeSizes();
+	if(tape_blocksize && FindTapeSizes() < 350000)
+	{
+		AddBlock(TB_PAUSE)->pause = 350000; // small pause [rqd for 3ddeathchase]
+		if(tape_infosize)
+			tapeinfo[tape_infosize - 1].t_size += 350000;
+	}
 	return (ptr == (const byte*)data + data_size);
 }
 //=============================================================================
+//	eTape::Store
+//-----------------------------------------------------------------------------
+//	writes recorded blocks (tap keeps only standard ones) and clears recording
+bool eTape::Store(const char* type, const char* name)
+{
+	bool tzx = !strcmp(type, "tzx");
+	if(!tzx && strcmp(type, "tap"))
+		return false;
+	RecordClose(0);
+	if(!rec.size)
+		return false;
+	FILE* f = fopen(name, "wb");
+	if(!f)
+		return false;
+	bool ok = true;
+	dword stored = 0;
+	if(tzx)
+	{
+		static const byte header[] = { 'Z', 'X', 'T', 'a', 'p', 'e', '!', 0x1A, 1, 20 };
+		ok = fwrite(header, 1, sizeof(header), f) == sizeof(header)
+			&& fwrite(rec.data, 1, rec.size, f) == rec.size;
+		stored = rec.size;
+	}
+	else
+	{
+		for(dword i = 0; ok && i < rec.size; )
+		{
+			const byte* b = rec.data + i;
+			if(*b == 0x10)
+			{
+				dword size = Word(b + 3);
+				ok = fwrite(b + 3, 1, size + 2, f) == size + 2;
+				stored += size;
+				i += size + 5;
+			}
+			else // direct recording
+				i += (0xFFFFFF & Dword(b + 6)) + 9;
+		}
+	}
+	fclose(f);
+	if(!ok || !stored)
+	{
+		remove(name);
+		return false;
+	}
+	rec.size = 0;
+	return true;
+}
+//=============================================================================
+//	eTape::RecordAlloc
+//-----------------------------------------------------------------------------
+byte* eTape::RecordAlloc(dword size)
+{
+	if(rec.size + size > REC_MAX)
+		return NULL;
+	if(rec.size + size > rec.alloc)
+	{
+		dword alloc = rec.alloc ? rec.alloc * 2 : 65536;
+		while(alloc < rec.size + size)
+			alloc *= 2;
+		byte* data = (byte*)realloc(rec.data, alloc);
+		if(!data)
+			return NULL;
+		rec.data = data;
+		rec.alloc = alloc;
+	}
+	byte* ptr = rec.data + rec.size;
+	rec.size += size;
+	return ptr;
+}
+//=============================================================================
+//	eTape::RecordEdge
+//-----------------------------------------------------------------------------
+//	MIC output is recorded as direct recording blocks, a block is started
+//	after a pause and kept only if it begins with a pilot tone
+void eTape::RecordEdge(qword t)
+{
+	qword pulse = t - rec.edge;
+	rec.edge = t;
+	if(pulse > REC_GAP || (rec.block == (dword)-1 && !rec.skip))
+	{
+		RecordClose(pulse < 65535 * 3500 ? dword(pulse / 3500) : 65535);
+		rec.skip = false;
+		byte* b = RecordAlloc(9);
+		if(!b)
+			return;
+		memset(b, 0, 9);
+		b[0] = 0x15;
+		b[1] = byte(REC_SAMPLE);
+		b[2] = byte(REC_SAMPLE >> 8);
+		rec.block = rec.size - 9;
+		rec.bits = rec.frac = rec.pulses = 0;
+		return;
+	}
+	if(rec.skip || rec.block == (dword)-1)
+		return;
+	if(rec.pulses < REC_PILOT)
+	{
+		if(!rec.pulses)
+			rec.pilot = dword(pulse);
+		dword d = dword(pulse) > rec.pilot ? dword(pulse) - rec.pilot : rec.pilot - dword(pulse);
+		if(rec.pilot < 1000 || rec.pilot > 4000 || d > rec.pilot / 8)
+		{
+			rec.size = rec.block; // sound or noise
+			rec.block = -1;
+			rec.skip = true;
+			return;
+		}
+		if(++rec.pulses == REC_PILOT && xPlatform::OPTION_GET(op_tape_fast)
+			&& *xPlatform::OPTION_GET(op_tape_fast) && !speccy->CPU()->HandlerStep()
+			&& !speccy->CPU()->HandlerIo())
+		{
+			speccy->CPU()->HandlerStep(fast_tape_emul);
+			rec.armed = true;
+		}
+	}
+	dword samples = (dword(pulse) + rec.frac) / REC_SAMPLE;
+	rec.frac = (dword(pulse) + rec.frac) % REC_SAMPLE;
+	byte level = rec.mic ? 0xFF : 0;
+	dword bit = rec.bits & 7;
+	if(bit && samples) // fill up last byte
+	{
+		dword n = 8 - bit < samples ? 8 - bit : samples;
+		rec.data[rec.size - 1] |= (level & (0xFF >> bit)) & ~(0xFF >> (bit + n));
+		rec.bits += n;
+		samples -= n;
+	}
+	if(!samples)
+		return;
+	byte* ptr = RecordAlloc((samples + 7) / 8);
+	if(!ptr)
+	{
+		RecordClose(0);
+		rec.skip = true;
+		return;
+	}
+	memset(ptr, level, (samples + 7) / 8);
+	if(samples & 7)
+		ptr[samples / 8] &= ~(0xFF >> (samples & 7));
+	rec.bits += samples;
+}
+//=============================================================================
+//	eTape::RecordClose
+//-----------------------------------------------------------------------------
+void eTape::RecordClose(dword pause)
+{
+	if(rec.block == (dword)-1)
+		return;
+	if(rec.pulses < REC_PILOT) // too short to be a tape signal
+	{
+		rec.size = rec.block;
+		rec.block = -1;
+		return;
+	}
+	byte* b = rec.data + rec.block;
+	dword size = (rec.bits + 7) / 8;
+	b[3] = byte(pause);
+	b[4] = byte(pause >> 8);
+	b[5] = byte(((rec.bits - 1) & 7) + 1);
+	b[6] = byte(size);
+	b[7] = byte(size >> 8);
+	b[8] = byte(size >> 16);
+	rec.block = -1;
+}
+//=============================================================================
+//	eTape::RecordBlock
+//-----------------------------------------------------------------------------
+//	standard speed block saved by ROM trap, edges recorded so far are dropped,
+//	returns block data to fill
+byte* eTape::RecordBlock(dword size)
+{
+	if(rec.block != (dword)-1)
+	{
+		rec.size = rec.block;
+		rec.block = -1;
+	}
+	rec.skip = true;
+	byte* b = RecordAlloc(size + 5);
+	if(!b)
+		return NULL;
+	b[0] = 0x10;
+	b[1] = byte(1000 & 0xFF); // pause ms
+	b[2] = byte(1000 >> 8);
+	b[3] = byte(size);
+	b[4] = byte(size >> 8);
+	return b + 5;
+}
+//=============================================================================
+//	eTape::LoaderStats
+//-----------------------------------------------------------------------------
+int eTape::LoaderStats(word pc)
+{
+	for(dword i = 0; i < loaders; i++)
+		if(loader_stats[i].pc == pc)
+			return i;
+	if(loaders == MAX_LOADERS)
+		return -1;
+	eLoaderStats& s = loader_stats[loaders];
+	s.pc = pc;
+	s.hits = s.misses = 0;
+	return loaders++;
+}
+//=============================================================================
 //	eTape::TapeBit
 //-----------------------------------------------------------------------------
 byte eTape::TapeBit(int tact)
@@ -881,10 +1486,9 @@ byte eTape::TapeBit(int tact)
 			short mono = tape.tape_bit ? vol : 0;
 			Update(tact, mono, mono);
 		}
-		dword pulse;
 		tape.tape_bit ^= -1;
-		if(tape.play_pointer >= tape.end_of_tape ||
-				(pulse = tape_pulse[*tape.play_pointer++]) == (dword)-1)
+		dword pulse = NextPulse();
+		if(pulse == (dword)-1)
 			StopTape();
 		else
 			tape.edge_change += pulse;
@@ -903,250 +1507,602 @@ class eZ80_FastTape: public xZ80::eZ80
 public:
 	void StepEdge();
 	void StepTrap();
+	void StepSaveTrap();
 	void Step()
 	{
 		StepTrap();
+		StepSaveTrap();
 		StepEdge();
 	}
+protected:
+	enum eOpType { OT_NEXT, OT_JUMP, OT_BRANCH, OT_RET, OT_RET_COND };
+	enum { LOOP_OPS = 24 };
+	struct eOp
+	{
+		word pc;
+		byte len;
+		byte type;
+		byte tacts;         // tacts if jump not taken
+		byte tacts_jump;
+		word target;
+		byte reads;         // registers (bit per z80 register encoding, 6 unused)
+		byte writes;
+		byte flags_r;
+		byte flags_w;
+		bool in;            // port read
+		bool in_c;          // in r,(c)
+		byte port;          // in a,(n) port
+		int count;          // inc/dec/djnz register or -1
+		int step;
+	};
+	struct ePath
+	{
+		eOp op[LOOP_OPS];
+		bool jump[LOOP_OPS];
+		int size;
+	};
+	bool DecodeOp(word addr, eOp* op) const;
+	void WalkLoop(const eTape::eEdgeLoop& loop, word addr, ePath* path, ePath* found, int* paths) const;
+	bool DecodeLoop(eTape::eEdgeLoop* loop) const;
+	eTape::eEdgeLoop* FindLoop(eTape* tape, word addr, word jump) const;
+	void SkipLoop(eTape* tape, eTape::eEdgeLoop* loop);
+	void Regs(byte* regs) const
+	{
+		regs[0] = b; regs[1] = c; regs[2] = d; regs[3] = e;
+		regs[4] = h; regs[5] = l; regs[6] = 0; regs[7] = a;
+	}
+	byte* Reg(int r)
+	{
+		switch(r)
+		{
+		case 0: return &b;
+		case 1: return &c;
+		case 2: return &d;
+		case 3: return &e;
+		case 4: return &h;
+		case 5: return &l;
+		}
+		return &a;
+	}
 };
 //=============================================================================
-//	eZ80_FastTape::StepEdge
+//	eZ80_FastTape::DecodeOp
 //-----------------------------------------------------------------------------
-void eZ80_FastTape::StepEdge()
+//	instructions allowed in edge sampling loops: no writes to memory, stack or ports
+bool eZ80_FastTape::DecodeOp(word addr, eOp* op) const
+{
+	static const byte cond_flags[] = { ZF, ZF, CF, CF, PV, PV, SF, SF };
+	const byte all = SF|ZF|F5|HF|F3|PV|NF|CF;
+	const byte HL = (1 << 4)|(1 << 5);
+	const byte A = 1 << 7;
+	byte p0 = memory->Read(addr);
+	byte p1 = memory->Read(addr + 1);
+	int r = p0 & 7, rd = (p0 >> 3) & 7;
+	memset(op, 0, sizeof(eOp));
+	op->pc = addr;
+	op->len = 1;
+	op->tacts = 4;
+	op->count = -1;
+	op->type = OT_NEXT;
+	if(p0 == 0x00) // nop
+		return true;
+	if(p0 == 0x07 || p0 == 0x0F || p0 == 0x17 || p0 == 0x1F) // rlca, rrca, rla, rra
+	{
+		op->reads = op->writes = A;
+		op->flags_r = (p0 >= 0x17) ? CF : 0;
+		op->flags_w = F5|HF|F3|NF|CF;
+		return true;
+	}
+	if(p0 == 0x2F) // cpl
+	{
+		op->reads = op->writes = A;
+		op->flags_w = F5|HF|F3|NF;
+		return true;
+	}
+	if(p0 == 0x37 || p0 == 0x3F) // scf, ccf
+	{
+		op->flags_r = (p0 == 0x3F) ? CF : 0;
+		op->flags_w = F5|HF|F3|NF|CF;
+		return true;
+	}
+	if(p0 < 0x40 && (r == 4 || r == 5) && rd != 6) // inc r, dec r
+	{
+		op->reads = op->writes = 1 << rd;
+		op->flags_w = all & ~CF;
+		op->count = rd;
+		op->step = (r == 4) ? 1 : -1;
+		return true;
+	}
+	if(p0 < 0x40 && r == 6 && rd != 6) // ld r,n
+	{
+		op->len = 2;
+		op->tacts = 7;
+		op->writes = 1 << rd;
+		return true;
+	}
+	if(p0 >= 0x40 && p0 < 0x80 && rd != 6) // ld r,r'
+	{
+		op->reads = (r == 6) ? HL : 1 << r;
+		op->writes = 1 << rd;
+		op->tacts = (r == 6) ? 7 : 4;
+		return true;
+	}
+	if(p0 >= 0x80 && p0 < 0xC0) // alu a,r
+	{
+		op->reads = A | ((r == 6) ? HL : 1 << r);
+		op->writes = (rd == 7) ? 0 : A; // cp
+		op->tacts = (r == 6) ? 7 : 4;
+		op->flags_r = (rd == 1 || rd == 3) ? CF : 0; // adc, sbc
+		op->flags_w = all;
+		return true;
+	}
+	if(p0 >= 0xC0 && r == 6) // alu a,n
+	{
+		op->len = 2;
+		op->tacts = 7;
+		op->reads = A;
+		op->writes = (rd == 7) ? 0 : A;
+		op->flags_r = (rd == 1 || rd == 3) ? CF : 0;
+		op->flags_w = all;
+		return true;
+	}
+	if(p0 == 0xDB) // in a,(n)
+	{
+		op->len = 2;
+		op->tacts = 11;
+		op->reads = op->writes = A;
+		op->in = true;
+		op->port = p1;
+		return true;
+	}
+	if(p0 == 0xED && (p1 & 0xC7) == 0x40 && ((p1 >> 3) & 7) != 6) // in r,(c)
+	{
+		op->len = 2;
+		op->tacts = 12;
+		op->reads = (1 << 0)|(1 << 1);
+		op->writes = 1 << ((p1 >> 3) & 7);
+		op->flags_w = all & ~CF;
+		op->in = op->in_c = true;
+		return true;
+	}
+	if(p0 == 0xCB)
+	{
+		int rr = p1 & 7;
+		op->len = 2;
+		op->tacts = 8;
+		op->reads = (rr == 6) ? HL : 1 << rr;
+		if(p1 >= 0x40 && p1 < 0x80) // bit n,r
+		{
+			op->tacts = (rr == 6) ? 12 : 8;
+			op->flags_w = all & ~CF;
+			return true;
+		}
+		if(rr == 6)
+			return false;
+		op->writes = 1 << rr;
+		if(p1 < 0x40) // rotates & shifts
+		{
+			op->flags_r = ((p1 >> 3) == 2 || (p1 >> 3) == 3) ? CF : 0; // rl, rr
+			op->flags_w = all;
+		}
+		return true;
+	}
+	switch(p0)
+	{
+	case 0x10: // djnz
+		op->len = 2;
+		op->type = OT_BRANCH;
+		op->tacts = 8;
+		op->tacts_jump = 13;
+		op->target = addr + 2 + (signed char)p1;
+		op->reads = op->writes = 1 << 0;
+		op->count = 0;
+		op->step = -1;
+		return true;
+	case 0x18: // jr
+		op->len = 2;
+		op->type = OT_JUMP;
+		op->tacts_jump = 12;
+		op->target = addr + 2 + (signed char)p1;
+		return true;
+	case 0x20: case 0x28: case 0x30: case 0x38: // jr cc
+		op->len = 2;
+		op->type = OT_BRANCH;
+		op->tacts = 7;
+		op->tacts_jump = 12;
+		op->target = addr + 2 + (signed char)p1;
+		op->flags_r = cond_flags[rd - 4];
+		return true;
+	case 0xC3: // jp
+		op->len = 3;
+		op->type = OT_JUMP;
+		op->tacts_jump = 10;
+		op->target = p1 + memory->Read(addr + 2) * 0x100;
+		return true;
+	case 0xC9: // ret
+		op->type = OT_RET;
+		return true;
+	}
+	if(p0 >= 0xC0 && r == 2) // jp cc
+	{
+		op->len = 3;
+		op->type = OT_BRANCH;
+		op->tacts = op->tacts_jump = 10;
+		op->target = p1 + memory->Read(addr + 2) * 0x100;
+		op->flags_r = cond_flags[rd];
+		return true;
+	}
+	if(p0 >= 0xC0 && r == 0) // ret cc
+	{
+		op->type = OT_RET_COND;
+		op->tacts = 5;
+		op->flags_r = cond_flags[rd];
+		return true;
+	}
+	return false;
+}
+//=============================================================================
+//	eZ80_FastTape::WalkLoop
+//-----------------------------------------------------------------------------
+//	find paths from loop start back to it, jumps out of loop code end the path
+void eZ80_FastTape::WalkLoop(const eTape::eEdgeLoop& loop, word addr, ePath* path,
+		ePath* found, int* paths) const
 {
-	byte p0 = memory->Read(pc + 0);
-	byte p1 = memory->Read(pc + 1);
-	byte p2 = memory->Read(pc + 2);
-	byte p3 = memory->Read(pc + 3);
-	if(p0 == 0x3D && p1 == 0x20 && p2 == 0xFD && p3 == 0xA7)
-	{ // dec a:jr nz,$-1
-		t += ((byte)(a - 1)) * 16;
-		a = 1;
+	if(*paths > 1)
+		return;
+	if(path->size && addr == loop.pc)
+	{
+		if(!(*paths)++)
+			*found = *path;
 		return;
 	}
-	if(p0 == 0x10 && p1 == 0xFE)
-	{ // djnz $
-		t += ((byte)(b - 1)) * 13;
-		b = 1;
+	if((word)(addr - loop.pc) >= loop.size)
 		return;
+	for(int n = 0; n < path->size; ++n)
+	{
+		if(path->op[n].pc == addr) // inner loop
+		{
+			*paths = 2;
+			return;
+		}
 	}
-	if(p0 == 0x3D && p1 == 0xC2 && pc == dword(p3) * 0x100 + p2)
-	{ // dec a:jp nz,$-1
-		t += ((byte)(a - 1)) * 14;
-		a = 1;
+	int n = path->size;
+	eOp* op = &path->op[n];
+	if(n == LOOP_OPS || !DecodeOp(addr, op))
+	{
+		*paths = 2;
 		return;
 	}
-	if(p0 == 0x04 && p1 == 0xC8 && p2 == 0x3E)
-	{
-		byte p04 = memory->Read(pc + 4);
-		byte p05 = memory->Read(pc + 5);
-		byte p06 = memory->Read(pc + 6);
-		byte p07 = memory->Read(pc + 7);
-		byte p08 = memory->Read(pc + 8);
-		byte p09 = memory->Read(pc + 9);
-		byte p10 = memory->Read(pc + 10);
-		byte p11 = memory->Read(pc + 11);
-		byte p12 = memory->Read(pc + 12);
-		if(p04 == 0xDB && p05 == 0xFE && p06 == 0x1F && p07 == 0xD0 && p08
-				== 0xA9 && p09 == 0xE6 && p10 == 0x20 && p11 == 0x28 && p12
-				== 0xF3)
-		{ // find edge (rom routine)
-			eTape* tape = devices->Get<eTape>();
-			for(;;)
-			{
-				if(b == 0xFF)
-					return;
-				if((tape->TapeBit(T()) ^ c) & 0x20)
-	            	return;
-				b++;
-				t += 59;
-			}
-		}
-		if(p04 == 0xDB && p05 == 0xFE && p06 == 0xCB && p07 == 0x1F && p08
-				== 0xA9 && p09 == 0xE6 && p10 == 0x20 && p11 == 0x28 && p12
-				== 0xF3)
-		{ // rra,ret nc => rr a (popeye2)
-			eTape* tape = devices->Get<eTape>();
-			for(;;)
-			{
-				if(b == 0xFF)
-					return;
-				if((tape->TapeBit(T()) ^ c) & 0x20)
-					return;
-				b++;
-				t += 58;
-			}
-		}
-		if(p04 == 0xDB && p05 == 0xFE && p06 == 0x1F && p07 == 0x00 && p08
-				== 0xA9 && p09 == 0xE6 && p10 == 0x20 && p11 == 0x28 && p12
-				== 0xF3)
-		{ // ret nc nopped (some bleep loaders)
-			eTape* tape = devices->Get<eTape>();
-			for(;;)
-			{
-				if(b == 0xFF)
-					return;
-				if((tape->TapeBit(T()) ^ c) & 0x20)
-					return;
-				b++;
-				t += 58;
-			}
+	++path->size;
+	word next = addr + op->len;
+	switch(op->type)
+	{
+	case OT_NEXT:
+	case OT_RET_COND:
+		path->jump[n] = false;
+		WalkLoop(loop, next, path, found, paths);
+		break;
+	case OT_JUMP:
+		path->jump[n] = true;
+		WalkLoop(loop, op->target, path, found, paths);
+		break;
+	case OT_BRANCH:
+		path->jump[n] = true;
+		WalkLoop(loop, op->target, path, found, paths);
+		path->jump[n] = false;
+		WalkLoop(loop, next, path, found, paths);
+		break;
+	}
+	--path->size;
+}
+//=============================================================================
+//	eZ80_FastTape::DecodeLoop
+//-----------------------------------------------------------------------------
+//	loop pass must depend only on its live registers & flags and tape input,
+//	so passes with the same state & input may be skipped.
+//	counter inc/dec (if any) ends the loop when it reaches zero.
+bool eZ80_FastTape::DecodeLoop(eTape::eEdgeLoop* loop) const
+{
+	loop->valid = false;
+	loop->seen = false;
+	eOp op;
+	if(!DecodeOp(loop->jump, &op))
+		return false;
+	loop->size = loop->jump + op.len - loop->pc;
+	if(loop->size > eTape::EDGE_LOOP_SIZE)
+		return false;
+	for(int n = 0; n < loop->size; ++n)
+		loop->code[n] = memory->Read(loop->pc + n);
+	static ePath path, found;
+	path.size = 0;
+	int paths = 0;
+	WalkLoop(*loop, loop->pc, &path, &found, &paths);
+	if(paths != 1)
+		return false;
+
+	loop->cost = 0;
+	loop->fetches = 0;
+	loop->in_t = -1;
+	loop->in_c = false;
+	loop->counter = -1;
+	loop->step = 0;
+	loop->counter_f = 0;
+	loop->live = loop->live_f = 0;
+	byte written = 0, written_f = 0;
+	bool z_counter = false; // Z flag holds counter state
+	for(int n = 0; n < found.size; ++n)
+	{
+		const eOp& o = found.op[n];
+		loop->live |= o.reads & ~written;
+		loop->live_f |= o.flags_r & ~written_f;
+		if(z_counter && (o.flags_r & ~(ZF|CF)))
+			return false; // counter ends the loop not at zero
+		if(o.flags_w & ZF)
+			z_counter = false;
+		if(o.count >= 0)
+		{
+			if(loop->counter >= 0)
+				return false;
+			loop->counter = o.count;
+			loop->step = o.step;
+			z_counter = o.flags_w != 0;
+			loop->counter_f = o.flags_w;
 		}
-		if(p04 == 0xDB && p05 == 0xFE && p06 == 0xA9 && p07 == 0xE6 && p08
-				== 0x40 && p09 == 0xD8 && p10 == 0x00 && p11 == 0x28 && p12
-				== 0xF3)
-		{ // no rra, no break check (rana rama)
-			eTape* tape = devices->Get<eTape>();
-			for(;;)
-			{
-				if(b == 0xFF)
-					return;
-				if((tape->TapeBit(T()) ^ c) & 0x40)
-					return;
-				b++;
-				t += 59;
-			}
+		else
+			loop->counter_f &= ~o.flags_w;
+		loop->cost += found.jump[n] ? o.tacts_jump : o.tacts;
+		byte p0 = memory->Read(o.pc);
+		loop->fetches += (p0 == 0xCB || p0 == 0xED) ? 2 : 1;
+		if(o.in)
+		{
+			if(loop->in_t >= 0)
+				return false;
+			if(!o.in_c && (o.port & 1))
+				return false; // not ULA port
+			loop->in_t = loop->cost;
+			loop->in_c = o.in_c;
 		}
-		if(p04 == 0xDB && p05 == 0xFE && p06 == 0x1F && p07 == 0xA9 && p08
-				== 0xE6 && p09 == 0x20 && p10 == 0x28 && p11 == 0xF4)
-		{ // ret nc skipped: routine without BREAK checking (ZeroMusic & JSW)
-			eTape* tape = devices->Get<eTape>();
-			for(;;)
-			{
-				if(b == 0xFF)
-					return;
-				if((tape->TapeBit(T()) ^ c) & 0x20)
-					return;
-				b++;
-				t += 54;
-			}
+		written |= o.writes;
+		written_f |= o.flags_w;
+	}
+	if(loop->counter >= 0)
+	{
+		byte bit = 1 << loop->counter;
+		for(int n = 0; n < found.size; ++n)
+		{
+			const eOp& o = found.op[n];
+			if(o.count < 0 && ((o.reads|o.writes) & bit))
+				return false; // counter used not only for counting
 		}
+		loop->live &= ~bit;
+		if(loop->counter_f & loop->live_f)
+			return false; // next pass depends on counter flags
 	}
-	if(p0 == 0x04 && p1 == 0x20 && p2 == 0x03)
-	{
-		byte p06 = memory->Read(pc + 6);
-		byte p08 = memory->Read(pc + 8);
-		byte p09 = memory->Read(pc + 9);
-		byte p10 = memory->Read(pc + 10);
-		byte p11 = memory->Read(pc + 11);
-		byte p12 = memory->Read(pc + 12);
-		byte p13 = memory->Read(pc + 13);
-		byte p14 = memory->Read(pc + 14);
-		if(p06 == 0xDB && p08 == 0x1F && p09 == 0xC8 && p10 == 0xA9 && p11
-				== 0xE6 && p12 == 0x20 && p13 == 0x28 && p14 == 0xF1)
-		{ // find edge from Donkey Kong
-			eTape* tape = devices->Get<eTape>();
-			for(;;)
+	else if(loop->in_t < 0)
+		return false; // endless loop
+	loop->valid = true;
+	return true;
+}
+//=============================================================================
+//	eZ80_FastTape::FindLoop
+//-----------------------------------------------------------------------------
+eTape::eEdgeLoop* eZ80_FastTape::FindLoop(eTape* tape, word addr, word jump) const
+{
+	for(int n = 0; n < eTape::EDGE_LOOPS; ++n)
+	{
+		eTape::eEdgeLoop* loop = &tape->edge_loops[n];
+		if(loop->pc != addr || loop->jump != jump || !loop->size)
+			continue;
+		for(int i = 0; i < loop->size; ++i)
+		{
+			if(memory->Read(addr + i) != loop->code[i])
 			{
-				if(b == 0xFF)
-					return;
-				if((tape->TapeBit(T()) ^ c) & 0x20)
-					return;
-				b++;
-				t += 59;
+				if(DecodeLoop(loop) && loop->in_t >= 0)
+					loop->stats = tape->LoaderStats(addr);
+				return loop;
 			}
 		}
+		return loop;
 	}
-	if(p0 == 0x3E && p2 == 0xDB && p3 == 0xFE)
-	{
-		byte p04 = memory->Read(pc + 4);
-		byte p05 = memory->Read(pc + 5);
-		byte p06 = memory->Read(pc + 6);
-		byte p07 = memory->Read(pc + 7);
-		byte p09 = memory->Read(pc + 9);
-		byte p10 = memory->Read(pc + 10);
-		byte p11 = memory->Read(pc + 11);
-		if(p04 == 0xA9 && p05 == 0xE6 && p06 == 0x40 && p07 == 0x20 && p09
-				== 0x05 && p10 == 0x20 && p11 == 0xF4)
-		{ // lode runner
-			eTape* tape = devices->Get<eTape>();
-			for(;;)
-			{
-				if(b == 1)
-					return;
-				if((tape->TapeBit(T()) ^ c) & 0x40)
-					return;
-				t += 52;
-				b--;
-			}
+	eTape::eEdgeLoop* loop = &tape->edge_loops[tape->edge_loop_next];
+	tape->edge_loop_next = (tape->edge_loop_next + 1) % eTape::EDGE_LOOPS;
+	loop->pc = addr;
+	loop->jump = jump;
+	loop->stats = -1;
+	if(DecodeLoop(loop) && loop->in_t >= 0)
+		loop->stats = tape->LoaderStats(addr);
+	return loop;
+}
+//=============================================================================
+//	eZ80_FastTape::SkipLoop
+//-----------------------------------------------------------------------------
+void eZ80_FastTape::SkipLoop(eTape* tape, eTape::eEdgeLoop* loop)
+{
+	byte regs[8];
+	Regs(regs);
+	bool in = loop->in_t >= 0 && !(loop->in_c && (c & 1));
+	byte bit = in ? tape->TapeBit(t + loop->in_t) & 0x40 : 0;
+	bool steady = loop->seen && t - loop->t == loop->cost && bit == loop->bit
+			&& !((f ^ loop->f) & loop->live_f);
+	for(int r = 0; steady && r < 8; ++r)
+	{
+		if(loop->live & (1 << r))
+			steady = regs[r] == loop->regs[r];
+	}
+	if(steady && loop->counter >= 0)
+		steady = regs[loop->counter] == (byte)(loop->regs[loop->counter] + loop->step);
+	int passes = 0;
+	if(steady && (in || loop->in_t < 0))
+	{
+		int max_passes = 0x7FFFFFFF;
+		if(loop->counter >= 0)
+		{ // pass with zero counter ends the loop
+			byte v = regs[loop->counter];
+			int left = (loop->step > 0) ? (byte)-v : v;
+			max_passes = (left ? left : 0x100) - 1;
+		}
+		while(passes < max_passes && bit == loop->bit && t + loop->cost < (int)FrameTacts())
+		{
+			t += loop->cost;
+			++passes;
+			if(in)
+				bit = tape->TapeBit(t + loop->in_t) & 0x40;
+		}
+		r_low += passes * loop->fetches;
+		if(loop->counter >= 0)
+			*Reg(loop->counter) += passes * loop->step;
+		if(passes && loop->counter_f)
+		{ // flags as left by inc/dec of the last skipped pass
+			byte v = *Reg(loop->counter) - loop->step;
+			byte cf = (loop->step > 0) ? incf[v] : decf[v];
+			f = (f & ~loop->counter_f) | (cf & loop->counter_f);
 		}
 	}
+	if(loop->stats >= 0)
+	{
+		eTape::eLoaderStats& s = tape->loader_stats[loop->stats];
+		s.hits += passes;
+		++s.misses;
+	}
+	loop->seen = true;
+	loop->t = t;
+	Regs(loop->regs);
+	loop->f = f;
+	loop->bit = bit;
+}
+//=============================================================================
+//	eZ80_FastTape::StepEdge
+//-----------------------------------------------------------------------------
+//	accelerates short loops sampling tape input (or just counting) found by
+//	backward jumps: passes are skipped up to the next tape edge / counter end
+void eZ80_FastTape::StepEdge()
+{
+	eTape* tape = devices->Get<eTape>();
+	word addr = pc;
+	word jump = tape->prev_pc;
+	tape->prev_pc = addr;
+	if(addr > jump || jump - addr >= eTape::EDGE_LOOP_SIZE)
+		return;
+	eTape::eEdgeLoop* loop = FindLoop(tape, addr, jump);
+	if(loop->valid)
+		SkipLoop(tape, loop);
 }
 //=============================================================================
 //	eZ80_FastTape::StepTrap
 //-----------------------------------------------------------------------------
+//	ROM LD-BYTES: whole data block is loaded at once from tape block data,
+//	A' - flag byte, F' carry - load/verify, IX - address, DE - length
 void eZ80_FastTape::StepTrap()
 {
 	if((pc & 0xFFFF) != 0x056B)
 		return;
-	eTape* tape = devices->Get<eTape>();
-	dword pulse;
-	do
+	static const byte ld_bytes[] =
 	{
-		if(tape->tape.play_pointer >= tape->tape.end_of_tape ||
-				(pulse = tape->tape_pulse[*tape->tape.play_pointer++]) == (dword)-1)
-		{
-			tape->Stop();
+		0x14, 0x08, 0x15, 0xF3, 0x3E, 0x0F, 0xD3, 0xFE, 0x21, 0x3F, 0x05, 0xE5,
+		0xDB, 0xFE, 0x1F, 0xE6, 0x20, 0xF6, 0x02, 0x4F, 0xBF, 0xC0
+	};
+	static const byte ld_end[] = { 0x7C, 0xFE, 0x01, 0xC9 }; // ld a,h: cp 1: ret
+	for(dword i = 0; i < sizeof(ld_bytes); ++i)
+	{
+		if(memory->Read(0x0556 + i) != ld_bytes[i])
 			return;
-		}
 	}
-	while(pulse > 770);
-	++tape->tape.play_pointer;
-
-	// loading header
-	l = 0;
-	for(dword bit = 0x80; bit; bit >>= 1)
+	for(dword i = 0; i < sizeof(ld_end); ++i)
 	{
-		if(tape->tape.play_pointer >= tape->tape.end_of_tape ||
-				(pulse = tape->tape_pulse[*tape->tape.play_pointer++]) == (dword)-1)
-		{
-			tape->Stop();
-			pc = 0x05E2;
+		if(memory->Read(0x05DF + i) != ld_end[i])
 			return;
-		}
-		l |= (pulse > 1240) ? bit : 0;
-		++tape->tape.play_pointer;
 	}
+	eTape* tape = devices->Get<eTape>();
+	int block = tape->FindDataBlock();
+	if(block < 0) // load it edge by edge
+		return;
+	const eTape::eTapeBlock& tb = tape->tape_blocks[block];
+	tape->PlayFrom(block + 1, T());
 
-	// loading data
-	do
+	const byte* data = tb.data;
+	dword size = tb.size;
+	if(!size || *data != alt.a) // no flag byte or another block expected
 	{
-		l = 0;
-		for(dword bit = 0x80; bit; bit >>= 1)
-		{
-			if(tape->tape.play_pointer >= tape->tape.end_of_tape ||
-					(pulse = tape->tape_pulse[*tape->tape.play_pointer++]) == (dword)-1)
-			{
-				tape->Stop();
-				pc = 0x05E2;
-				return;
-			}
-			l |= (pulse > 1240) ? bit : 0;
-			++tape->tape.play_pointer;
-		}
-		memory->Write(ix++, l);
-		--de;
+		f &= ~(CF|ZF);
+		pc = 0x05E2;
+		return;
 	}
-	while(de & 0xFFFF);
-
-	// loading CRC
-	l = 0;
-	for(dword bit = 0x80; bit; bit >>= 1)
+	bool load = (alt.f & CF) != 0;
+	byte parity = *data++;
+	--size;
+	for(; de & 0xFFFF; de = (de - 1) & 0xFFFF, ix = (ix + 1) & 0xFFFF, --size)
 	{
-		if(tape->tape.play_pointer >= tape->tape.end_of_tape ||
-				(pulse = tape->tape_pulse[*tape->tape.play_pointer++]) == (dword)-1)
+		if(!size) // tape block too short
 		{
-			tape->Stop();
+			f &= ~(CF|ZF);
 			pc = 0x05E2;
 			return;
 		}
-		l |= (pulse > 1240) ? bit : 0;
-		++tape->tape.play_pointer;
+		byte v = *data++;
+		parity ^= v;
+		if(load)
+			memory->Write(ix & 0xFFFF, v);
+		else if(memory->Read(ix & 0xFFFF) != v)
+		{
+			f &= ~(CF|ZF);
+			pc = 0x05E2;
+			return;
+		}
+	}
+	if(!size) // no checksum byte
+	{
+		f &= ~(CF|ZF);
+		pc = 0x05E2;
+		return;
 	}
-	pc = 0x05DF;
-	f |= CF;
+	l = *data;
+	h = parity ^ l;
 	bc = 0xB001;
-	h = 0;
+	pc = 0x05DF; // carry set if h == 0
+}
+//=============================================================================
+//	eZ80_FastTape::StepSaveTrap
+//-----------------------------------------------------------------------------
+//	ROM SA-BYTES: block is written to recorded tape at once from leader loop,
+//	A' - flag byte, IX - address - 1, DE - length + 1
+void eZ80_FastTape::StepSaveTrap()
+{
+	if((pc & 0xFFFF) != 0x04D8)
+		return;
+	static const byte sa_bytes[] =
+	{
+		0x21, 0x3F, 0x05, 0xE5, 0x21, 0x80, 0x1F, 0xCB, 0x7F, 0x28, 0x03, 0x21,
+		0x98, 0x0C, 0x08, 0x13, 0xDD, 0x2B, 0xF3, 0x3E, 0x02, 0x47, 0x10, 0xFE
+	};
+	for(dword i = 0; i < sizeof(sa_bytes); ++i)
+	{
+		if(memory->Read(0x04C2 + i) != sa_bytes[i])
+			return;
+	}
+	if(memory->Read(sp) != 0x3F || memory->Read(sp + 1) != 0x05) // SA/LD-RET
+		return;
+	eTape* tape = devices->Get<eTape>();
+	word addr = ix + 1;
+	word size = de - 1;
+	byte* data = tape->RecordBlock(size + 2);
+	if(!data) // save it edge by edge
+		return;
+	byte parity = alt.a;
+	*data++ = parity;
+	for(word i = 0; i < size; ++i)
+	{
+		byte v = memory->Read(addr + i);
+		parity ^= v;
+		*data++ = v;
+	}
+	*data = parity;
+	ix = (addr + size) & 0xFFFF;
+	de = 0xFFFF;
+	a = 0;
+	f = ZF|HF|CF;
+	b = 0;
+	sp = (sp + 2) & 0xFFFF;
+	pc = 0x053F; // ret from SA-BYTES to SA/LD-RET
 }
 
 }
@@ -26,43 +26,84 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 class eSpeccy;
 namespace xZ80 { class eZ80_FastTape; }
+namespace xIo { class eFileData; }
 
 class eTape : public eDeviceSound
 {
 	typedef eDeviceSound eInherited;
 	friend class xZ80::eZ80_FastTape;
 public:
-	eTape(eSpeccy* s) : speccy(s) {}
-	virtual ~eTape() { CloseTape(); }
+	eTape(eSpeccy* s);
+	virtual ~eTape() { CloseTape(); free(rec.data); }
 	virtual void Init();
 	virtual void Reset();
-	virtual bool IoRead(word port) const;
+	virtual void IoReadDecode(eIoDecoder* d) const;
+	virtual void IoWriteDecode(eIoDecoder* d) const;
 	virtual void IoRead(word port, byte* v, int tact);
+	virtual void IoWrite(word port, byte v, int tact);
+	virtual void FrameEnd(dword tacts);
 
-	bool Open(const char* type, const void* data, size_t data_size);
+	bool Open(const char* type, xIo::eFileData* data);
+	// takes over image opened by another instance (parsed off the emulation thread), it's left empty
+	void Insert(eTape* image);
+	bool Store(const char* type, const char* name);
 	void Start();
 	void Stop();
 	bool Started() const;
 	bool Inserted() const;
 
 	static eDeviceId Id() { return D_TAPE; }
-	virtual dword IoNeed() const { return ION_READ; }
+	virtual dword IoNeed() const { return ION_READ|ION_WRITE; }
 
 	byte TapeBit(int tact);
 	virtual const char* Name() const { return "tape"; }
+
+	struct eLoaderStats
+	{
+		word pc;        // edge sampling loop address
+		dword hits;     // loop passes skipped up to the next edge
+		dword misses;   // loop passes emulated
+	};
+	dword Loaders() const { return loaders; }
+	const eLoaderStats& Loader(dword i) const { return loader_stats[i]; }
 protected:
+	enum eBlockType
+	{
+		TB_DATA, TB_TONE, TB_PULSES, TB_DIRECT, TB_CSW, TB_GENERAL,
+		TB_PAUSE, TB_STOP, TB_LOOP_START, TB_LOOP_END
+	};
+	struct eTapeBlock
+	{
+		byte type;
+		byte last;      // used bits in last byte (CSW: flags)
+		const byte* data;
+		dword size;     // bytes (pulses: count, loop start: repeats)
+		dword pilot_t;  // tone pulse (CSW: tacts per sample)
+		dword s1_t, s2_t;
+		dword zero_t;   // direct recording: tacts per sample
+		dword one_t;
+		dword pilot_len;    // -1 if no pilot
+		dword pause;    // ms (TB_PAUSE: tacts)
+	};
+
 	bool ParseTAP(const void* data, size_t data_size);
 	bool ParseCSW(const void* data, size_t data_size);
 	bool ParseTZX(const void* data, size_t data_size);
 
-	dword FindPulse(dword t);
 	void FindTapeIndex();
-	void FindTapeSizes();
+	dword FindTapeSizes();
 	void StopTape();
 	void ResetTape();
 	void StartTape();
 	void CloseTape();
-	void Reserve(dword datasize);
+	void SeekTape(dword block);
+	void PlayFrom(dword block, int tact);
+	int FindDataBlock() const;
+	dword NextPulse();
+	bool RawPulse(dword* pulse, bool* edge);
+	bool BlockPulse(dword* pulse, bool* edge);
+	bool GeneralPulse(dword* pulse, bool* edge);
+	eTapeBlock* AddBlock(byte type);
 	void MakeBlock(const byte* data, dword size, dword pilot_t,
 	      dword s1_t, dword s2_t, dword zero_t, dword one_t,
 	      dword pilot_len, dword pause, byte last = 8);
@@ -71,6 +112,11 @@ protected:
 	void NamedCell(const void *nm, dword sz = 0);
 	void CreateAppendableBlock();
 	void ParseHardware(const byte* ptr);
+	int LoaderStats(word pc);
+	void RecordEdge(qword t);
+	void RecordClose(dword pause);
+	byte* RecordAlloc(dword size);
+	byte* RecordBlock(dword size);
 
 protected:
 	eSpeccy* speccy;
@@ -78,10 +124,25 @@ protected:
 	struct eTapeState
 	{
 		qword edge_change;
-		byte* play_pointer; // or NULL if tape stopped
-		byte* end_of_tape;  // where to stop tape
+		bool play;      // false if tape stopped
 		dword index;    // current tape block
 		dword tape_bit;
+
+		dword block;    // block being decoded
+		dword stage;    // block specific decoder stage
+		dword pos;      // pulse/bit position inside the stage
+		dword count;    // stage length
+		dword t;        // accumulated pulse of direct recording
+		byte sample;    // last sample of direct recording
+		byte level;     // signal level after the last decoded pulse
+		const byte* ptr;
+		const byte* sym;    // generalized data symbol being played
+		dword sym_pulse;
+		dword sym_rep;
+		dword loop_start;
+		dword loop_left;
+		dword next;     // decoded ahead pulse
+		bool next_ok;   // or false if end of tape reached
 	};
 	eTapeState tape;
 
@@ -92,17 +153,64 @@ protected:
 	   dword t_size;
 	};
 
-	dword tape_pulse[0x100];
-	dword max_pulses;
-	dword tape_err;
-
-	byte* tape_image;
-	dword tape_imagesize;
+	xIo::eFileData* tape_data; // image referenced while inserted, blocks refer to it
+	eTapeBlock* tape_blocks;
+	dword tape_blocksize;
 
 	TAPEINFO* tapeinfo;
 	dword tape_infosize;
 
 	dword appendable;
+
+	enum { EDGE_LOOPS = 8, EDGE_LOOP_SIZE = 64, MAX_LOADERS = 32 };
+	struct eEdgeLoop
+	{
+		word pc;        // loop start
+		word jump;      // address of jump back to loop start
+		word size;      // loop code size
+		byte code[EDGE_LOOP_SIZE + 4];
+		bool valid;     // loop pass may be skipped
+		int cost;       // tacts per loop pass
+		int fetches;    // opcode fetches per pass (R register increments)
+		int in_t;       // tacts from pass start to port read (-1 if no port read)
+		bool in_c;      // port read via (c)
+		int counter;    // counter register (z80 encoding) or -1
+		int step;       // counter change per pass
+		byte counter_f; // flags left by counter inc/dec at pass end
+		byte live;      // registers read before written in pass
+		byte live_f;    // flags read before written in pass
+		int stats;      // loader stats index or -1
+
+		bool seen;      // previous pass state
+		int t;
+		byte regs[8];
+		byte f;
+		byte bit;
+	};
+	eEdgeLoop edge_loops[EDGE_LOOPS];
+	dword edge_loop_next;
+	word prev_pc;
+
+	eLoaderStats loader_stats[MAX_LOADERS];
+	dword loaders;
+
+	enum { REC_SAMPLE = 79, REC_GAP = 3500000, REC_PILOT = 512, REC_MAX = 16*1024*1024 };
+	struct eRecordState
+	{
+		byte* data;     // recorded tzx blocks (without tzx header)
+		dword size;
+		dword alloc;
+		byte mic;       // MIC output level
+		qword edge;     // last MIC edge tact
+		dword block;    // direct recording block being written or -1
+		dword bits;     // samples in direct recording block
+		dword frac;     // tacts not fitted to the last sample
+		dword pilot;    // first pulse of the block
+		dword pulses;   // pulses checked to be pilot tone
+		bool skip;      // not a tape signal, ignored up to the next pause
+		bool armed;     // fast tape step handler set by recorder
+	};
+	eRecordState rec;
 };
 
 extern xZ80::eZ80::eHandlerStep* fast_tape_emul;
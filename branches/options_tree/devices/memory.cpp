@@ -59,21 +59,29 @@ eMemory::~eMemory()
 }
 //=============================================================================
 //	eMemory::Init
+//	ROM files are read once, all machines copy the same pages
 //-----------------------------------------------------------------------------
 void eMemory::Init()
 {
 #if defined(USE_EMBEDDED_RESOURCES) || defined(USE_EXTERN_RESOURCES)
-	memcpy(memory->Get(P_ROM_128_0),	sos128_0,	eMemory::PAGE_SIZE);
-	memcpy(memory->Get(P_ROM_128_1),	sos128_1,	eMemory::PAGE_SIZE);
-	memcpy(memory->Get(P_ROM_48),		sos48,		eMemory::PAGE_SIZE);
-	memcpy(memory->Get(P_ROM_SYS),		service,	eMemory::PAGE_SIZE);
-	memcpy(memory->Get(P_ROM_DOS),		dos513f,	eMemory::PAGE_SIZE);
+	memcpy(Get(P_ROM_128_0),	sos128_0,	eMemory::PAGE_SIZE);
+	memcpy(Get(P_ROM_128_1),	sos128_1,	eMemory::PAGE_SIZE);
+	memcpy(Get(P_ROM_48),		sos48,		eMemory::PAGE_SIZE);
+	memcpy(Get(P_ROM_SYS),		service,	eMemory::PAGE_SIZE);
+	memcpy(Get(P_ROM_DOS),		dos513f,	eMemory::PAGE_SIZE);
 #else//USE_EMBEDDED_RESOURCES
-	LoadRom(P_ROM_128_0,	xIo::ResourcePath("res/rom/sos128_0.rom"));
-	LoadRom(P_ROM_128_1,	xIo::ResourcePath("res/rom/sos128_1.rom"));
-	LoadRom(P_ROM_48,		xIo::ResourcePath("res/rom/sos48.rom"));
-	LoadRom(P_ROM_SYS,		xIo::ResourcePath("res/rom/service.rom"));
-	LoadRom(P_ROM_DOS,		xIo::ResourcePath("res/rom/dos513f.rom"));
+	static byte roms[P_RAM0*PAGE_SIZE]; // rom pages go first
+	static bool roms_loaded = false;
+	if(!roms_loaded)
+	{
+		LoadRom(roms + P_ROM_128_0*PAGE_SIZE,	xIo::ResourcePath("res/rom/sos128_0.rom"));
+		LoadRom(roms + P_ROM_128_1*PAGE_SIZE,	xIo::ResourcePath("res/rom/sos128_1.rom"));
+		LoadRom(roms + P_ROM_48*PAGE_SIZE,		xIo::ResourcePath("res/rom/sos48.rom"));
+		LoadRom(roms + P_ROM_SYS*PAGE_SIZE,		xIo::ResourcePath("res/rom/service.rom"));
+		LoadRom(roms + P_ROM_DOS*PAGE_SIZE,		xIo::ResourcePath("res/rom/dos513f.rom"));
+		roms_loaded = true;
+	}
+	memcpy(memory, roms, sizeof(roms));
 #endif//USE_EMBEDDED_RESOURCES
 }
 //=============================================================================
@@ -113,11 +121,11 @@ int	eMemory::Page(int idx)
 //=============================================================================
 //	eMemory::::LoadRom
 //-----------------------------------------------------------------------------
-void eMemory::LoadRom(int page, const char* rom)
+void eMemory::LoadRom(byte* page, const char* rom)
 {
 	FILE* f = fopen(rom, "rb");
 	assert(f);
-	size_t s = fread(Get(page), 1, PAGE_SIZE, f);
+	size_t s = fread(page, 1, PAGE_SIZE, f);
 	assert(s == PAGE_SIZE);
 	fclose(f);
 }
@@ -131,11 +139,11 @@ void eMemory::Mode48k(bool on)
 	}
 }
 //=============================================================================
-//	eMemory::IoWrite
+//	eMemory::IoWriteDecode
 //-----------------------------------------------------------------------------
-bool eMemory::IoWrite(word port) const
+void eMemory::IoWriteDecode(eIoDecoder* d) const
 {
-	return !(port & 2) && !(port & 0x8000); // zx128 port
+	d->Port(0x8002, 0); // zx128 port
 }
 //=============================================================================
 //	eMemory::IoWrite
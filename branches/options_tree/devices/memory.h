@@ -71,14 +71,14 @@ public:
 	bool Mode48k() const { return mode_48k; }
 	void Mode48k(bool on);
 
-	virtual bool IoWrite(word port) const;
+	virtual void IoWriteDecode(eIoDecoder* d) const;
 	virtual void IoWrite(word port, byte v, int tact);
 	static eDeviceId Id() { return D_MEMORY; }
 	virtual dword IoNeed() const { return ION_WRITE; }
 	virtual const char* Name() const { return "memory"; }
 	enum { BANKS_AMOUNT = 4, PAGE_SIZE = 0x4000, SIZE = P_AMOUNT * PAGE_SIZE };
 protected:
-	void LoadRom(int page, const char* rom);
+	static void LoadRom(byte* page, const char* rom);
 	void SetPage(int idx, int page);
 protected:
 	byte* bank_read[BANKS_AMOUNT];
@@ -22,7 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 static struct eOptionSoundChip : public xOptions::eOptionInt
 {
-	eOptionSoundChip() : owner(NULL) { Set(SC_AY); }
+	eOptionSoundChip() { Set(SC_AY); }
 	enum eType { SC_FIRST, SC_AY = SC_FIRST, SC_YM, SC_LAST };
 	virtual const char* Name() const { return "chip"; }
 	virtual const char** Values() const
@@ -34,15 +34,12 @@ static struct eOptionSoundChip : public xOptions::eOptionInt
 	{
 		eOptionInt::Change(SC_LAST, next);
 	}
-	void Owner(eAY* o) { owner = o; }
-	virtual void OnOption() { if(changed) owner->OnOptionChanged(); }
-	eAY* owner;
 } op_sound_chip;
 DECLARE_OPTION_ACCESSOR(eOptionInt, op_sound_chip);
 
 static struct eOptionAYStereo : public xOptions::eOptionInt
 {
-	eOptionAYStereo() : owner(NULL)  { Set(AS_ABC); }
+	eOptionAYStereo() { Set(AS_ABC); }
 	enum eMode { AS_FIRST, AS_ABC = AS_FIRST, AS_ACB, AS_BAC, AS_BCA, AS_CAB, AS_CBA, AS_MONO, AS_LAST };
 	virtual const char* Name() const { return "stereo"; }
 	virtual const char** Values() const
@@ -54,9 +51,6 @@ static struct eOptionAYStereo : public xOptions::eOptionInt
 	{
 		eOptionInt::Change(AS_LAST, next);
 	}
-	void Owner(eAY* o) { owner = o; }
-	virtual void OnOption() { if(changed) owner->OnOptionChanged(); }
-	eAY* owner;
 } op_ay_stereo;
 DECLARE_OPTION_ACCESSOR(eOptionInt, op_ay_stereo);
 
@@ -96,32 +90,25 @@ eAY::eAY() : t(0), ta(0), tb(0), tc(0), tn(0), te(0), env(0), denv(0)
 	,fa(0), fb(0), fc(0), fn(0), fe(0)
 	,activereg(0)
 {
-	op_sound_chip.Owner(this);
-	op_ay_stereo.Owner(this);
 	SetChip(CHIP_AY);
 	SetTimings(SNDR_DEFAULT_SYSTICK_RATE, SNDR_DEFAULT_AY_RATE, SNDR_DEFAULT_SAMPLE_RATE);
 	SetVolumes(0x7FFF, SNDR_VOL_AY, SNDR_PAN_ABC);
 	_Reset();
 }
 //=============================================================================
-//	eAY::IoRead
+//	eAY::IoReadDecode
 //-----------------------------------------------------------------------------
-bool eAY::IoRead(word port) const
+void eAY::IoReadDecode(eIoDecoder* d) const
 {
-	return (port&0xC0FF) == 0xC0FD;
+	d->Port(0xC0FF, 0xC0FD);
 }
 //=============================================================================
-//	eAY::IoWrite
+//	eAY::IoWriteDecode
 //-----------------------------------------------------------------------------
-bool eAY::IoWrite(word port) const
+void eAY::IoWriteDecode(eIoDecoder* d) const
 {
- 	if(port&2)
-		return false;
- 	if((port & 0xC0FF) == 0xC0FD)
-		return true;
- 	if((port & 0xC000) == 0x8000)
- 		return true;
-	return false;
+	d->Port(0xC0FF, 0xC0FD);
+	d->Port(0xC002, 0x8000);
 }
 //=============================================================================
 //	eAY::IoRead
@@ -150,70 +137,162 @@ const dword MULT_C_1 = 14; // fixed point precision for 'system tick -> ay tick'
 // assert(b+MULT_C_1 <= 32)
 
 //=============================================================================
-//	eAY::FrameStart
+//	eAY::Render
 //-----------------------------------------------------------------------------
-void eAY::FrameStart(dword tacts)
+void eAY::Render(const eEvent& e)
 {
-	t = tacts * chip_clock_rate / system_clock_rate;
-	eInherited::FrameStart(t);
+	switch(e.type)
+	{
+	case eEvent::E_FRAME_START:
+		t = e.tact * chip_clock_rate / system_clock_rate;
+		SynthFrameStart(t);
+		break;
+	case eEvent::E_WRITE:
+		SynthWrite(e.tact, e.p0, e.p1);
+		break;
+	case eEvent::E_FRAME_SLICE:
+		{
+			qword slice_chip_tick = ((passed_clk_ticks + e.tact) * chip_clock_rate) / system_clock_rate;
+			Flush((dword)(slice_chip_tick - passed_chip_ticks));
+			SynthFrameSlice(t);
+		}
+		break;
+	case eEvent::E_FRAME_END:
+		{
+			//adjusting 't' with whole history will fix accumulation of rounding errors
+			qword end_chip_tick = ((passed_clk_ticks + e.tact) * chip_clock_rate) / system_clock_rate;
+			Flush((dword)(end_chip_tick - passed_chip_ticks));
+			SynthFrameEnd(t, e.p0);
+			passed_clk_ticks += e.tact;
+			passed_chip_ticks += t;
+		}
+		break;
+	}
 }
 //=============================================================================
-//	eAY::FrameEnd
+//	Overflows
+//	advances generator counter (with AY "++c >= f" rules) by n ticks
+//	returns count of counter overflows
 //-----------------------------------------------------------------------------
-void eAY::FrameEnd(dword tacts)
+static inline dword Overflows(dword& c, dword f, dword n)
 {
-	//adjusting 't' with whole history will fix accumulation of rounding errors
-	qword end_chip_tick = ((passed_clk_ticks + tacts) * chip_clock_rate) / system_clock_rate;
-	Flush((dword)(end_chip_tick - passed_chip_ticks));
-	eInherited::FrameEnd(t);
-	passed_clk_ticks += tacts;
-	passed_chip_ticks += t;
+	dword d = (c + 1 < f) ? f - c : 1; // ticks to nearest overflow
+	if(n < d)
+	{
+		c += n;
+		return 0;
+	}
+	n -= d;
+	if(f <= 1)
+	{
+		c = 0;
+		return n + 1;
+	}
+	c = n % f;
+	return n / f + 1;
 }
 //=============================================================================
-//	eAY::Flush
+//	NearestOverflow
+//	limits n by ticks to nearest generator counter overflow
 //-----------------------------------------------------------------------------
-void eAY::Flush(dword chiptick)
+static inline void NearestOverflow(dword& n, dword c, dword f)
 {
-	// todo: noaction at (temp.sndblock || !conf.sound.ay)
-	while (t < chiptick)
+	dword d = (c + 1 < f) ? f - c : 1;
+	if(d < n)
+		n = d;
+}
+//=============================================================================
+//	eAY::NoiseStep
+//-----------------------------------------------------------------------------
+inline void eAY::NoiseStep()
+{
+	ns = (ns*2+1) ^ (((ns>>16)^(ns>>13)) & 1);
+	bitN = 0 - ((ns >> 16) & 1);
+}
+//=============================================================================
+//	eAY::EnvStep
+//-----------------------------------------------------------------------------
+inline void eAY::EnvStep()
+{
+	env += denv;
+	if(env & ~31)
 	{
-		t++;
-		if(++ta >= fa) ta = 0, bitA ^= -1;
-		if(++tb >= fb) tb = 0, bitB ^= -1;
-		if(++tc >= fc) tc = 0, bitC ^= -1;
-		if(++tn >= fn)
-			tn = 0,
-			ns = (ns*2+1) ^ (((ns>>16)^(ns>>13)) & 1),
-			bitN = 0 - ((ns >> 16) & 1);
-		if(++te >= fe)
-		{
-			te = 0, env += denv;
-			if(env & ~31)
-			{
-				dword mask = (1<<r.env);
-				if(mask & ((1<<0)|(1<<1)|(1<<2)|(1<<3)|(1<<4)|(1<<5)|(1<<6)|(1<<7)|(1<<9)|(1<<15)))
-					env = denv = 0;
-				else if(mask & ((1<<8)|(1<<12)))
-					env &= 31;
-				else if(mask & ((1<<10)|(1<<14)))
-					denv = -denv, env = env + denv;
-				else env = 31, denv = 0; //11,13
-			}
-		}
+		dword mask = (1<<r.env);
+		if(mask & ((1<<0)|(1<<1)|(1<<2)|(1<<3)|(1<<4)|(1<<5)|(1<<6)|(1<<7)|(1<<9)|(1<<15)))
+			env = denv = 0;
+		else if(mask & ((1<<8)|(1<<12)))
+			env &= 31;
+		else if(mask & ((1<<10)|(1<<14)))
+			denv = -denv, env = env + denv;
+		else env = 31, denv = 0; //11,13
+	}
+}
+//=============================================================================
+//	eAY::Tick
+//	one chip tick with output mixing
+//-----------------------------------------------------------------------------
+inline void eAY::Tick()
+{
+	t++;
+	if(++ta >= fa) ta = 0, bitA ^= -1;
+	if(++tb >= fb) tb = 0, bitB ^= -1;
+	if(++tc >= fc) tc = 0, bitC ^= -1;
+	if(++tn >= fn) tn = 0, NoiseStep();
+	if(++te >= fe) te = 0, EnvStep();
 
-		dword en, mix_l, mix_r;
+	dword en, mix_l, mix_r;
 
-		en = ((ea & env) | va) & ((bitA | bit0) & (bitN | bit3));
-		mix_l  = vols[0][en]; mix_r  = vols[1][en];
+	en = ((ea & env) | va) & ((bitA | bit0) & (bitN | bit3));
+	mix_l  = vols[0][en]; mix_r  = vols[1][en];
 
-		en = ((eb & env) | vb) & ((bitB | bit1) & (bitN | bit4));
-		mix_l += vols[2][en]; mix_r += vols[3][en];
+	en = ((eb & env) | vb) & ((bitB | bit1) & (bitN | bit4));
+	mix_l += vols[2][en]; mix_r += vols[3][en];
 
-		en = ((ec & env) | vc) & ((bitC | bit2) & (bitN | bit5));
-		mix_l += vols[4][en]; mix_r += vols[5][en];
+	en = ((ec & env) | vc) & ((bitC | bit2) & (bitN | bit5));
+	mix_l += vols[4][en]; mix_r += vols[5][en];
 
-		if((mix_l ^ eInherited::mix_l) | (mix_r ^ eInherited::mix_r)) // similar check inside update()
-			Update(t, mix_l, mix_r);
+	if((mix_l ^ eInherited::mix_l) | (mix_r ^ eInherited::mix_r)) // similar check inside update()
+		SynthUpdate(t, mix_l, mix_r);
+}
+//=============================================================================
+//	eAY::Skip
+//	n chip ticks without output mixing,
+//	audible generators must not overflow in this interval
+//-----------------------------------------------------------------------------
+inline void eAY::Skip(dword n)
+{
+	t += n;
+	if(Overflows(ta, fa, n) & 1) bitA ^= -1;
+	if(Overflows(tb, fb, n) & 1) bitB ^= -1;
+	if(Overflows(tc, fc, n) & 1) bitC ^= -1;
+	for(dword i = Overflows(tn, fn, n); i; --i)
+		NoiseStep();
+	for(dword i = Overflows(te, fe, n); i && denv; --i)
+		EnvStep();
+}
+//=============================================================================
+//	eAY::Flush
+//-----------------------------------------------------------------------------
+void eAY::Flush(dword chiptick)
+{
+	// todo: noaction at (temp.sndblock || !conf.sound.ay)
+	if(t >= chiptick)
+		return;
+	// regs/volumes may be changed since last flush, so first tick is always mixed
+	Tick();
+	while(t < chiptick)
+	{
+		// output can change only on overflow of audible generator (tone/noise enabled in mixer,
+		// envelope running and used by some channel), so advance directly to nearest one
+		dword n = chiptick - t;
+		if(!bit0) NearestOverflow(n, ta, fa);
+		if(!bit1) NearestOverflow(n, tb, fb);
+		if(!bit2) NearestOverflow(n, tc, fc);
+		if(!(bit3 & bit4 & bit5)) NearestOverflow(n, tn, fn);
+		if(denv && (ea|eb|ec)) NearestOverflow(n, te, fe);
+		if(--n)
+			Skip(n);
+		Tick();
 	}
 }
 //=============================================================================
@@ -239,11 +318,19 @@ void eAY::Write(dword timestamp, byte val)
 		return;
 
 	reg[activereg] = val;
+	Log(eEvent::E_WRITE, timestamp, activereg, val);
+}
+//=============================================================================
+//	eAY::SynthWrite
+//-----------------------------------------------------------------------------
+void eAY::SynthWrite(dword timestamp, byte nreg, byte val)
+{
+	sreg[nreg] = val;
 
 	if(timestamp)
 		Flush((timestamp * mult_const) >> MULT_C_1); // cputick * ( (chip_clock_rate/8) / system_clock_rate );
 
-	switch(activereg)
+	switch(nreg)
 	{
 	case 0:
 	case 1:
@@ -305,6 +392,7 @@ byte eAY::Read()
 //-----------------------------------------------------------------------------
 void eAY::SetTimings(dword _system_clock_rate, dword _chip_clock_rate, dword _sample_rate)
 {
+	Wait();
 	_chip_clock_rate /= 8;
 
 	system_clock_rate = _system_clock_rate;
@@ -320,6 +408,7 @@ void eAY::SetTimings(dword _system_clock_rate, dword _chip_clock_rate, dword _sa
 //-----------------------------------------------------------------------------
 void eAY::SetVolumes(dword global_vol, const SNDCHIP_VOLTAB *voltab, const SNDCHIP_PANTAB *stereo)
 {
+	Wait();
 	for (int j = 0; j < 6; j++)
 		for (int i = 0; i < 32; i++)
 			vols[j][i] = (dword)(((qword)global_vol * voltab->v[i] * stereo->raw[j])/(65535*100*3));
@@ -349,8 +438,24 @@ void eAY::ApplyRegs(dword timestamp)
 	}
 	activereg = ar;
 }
-void eAY::OnOptionChanged()
+void eAY::BindOptions(bool bind)
 {
+	if(bind)
+	{
+		op_sound_chip.Observe(this);
+		op_ay_stereo.Observe(this);
+		OnOptionChanged(NULL);
+	}
+	else
+	{
+		op_sound_chip.Unobserve(this);
+		op_ay_stereo.Unobserve(this);
+	}
+}
+void eAY::OnOptionChanged(xOptions::eOptionB* o)
+{
+	Wait(); // volumes are used by synthesis
+
 	eOptionSoundChip::eType chip = (eOptionSoundChip::eType)(int)op_sound_chip;
 	eOptionAYStereo::eMode stereo = (eOptionAYStereo::eMode)(int)op_ay_stereo;
 	const SNDCHIP_PANTAB* sndr_pan = SNDR_PAN_MONO;
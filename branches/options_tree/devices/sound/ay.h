@@ -69,26 +69,27 @@ extern const SNDCHIP_PANTAB* SNDR_PAN_CBA;
 //=============================================================================
 //	eAY
 //-----------------------------------------------------------------------------
-class eAY : public eDeviceSound
+class eAY : public eDeviceSound, public xOptions::eObserver
 {
 	typedef eDeviceSound eInherited;
 public:
 	eAY();
-	virtual ~eAY() {}
-	virtual bool IoRead(word port) const;
-	virtual bool IoWrite(word port) const;
+	virtual ~eAY() { Wait(); }
+	virtual void IoReadDecode(eIoDecoder* d) const;
+	virtual void IoWriteDecode(eIoDecoder* d) const;
 	virtual void IoRead(word port, byte* v, int tact);
 	virtual void IoWrite(word port, byte v, int tact);
 	void SetRegs(const byte _reg[16]) { memcpy(reg, _reg, sizeof(reg)); ApplyRegs(0); }
+	const byte* Regs() const { return reg; }
 	void Select(byte nreg);
+	byte Selected() const { return activereg; }
 	virtual void Reset() { _Reset(); }
-	virtual void FrameStart(dword tacts);
-	virtual void FrameEnd(dword tacts);
 
 	static eDeviceId Id() { return D_AY; }
 	virtual dword IoNeed() const { return ION_WRITE|ION_READ; }
 	virtual const char* Name() const { return "ay"; }
-	void OnOptionChanged();
+	virtual void BindOptions(bool bind);
+	virtual void OnOptionChanged(xOptions::eOptionB* o);
 protected:
 	enum CHIP_TYPE { CHIP_AY, CHIP_YM, CHIP_MAX };
 	static const char* GetChipName(CHIP_TYPE i);
@@ -97,8 +98,14 @@ protected:
 	void SetVolumes(dword global_vol, const SNDCHIP_VOLTAB *voltab, const SNDCHIP_PANTAB *stereo);
 	void Write(dword timestamp, byte val);
 	byte Read();
+	virtual void Render(const eEvent& e);
+	void SynthWrite(dword timestamp, byte nreg, byte val);
 	void _Reset(dword timestamp = 0); // call with default parameter, when context outside start_frame/end_frame block
 	void Flush(dword chiptick);
+	void Tick();
+	void Skip(dword n);
+	void NoiseStep();
+	void EnvStep();
 	void ApplyRegs(dword timestamp = 0);
 protected:
 	dword t, ta, tb, tc, tn, te, env;
@@ -126,8 +133,9 @@ protected:
 	};
 #pragma pack(pop)
 
-	union {
-		byte reg[16];
+	byte reg[16]; // seen by cpu
+	union { // seen by synthesis
+		byte sreg[16];
 		struct AYREGS r;
 	};
 	dword chip_clock_rate, system_clock_rate;
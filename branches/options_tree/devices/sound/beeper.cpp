@@ -20,11 +20,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "beeper.h"
 
 //=============================================================================
-//	eBeeper::IoWrite
+//	eBeeper::IoWriteDecode
 //-----------------------------------------------------------------------------
-bool eBeeper::IoWrite(word port) const
+void eBeeper::IoWriteDecode(eIoDecoder* d) const
 {
-	return !(port&1);
+	d->Port(0x0001, 0);
 }
 //=============================================================================
 //	eBeeper::IoWrite
@@ -22,53 +22,161 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //=============================================================================
 //	eDeviceSound::eDeviceSound
 //-----------------------------------------------------------------------------
-eDeviceSound::eDeviceSound() : frame_rate(50 << 4), mix_l(0), mix_r(0), s1_l(0), s1_r(0), s2_l(0), s2_r(0)
+eDeviceSound::eDeviceSound() : mix_l(0), mix_r(0), frame_rate(50 << 4)
+	, log(logs[0]), log_size(0), render_log(logs[1]), render_size(0), log_l(0), log_r(0)
 {
 	SetTimings(SNDR_DEFAULT_SYSTICK_RATE, SNDR_DEFAULT_SAMPLE_RATE);
 }
 
-const dword TICK_FF = 6;            // oversampling ratio: 2^6 = 64
-const dword TICK_F = (1<<TICK_FF);
-//const dword MULT_C = 12;   // fixed point precision for 'system tick -> sound tick'
-// b = 1+ln2(max_sndtick) = 1+ln2((max_sndfq*TICK_F)/min_intfq) = 1+ln2(48000*64/10) ~= 19.2;
-// assert(b+MULT_C <= 32)
+const dword TICK_FF = 16;	// fixed point precision of output sample position
+const dword BLEP_PHASES_FF = 5;
+const dword BLEP_PHASES = 1 << BLEP_PHASES_FF; // subsample positions of band-limited step
+const dword BLEP_FF = 14;	// fixed point precision of band-limited step
+
+static int blep[BLEP_PHASES][SNDR_BLEP_TAPS];
 
 //=============================================================================
 //	eDeviceSound::FrameStart
 //-----------------------------------------------------------------------------
 void eDeviceSound::FrameStart(dword tacts)
 {
-	dword endtick = (tacts * (qword)sample_rate * TICK_F) / clock_rate; //prev frame rest
-	base_tick = tick - endtick;
+	Log(eEvent::E_FRAME_START, tacts);
 }
 //=============================================================================
 //	eDeviceSound::Update
 //-----------------------------------------------------------------------------
 void eDeviceSound::Update(dword tact, dword l, dword r)
 {
-	if(!((l ^ mix_l) | (r ^ mix_r)))
+	if(!((l ^ log_l) | (r ^ log_r)))
 		return;
-	dword endtick = (tact * (qword)sample_rate * TICK_F) / clock_rate;
-	Flush(base_tick + endtick);
-	mix_l = l; mix_r = r;
+	Log(eEvent::E_UPDATE, tact, l, r);
+	log_l = l; log_r = r;
+}
+//=============================================================================
+//	eDeviceSound::FrameSlice
+//	samples up to tacts are rendered now, not waiting for frame end
+//	(in place - slices are short, thread switch costs more than rendering)
+//-----------------------------------------------------------------------------
+void eDeviceSound::FrameSlice(dword tacts)
+{
+	Log(eEvent::E_FRAME_SLICE, tacts);
+	RenderNow();
 }
 //=============================================================================
 //	eDeviceSound::FrameEnd
 //-----------------------------------------------------------------------------
 void eDeviceSound::FrameEnd(dword tacts)
 {
-	dword cr = (tacts * frame_rate) >> 4;
+	Log(eEvent::E_FRAME_END, tacts, frame_rate);
+	Wait();
+	eEvent* l = render_log;
+	render_log = log;
+	render_size = log_size;
+	log = l;
+	log_size = 0;
+	render_thread.Start(RenderProc, this);
+}
+//=============================================================================
+//	eDeviceSound::RenderProc
+//-----------------------------------------------------------------------------
+void eDeviceSound::RenderProc(void* param)
+{
+	eDeviceSound* ds = (eDeviceSound*)param;
+	for(dword i = 0; i < ds->render_size; ++i)
+		ds->Render(ds->render_log[i]);
+	ds->render_size = 0;
+}
+//=============================================================================
+//	eDeviceSound::RenderNow
+//	log overflow inside frame - render logged events immediately
+//-----------------------------------------------------------------------------
+void eDeviceSound::RenderNow()
+{
+	Wait();
+	for(dword i = 0; i < log_size; ++i)
+		Render(log[i]);
+	log_size = 0;
+}
+//=============================================================================
+//	eDeviceSound::Render
+//-----------------------------------------------------------------------------
+void eDeviceSound::Render(const eEvent& e)
+{
+	switch(e.type)
+	{
+	case eEvent::E_FRAME_START:	SynthFrameStart(e.tact);			break;
+	case eEvent::E_FRAME_SLICE:	SynthFrameSlice(e.tact);			break;
+	case eEvent::E_UPDATE:		SynthUpdate(e.tact, e.p0, e.p1);	break;
+	case eEvent::E_FRAME_END:	SynthFrameEnd(e.tact, e.p0);		break;
+	}
+}
+//=============================================================================
+//	eDeviceSound::Ticks
+//	tacts to output samples (fixed point)
+//-----------------------------------------------------------------------------
+inline dword eDeviceSound::Ticks(dword tacts) const
+{
+	return (dword)(((qword)tacts * tick_step) >> 16);
+}
+//=============================================================================
+//	eDeviceSound::SynthFrameStart
+//-----------------------------------------------------------------------------
+void eDeviceSound::SynthFrameStart(dword tacts)
+{
+	base_tick = tick - Ticks(tacts); //prev frame rest
+}
+//=============================================================================
+//	eDeviceSound::SynthUpdate
+//-----------------------------------------------------------------------------
+void eDeviceSound::SynthUpdate(dword tact, dword l, dword r)
+{
+	if(!((l ^ mix_l) | (r ^ mix_r)))
+		return;
+	dword pos = base_tick + Ticks(tact);
+	dword i = pos >> TICK_FF;
+	if(i >= ACC_LEN)
+		i = ACC_LEN - 1;
+	const int* k = blep[(pos >> (TICK_FF - BLEP_PHASES_FF)) & (BLEP_PHASES - 1)];
+	int dl = l - mix_l;
+	int dr = r - mix_r;
+	int* al = acc_l + i;
+	int* ar = acc_r + i;
+	// fixed length loop without dependencies - vectorized by compiler,
+	// cost per step doesn't depend on sample rate
+	for(dword j = 0; j < SNDR_BLEP_TAPS; ++j)
+	{
+		al[j] += k[j] * dl;
+		ar[j] += k[j] * dr;
+	}
+	if(acc_end < i + SNDR_BLEP_TAPS)
+		acc_end = i + SNDR_BLEP_TAPS;
+	mix_l = l; mix_r = r;
+}
+//=============================================================================
+//	eDeviceSound::SynthFrameSlice
+//-----------------------------------------------------------------------------
+void eDeviceSound::SynthFrameSlice(dword tacts)
+{
+	Flush(base_tick + Ticks(tacts));
+}
+//=============================================================================
+//	eDeviceSound::SynthFrameEnd
+//-----------------------------------------------------------------------------
+void eDeviceSound::SynthFrameEnd(dword tacts, dword _frame_rate)
+{
+	dword cr = (tacts * _frame_rate) >> 4;
 	if(cr < clock_rate_default / 2)
 		cr = clock_rate_default;
-	dword endtick = (tacts * (qword)sample_rate * TICK_F) / clock_rate;
-	Flush(base_tick + endtick);
+	Flush(base_tick + Ticks(tacts));
 	clock_rate = cr; //auto adjusting by frame tacts
+	tick_step = ((qword)sample_rate << (TICK_FF + 16)) / clock_rate;
 }
 //=============================================================================
 //	eDeviceSound::AudioData
 //-----------------------------------------------------------------------------
 void* eDeviceSound::AudioData()
 {
+	Wait();
 	return buffer;
 }
 //=============================================================================
@@ -76,6 +184,7 @@ void* eDeviceSound::AudioData()
 //-----------------------------------------------------------------------------
 dword eDeviceSound::AudioDataReady()
 {
+	Wait();
 	return (dstpos - buffer)*sizeof(SNDSAMPLE);
 }
 //=============================================================================
@@ -83,152 +192,117 @@ dword eDeviceSound::AudioDataReady()
 //-----------------------------------------------------------------------------
 void eDeviceSound::AudioDataUse(dword size)
 {
-	assert(size == AudioDataReady());
-	dstpos = buffer;
+	Wait();
+	dword ready = AudioDataReady();
+	assert(size <= ready);
+	dword rest = (ready - size)/sizeof(SNDSAMPLE);
+	if(rest) // keep samples not used yet (sources may be ahead by few samples)
+		memmove(buffer, buffer + size/sizeof(SNDSAMPLE), rest*sizeof(SNDSAMPLE));
+	dstpos = buffer + rest;
+}
+//=============================================================================
+//	eDeviceSound::SampleRate
+//-----------------------------------------------------------------------------
+void eDeviceSound::SampleRate(dword v)
+{
+	SetTimings(clock_rate_default, v);
 }
 //=============================================================================
 //	eDeviceSound::SetTimings
 //-----------------------------------------------------------------------------
 void eDeviceSound::SetTimings(dword _clock_rate, dword _sample_rate)
 {
+	Wait();
 	clock_rate_default = clock_rate = _clock_rate;
 	sample_rate = _sample_rate;
+	tick_step = ((qword)sample_rate << (TICK_FF + 16)) / clock_rate;
 
 	tick = base_tick = 0;
 	dstpos = buffer;
+	memset(acc_l, 0, sizeof(acc_l));
+	memset(acc_r, 0, sizeof(acc_r));
+	acc_end = 0;
+	sum_l = mix_l << BLEP_FF;
+	sum_r = mix_r << BLEP_FF;
 }
 
-static dword filter_diff[TICK_F*2];
-const double filter_sum_full = 1.0, filter_sum_half = 0.5;
-const dword filter_sum_full_u = (dword)(filter_sum_full * 0x10000);
-const dword filter_sum_half_u = (dword)(filter_sum_half * 0x10000);
-
 //=============================================================================
 //	eDeviceSound::Flush
+//	integrates complete samples (before endtick) into output buffer
 //-----------------------------------------------------------------------------
 void eDeviceSound::Flush(dword endtick)
 {
-	dword scale;
-	if(!((endtick ^ tick) & ~(TICK_F-1)))
-	{
-		//same discrete as before
-		scale = filter_diff[(endtick & (TICK_F-1)) + TICK_F] - filter_diff[(tick & (TICK_F-1)) + TICK_F];
-		s2_l += mix_l * scale;
-		s2_r += mix_r * scale;
-
-		scale = filter_diff[endtick & (TICK_F-1)] - filter_diff[tick & (TICK_F-1)];
-		s1_l += mix_l * scale;
-		s1_r += mix_r * scale;
-
-		tick = endtick;
-	}
-	else
+	dword n = endtick >> TICK_FF;
+	if(n > ACC_LEN)
+		n = ACC_LEN;
+	for(dword i = 0; i < n; ++i)
 	{
-		scale = filter_sum_full_u - filter_diff[(tick & (TICK_F-1)) + TICK_F];
-
-		dword sample_value;
-		sample_value =	((mix_l*scale + s2_l) >> 16) +
-						((mix_r*scale + s2_r) & 0xFFFF0000);
-
-		dstpos->sample = sample_value;
+		sum_l += acc_l[i];
+		sum_r += acc_r[i];
+		int l = sum_l >> BLEP_FF;
+		int r = sum_r >> BLEP_FF;
+		if(l < -0x8000) l = -0x8000; else if(l > 0x7fff) l = 0x7fff;
+		if(r < -0x8000) r = -0x8000; else if(r > 0x7fff) r = 0x7fff;
+		dstpos->ch.left = l;
+		dstpos->ch.right = r;
 		dstpos++;
 		if(dstpos - buffer >= BUFFER_LEN)
 		{
 			dstpos = buffer;
 		}
-
-		scale = filter_sum_half_u - filter_diff[tick & (TICK_F-1)];
-		s2_l = s1_l + mix_l * scale;
-		s2_r = s1_r + mix_r * scale;
-
-		tick = (tick | (TICK_F-1))+1;
-
-		if((endtick ^ tick) & ~(TICK_F-1))
-		{
-			// assume filter_coeff is symmetric
-			dword val_l = mix_l * filter_sum_half_u;
-			dword val_r = mix_r * filter_sum_half_u;
-			do
-			{
-				dword sample_value;
-				sample_value =	((s2_l + val_l) >> 16) +
-								((s2_r + val_r) & 0xFFFF0000); // save s2+val
-
-				dstpos->sample = sample_value;
-				dstpos++;
-				if(dstpos - buffer >= BUFFER_LEN)
-				{
-					dstpos = buffer;
-				}
-
-				tick += TICK_F;
-				s2_l = val_l;
-				s2_r = val_r; // s2=s1, s1=0;
-
-			} while ((endtick ^ tick) & ~(TICK_F-1));
-		}
-
-		tick = endtick;
-
-		scale = filter_diff[(endtick & (TICK_F-1)) + TICK_F] - filter_sum_half_u;
-		s2_l += mix_l * scale;
-		s2_r += mix_r * scale;
-
-		scale = filter_diff[endtick & (TICK_F-1)];
-		s1_l = mix_l * scale;
-		s1_r = mix_r * scale;
 	}
+	// move tails of steps to beginning
+	if(acc_end > n)
+	{
+		memmove(acc_l, acc_l + n, (acc_end - n)*sizeof(int));
+		memmove(acc_r, acc_r + n, (acc_end - n)*sizeof(int));
+		memset(acc_l + acc_end - n, 0, n*sizeof(int));
+		memset(acc_r + acc_end - n, 0, n*sizeof(int));
+		acc_end -= n;
+	}
+	else
+	{
+		memset(acc_l, 0, acc_end*sizeof(int));
+		memset(acc_r, 0, acc_end*sizeof(int));
+		acc_end = 0;
+	}
+	tick = endtick - (n << TICK_FF);
+	base_tick -= n << TICK_FF; // rest of frame (if flushed on slice) is relative to new position
 }
 
-const double filter_coeff[TICK_F*2] =
-{
-	// filter designed with Matlab's DSP toolbox
-	0.000797243121022152, 0.000815206499600866, 0.000844792477531490, 0.000886460636664257,
-	0.000940630171246217, 0.001007677515787512, 0.001087934129054332, 0.001181684445143001,
-	0.001289164001921830, 0.001410557756409498, 0.001545998595893740, 0.001695566052785407,
-	0.001859285230354019, 0.002037125945605404, 0.002229002094643918, 0.002434771244914945,
-	0.002654234457752337, 0.002887136343664226, 0.003133165351783907, 0.003391954293894633,
-	0.003663081102412781, 0.003946069820687711, 0.004240391822953223, 0.004545467260249598,
-	0.004860666727631453, 0.005185313146989532, 0.005518683858848785, 0.005860012915564928,
-	0.006208493567431684, 0.006563280932335042, 0.006923494838753613, 0.007288222831108771,
-	0.007656523325719262, 0.008027428904915214, 0.008399949736219575, 0.008773077102914008,
-	0.009145787031773989, 0.009517044003286715, 0.009885804729257883, 0.010251021982371376,
-	0.010611648461991030, 0.010966640680287394, 0.011314962852635887, 0.011655590776166550,
-	0.011987515680350414, 0.012309748033583185, 0.012621321289873522, 0.012921295559959939,
-	0.013208761191466523, 0.013482842243062109, 0.013742699838008606, 0.013987535382970279,
-	0.014216593638504731, 0.014429165628265581, 0.014624591374614174, 0.014802262449059521,
-	0.014961624326719471, 0.015102178534818147, 0.015223484586101132, 0.015325161688957322,
-	0.015406890226980602, 0.015468413001680802, 0.015509536233058410, 0.015530130313785910,
-	0.015530130313785910, 0.015509536233058410, 0.015468413001680802, 0.015406890226980602,
-	0.015325161688957322, 0.015223484586101132, 0.015102178534818147, 0.014961624326719471,
-	0.014802262449059521, 0.014624591374614174, 0.014429165628265581, 0.014216593638504731,
-	0.013987535382970279, 0.013742699838008606, 0.013482842243062109, 0.013208761191466523,
-	0.012921295559959939, 0.012621321289873522, 0.012309748033583185, 0.011987515680350414,
-	0.011655590776166550, 0.011314962852635887, 0.010966640680287394, 0.010611648461991030,
-	0.010251021982371376, 0.009885804729257883, 0.009517044003286715, 0.009145787031773989,
-	0.008773077102914008, 0.008399949736219575, 0.008027428904915214, 0.007656523325719262,
-	0.007288222831108771, 0.006923494838753613, 0.006563280932335042, 0.006208493567431684,
-	0.005860012915564928, 0.005518683858848785, 0.005185313146989532, 0.004860666727631453,
-	0.004545467260249598, 0.004240391822953223, 0.003946069820687711, 0.003663081102412781,
-	0.003391954293894633, 0.003133165351783907, 0.002887136343664226, 0.002654234457752337,
-	0.002434771244914945, 0.002229002094643918, 0.002037125945605404, 0.001859285230354019,
-	0.001695566052785407, 0.001545998595893740, 0.001410557756409498, 0.001289164001921830,
-	0.001181684445143001, 0.001087934129054332, 0.001007677515787512, 0.000940630171246217,
-	0.000886460636664257, 0.000844792477531490, 0.000815206499600866, 0.000797243121022152
-};
-
 //=============================================================================
-//	eFilterDiffInit
+//	eBlepInit
+//	band-limited impulses (blackman windowed sinc) for BLEP_PHASES subsample positions,
+//	each phase sums exactly to 1 << BLEP_FF so integrated steps have no dc error
 //-----------------------------------------------------------------------------
-static struct eFilterDiffInit
+static struct eBlepInit
 {
-	eFilterDiffInit()
+	eBlepInit()
 	{
-		double sum = 0;
-		for(int i = 0; i < (int)TICK_F*2; i++)
+		const double pi = 3.14159265358979323846;
+		const double cutoff = 0.45; // of sample rate
+		const int half = SNDR_BLEP_TAPS/2;
+		for(int p = 0; p < (int)BLEP_PHASES; ++p)
 		{
-			filter_diff[i] = (int)(sum * 0x10000);
-			sum += filter_coeff[i];
+			double h[SNDR_BLEP_TAPS];
+			double sum = 0;
+			for(int i = 0; i < (int)SNDR_BLEP_TAPS; ++i)
+			{
+				double x = i - (half - 1) - double(p)/BLEP_PHASES;
+				double s = x ? sin(2*pi*cutoff*x)/(pi*x) : 2*cutoff;
+				double w = 0.42 + 0.5*cos(pi*x/half) + 0.08*cos(2*pi*x/half);
+				h[i] = s*w;
+				sum += h[i];
+			}
+			int total = 0, peak = 0;
+			for(int i = 0; i < (int)SNDR_BLEP_TAPS; ++i)
+			{
+				blep[p][i] = (int)floor(h[i]/sum*(1 << BLEP_FF) + 0.5);
+				total += blep[p][i];
+				if(blep[p][i] > blep[p][peak])
+					peak = i;
+			}
+			blep[p][peak] += (1 << BLEP_FF) - total;
 		}
 	}
-} fdi;
+} bi;
@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define __DEVICE_SOUND_H__
 
 #include "../device.h"
+#include "../../tools/thread.h"
 
 #pragma once
 
@@ -31,39 +32,86 @@ union SNDSAMPLE
 
 const dword SNDR_DEFAULT_SYSTICK_RATE = 71680 * 50; // ZX-Spectrum Z80 clock
 const dword SNDR_DEFAULT_SAMPLE_RATE = 44100;
+const dword SNDR_BLEP_TAPS = 16; // band-limited step length (output samples)
 
 //=============================================================================
 //	eDeviceSound
+//	sound changes are logged during frame and rendered to buffer after frame end
+//	(in separate thread if available) - Z80 emulation isn't slowed by synthesis
 //-----------------------------------------------------------------------------
 class eDeviceSound : public eDevice
 {
 public:
 	eDeviceSound();
+	virtual ~eDeviceSound() { Wait(); }
 	void FrameRate(dword v) { frame_rate = v; } //28.4 fixedpoint
+	void SampleRate(dword v);
 	void SetTimings(dword clock_rate, dword sample_rate);
 
 	virtual void FrameStart(dword tacts);
+	virtual void FrameSlice(dword tacts);
 	virtual void FrameEnd(dword tacts);
-	virtual void Update(dword tact, dword l, dword r);
+	void Update(dword tact, dword l, dword r);
 
 	void* AudioData();
 	dword AudioDataReady();
 	void AudioDataUse(dword size);
 protected:
+	struct eEvent
+	{
+		enum eType { E_FRAME_START, E_FRAME_SLICE, E_FRAME_END, E_UPDATE, E_WRITE };
+		dword type;
+		dword tact;
+		dword p0, p1;
+	};
+	void Log(dword type, dword tact, dword p0 = 0, dword p1 = 0)
+	{
+		if(log_size == LOG_LEN)
+			RenderNow();
+		eEvent& e = log[log_size++];
+		e.type = type; e.tact = tact; e.p0 = p0; e.p1 = p1;
+	}
+	void Wait() { render_thread.Wait(); }
+	virtual void Render(const eEvent& e);
+
+	void SynthFrameStart(dword tacts);
+	void SynthFrameSlice(dword tacts);
+	void SynthFrameEnd(dword tacts, dword _frame_rate);
+	void SynthUpdate(dword tact, dword l, dword r);
 	void Flush(dword endtick);
+	dword Ticks(dword tacts) const;
+private:
+	void RenderNow();
+	static void RenderProc(void* param);
 protected:
 	enum { BUFFER_LEN = 16384 };
 	SNDSAMPLE buffer[BUFFER_LEN];
 	SNDSAMPLE* dstpos;
 
+	// band-limited steps are accumulated at output sample rate
+	// and integrated into buffer when samples are complete
+	enum { ACC_LEN = 8192 };
+	int acc_l[ACC_LEN + SNDR_BLEP_TAPS];
+	int acc_r[ACC_LEN + SNDR_BLEP_TAPS];
+	dword acc_end;
+	int sum_l, sum_r;
+
 	dword mix_l, mix_r;
 	dword clock_rate_default;
 	dword clock_rate;
 	dword sample_rate;
 	dword tick, base_tick;
-	dword s1_l, s1_r;
-	dword s2_l, s2_r;
+	qword tick_step; // output samples per tact (fixed point)
 	dword frame_rate;
+private:
+	enum { LOG_LEN = 4096 };
+	eEvent logs[2][LOG_LEN];
+	eEvent* log;	// logging now
+	dword log_size;
+	eEvent* render_log;	// rendering now
+	dword render_size;
+	dword log_l, log_r;
+	eThread render_thread;
 };
 
 #endif//__DEVICE_SOUND_H__
@@ -171,18 +171,20 @@ void eUla::SwitchScreen(bool first, int tact)
 	base = memory->Get(page);
 }
 //=============================================================================
-//	eUla::IoRead
+//	eUla::IoReadDecode
 //-----------------------------------------------------------------------------
-bool eUla::IoRead(word port) const
+void eUla::IoReadDecode(eIoDecoder* d) const
 {
-	return (port&0xff) == 0xff;
+	d->Port(0x00ff, 0xff);
 }
 //=============================================================================
-//	eUla::IoWrite
+//	eUla::IoWriteDecode
 //-----------------------------------------------------------------------------
-bool eUla::IoWrite(word port) const
+void eUla::IoWriteDecode(eIoDecoder* d) const
 {
-	return !(port&1) || (!memory->Mode48k() && !(port & 2) && !(port & 0x8000));
+	d->Port(0x0001, 0);
+	if(!memory->Mode48k())
+		d->Port(0x8002, 0);
 }
 //=============================================================================
 //	eUla::IoRead
@@ -36,13 +36,14 @@ public:
 	virtual void Init();
 	virtual void Reset();
 	virtual void FrameUpdate();
-	virtual bool IoRead(word port) const;
-	virtual bool IoWrite(word port) const;
+	virtual void IoReadDecode(eIoDecoder* d) const;
+	virtual void IoWriteDecode(eIoDecoder* d) const;
 	virtual void IoRead(word port, byte* v, int tact);
 	virtual void IoWrite(word port, byte v, int tact);
 	void	Write(int tact) { if(prev_t < tact) UpdateRay(tact); }
 
 	void*	Screen() const { return screen; }
+	enum eScreen { S_WIDTH = 320, S_HEIGHT = 240, SZX_WIDTH = 256, SZX_HEIGHT = 192 };
 
 	byte	BorderColor() const { return border_color; }
 	bool	FirstScreen() const { return first_screen; }
@@ -59,7 +60,6 @@ protected:
 	void	UpdateRayPaper(int& t, int last_t);
 	void	FlushScreen();
 
-	enum eScreen { S_WIDTH = 320, S_HEIGHT = 240, SZX_WIDTH = 256, SZX_HEIGHT = 192 };
 	struct eTiming
 	{
 		enum eZone { Z_SHADOW, Z_BORDER, Z_PAPER };
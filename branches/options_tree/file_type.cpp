@@ -45,5 +45,27 @@ eFileType* eFileType::FindByName(const char* name)
 	return Find(type);
 }
 
+// archive type for "path/archive/entry" names
+eFileType* eFileType::FindArchive(const char* name, char* archive, const char** entry)
+{
+	int l = strlen(name);
+	if(l >= xIo::MAX_PATH_LEN)
+		return NULL;
+	strcpy(archive, name);
+	for(int i = l; --i > 0;)
+	{
+		if(name[i] != '/' && name[i] != '\\')
+			continue;
+		archive[i] = '\0';
+		eFileType* t = FindByName(archive);
+		if(t && t->Entry(archive, 0))
+		{
+			*entry = name + i + 1;
+			return t;
+		}
+	}
+	return NULL;
+}
+
 }
 //namespace xPlatform
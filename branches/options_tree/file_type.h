@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define __FILE_TYPE_H__
 
 #include "tools/list.h"
+#include "tools/file_data.h"
 
 #pragma once
 
@@ -29,9 +30,26 @@ namespace xPlatform
 struct eFileType : public eList<eFileType>
 {
 	virtual bool Open(const void* data, size_t data_size) = 0;
+	// data isn't copied, name is NULL for archive entries
+	virtual bool OpenFile(const char* name, xIo::eFileData* data) { return Open(data->Data(), data->Size()); }
 	virtual bool Store(const char* name) { return false; }
 	virtual bool AbleOpen() { return true; }
 	virtual const char* Type() = 0;
+	// format detection by contents (header signature, size)
+	virtual bool Detect(const void* data, size_t data_size) { return false; }
+
+	// archives: images inside are listed by index and opened as "archive/entry" names
+	virtual const char* Entry(const char* archive, int index) { return NULL; }
+	virtual xIo::eFileData* Unpack(const char* archive, const char* entry) { return NULL; }
+	// background opening: image is read & parsed by Prepare() on worker thread (emulated
+	// machine isn't touched there), then inserted by Apply() at frame boundary and deleted
+	struct eImage { virtual ~eImage() {} };
+	virtual bool AblePrepare() { return false; }
+	virtual eImage* Prepare(const char* name, xIo::eFileData* data) { return NULL; }
+	// image sets (disks of one game), slot 0 is opened, others are inserted only
+	virtual int Slots() { return 1; }
+	virtual bool Apply(eImage* image, int slot) { SAFE_DELETE(image); return false; }
+
 	static eFileType* Find(const char* type)
 	{
 		for(eFileType* t = First(); t; t = t->Next())
@@ -42,6 +60,17 @@ struct eFileType : public eList<eFileType>
 		return NULL;
 	}
 	static eFileType* FindByName(const char* name);
+	static eFileType* FindByData(const void* data, size_t data_size)
+	{
+		for(eFileType* t = First(); t; t = t->Next())
+		{
+			if(t->Detect(data, data_size))
+				return t;
+		}
+		return NULL;
+	}
+	// archive path is copied (MAX_PATH_LEN buffer), entry points to name inside of archive
+	static eFileType* FindArchive(const char* name, char* archive, const char** entry);
 };
 
 }
@@ -21,17 +21,34 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifdef USE_ZIP
 
 #include <unzip.h>
+#include <sys/stat.h>
 #include "platform/io.h"
 #include "tools/stream_memory.h"
+#include "tools/thread.h"
 #include "file_type.h"
 
 namespace xPlatform
 {
 
+enum { MAX_SLOTS = 4 };
+
 static struct eFileTypeZIP : public eFileType
 {
-	virtual bool Open(const void* data, size_t data_size);
+	virtual bool Open(const void* data, size_t data_size)
+	{
+		xIo::eFileData* d = xIo::eFileData::Copy(data, data_size);
+		bool ok = OpenFile(NULL, d);
+		d->Release();
+		return ok;
+	}
+	virtual bool OpenFile(const char* name, xIo::eFileData* data) { return Apply(Prepare(name, data), 0); }
+	virtual bool AblePrepare() { return true; }
+	virtual eImage* Prepare(const char* name, xIo::eFileData* data);
+	virtual bool Apply(eImage* image, int slot);
+	virtual const char* Entry(const char* archive, int index);
+	virtual xIo::eFileData* Unpack(const char* archive, const char* entry);
 	virtual const char* Type() { return "zip"; }
+	virtual bool Detect(const void* data, size_t data_size) { return data_size >= 22 && !memcmp(data, "PK\x03\x04", 4); }
 } ft_zip;
 
 static voidpf ZOpen(voidpf opaque, const void* filename, int mode)
@@ -68,53 +85,388 @@ static int ZClose(voidpf opaque, voidpf stream)
 	xIo::eStreamMemory* f = (xIo::eStreamMemory*)stream;
 	return f->Close();
 }
-
-bool eFileTypeZIP::Open(const void* data, size_t data_size)
+static unzFile ZipOpen(xIo::eStreamMemory* f)
 {
-	xIo::eStreamMemory mf(data, data_size);
 	zlib_filefunc64_def zfuncs;
 	zfuncs.zopen64_file = ZOpen;
 	zfuncs.zread_file = ZRead;
 	zfuncs.ztell64_file = ZTell;
 	zfuncs.zseek64_file = ZSeek;
 	zfuncs.zclose_file = ZClose;
+	return unzOpen2_64(f, &zfuncs);
+}
 
-	unzFile h = unzOpen2_64(&mf, &zfuncs);
+//*****************************************************************************
+//	eZipIndex
+//	images inside of archive, central directory is walked once
+//-----------------------------------------------------------------------------
+struct eZipIndex
+{
+	enum { MAX_ENTRIES = 256, MAX_NAME = 256 };
+	struct eEntry
+	{
+		char name[MAX_NAME];
+		unz64_file_pos pos;
+		size_t size;
+		bool stored;
+	};
+	eZipIndex() : time(0), size(0), count(0) { *name = '\0'; }
+	bool Build(xIo::eFileData* data);
+	const eEntry* Find(const char* entry) const
+	{
+		for(int i = 0; i < count; ++i)
+		{
+			if(!strcmp(entries[i].name, entry))
+				return &entries[i];
+		}
+		return NULL;
+	}
+	char name[xIo::MAX_PATH_LEN];
+	time_t time;
+	size_t size;
+	int count;
+	eEntry entries[MAX_ENTRIES];
+};
+//=============================================================================
+//	eZipIndex::Build
+//-----------------------------------------------------------------------------
+bool eZipIndex::Build(xIo::eFileData* data)
+{
+	count = 0;
+	xIo::eStreamMemory mf(data->Data(), data->Size());
+	unzFile h = ZipOpen(&mf);
 	if(!h)
 		return false;
-	bool ok = false;
-	if(unzGoToFirstFile(h) == UNZ_OK)
+	for(int r = unzGoToFirstFile(h); r == UNZ_OK && count < MAX_ENTRIES; r = unzGoToNextFile(h))
 	{
-		for(;;)
+		unz_file_info fi;
+		eEntry& e = entries[count];
+		if(unzGetCurrentFileInfo(h, &fi, e.name, MAX_NAME, NULL, 0, NULL, 0) != UNZ_OK)
+			continue;
+		if(fi.size_filename >= MAX_NAME || (fi.flag & 1)) // too long name or encrypted
+			continue;
+		eFileType* t = eFileType::FindByName(e.name);
+		if(!t || t == &ft_zip) // archives inside of archive aren't supported
+			continue;
+		if(unzGetFilePos64(h, &e.pos) != UNZ_OK)
+			continue;
+		e.size = fi.uncompressed_size;
+		e.stored = fi.compression_method == 0;
+		++count;
+	}
+	unzClose(h);
+	return true;
+}
+
+//*****************************************************************************
+//	eZipCache
+//	recently used archives indices, checked against archive time & size
+//	shared by ui & open threads, callers get copies made under lock
+//-----------------------------------------------------------------------------
+static struct eZipCache
+{
+	enum { SIZE = 4 };
+	eZipCache() { memset(items, 0, sizeof(items)); }
+	~eZipCache()
+	{
+		for(int i = 0; i < SIZE; ++i)
 		{
-			unz_file_info fi;
-			char n[xIo::MAX_PATH_LEN];
-			if(unzGetCurrentFileInfo(h, &fi, n, xIo::MAX_PATH_LEN, NULL, 0, NULL, 0) == UNZ_OK)
-			{
-				eFileType* t = eFileType::FindByName(n);
-				if(t)
-				{
-					if(unzOpenCurrentFile(h) == UNZ_OK)
-					{
-						byte* buf = new byte[fi.uncompressed_size];
-						if(unzReadCurrentFile(h, buf, fi.uncompressed_size) == int(fi.uncompressed_size))
-						{
-							ok = t->Open(buf, fi.uncompressed_size);
-						}
-						delete[] buf;
-						unzCloseCurrentFile(h);
-					}
-				}
-			}
-			if(ok)
-				break;
-			if(unzGoToNextFile(h) == UNZ_END_OF_LIST_OF_FILE)
+			SAFE_DELETE(items[i]);
+		}
+	}
+	bool Copy(const char* name, xIo::eFileData* data, eZipIndex* index);
+	bool Entry(const char* name, xIo::eFileData* data, const char* entry, eZipIndex::eEntry* e);
+	bool Entry(const char* name, int index, char* entry);
+	eZipIndex* Index(const char* name, xIo::eFileData* data);
+	eZipIndex* items[SIZE];
+	eMutex mutex;
+} zip_cache;
+//=============================================================================
+//	eZipCache::Index
+//	data can be NULL, archive is mapped then if index isn't cached
+//-----------------------------------------------------------------------------
+eZipIndex* eZipCache::Index(const char* name, xIo::eFileData* data)
+{
+	struct stat st;
+	bool cached = name && strlen(name) < xIo::MAX_PATH_LEN && stat(name, &st) == 0;
+	int i = SIZE;
+	if(cached)
+	{
+		for(i = 0; i < SIZE; ++i)
+		{
+			eZipIndex* idx = items[i];
+			if(idx && idx->time == st.st_mtime && idx->size == (size_t)st.st_size && !strcmp(idx->name, name))
 				break;
 		}
 	}
+	if(i < SIZE)
+	{
+		eZipIndex* idx = items[i];
+		for(; i > 0; --i) // most recent first
+			items[i] = items[i - 1];
+		items[0] = idx;
+		return idx;
+	}
+	xIo::eFileData* d = data;
+	if(!d && name)
+		d = xIo::eFileData::Map(name);
+	if(!d)
+		return NULL;
+	eZipIndex* idx = items[SIZE - 1];
+	if(!idx)
+		idx = new eZipIndex;
+	for(i = SIZE; --i > 0;)
+		items[i] = items[i - 1];
+	items[0] = idx;
+	*idx->name = '\0';
+	bool ok = idx->Build(d);
+	if(d != data)
+		d->Release();
+	if(!ok)
+		return NULL;
+	if(cached)
+	{
+		strcpy(idx->name, name);
+		idx->time = st.st_mtime;
+		idx->size = st.st_size;
+	}
+	return idx;
+}
+//=============================================================================
+//	eZipCache::Copy
+//-----------------------------------------------------------------------------
+bool eZipCache::Copy(const char* name, xIo::eFileData* data, eZipIndex* index)
+{
+	eLock lock(mutex);
+	eZipIndex* idx = Index(name, data);
+	if(!idx)
+		return false;
+	*index = *idx;
+	return true;
+}
+//=============================================================================
+//	eZipCache::Entry
+//	entry found by name
+//-----------------------------------------------------------------------------
+bool eZipCache::Entry(const char* name, xIo::eFileData* data, const char* entry, eZipIndex::eEntry* e)
+{
+	eLock lock(mutex);
+	eZipIndex* idx = Index(name, data);
+	const eZipIndex::eEntry* f = idx ? idx->Find(entry) : NULL;
+	if(!f)
+		return false;
+	*e = *f;
+	return true;
+}
+//=============================================================================
+//	eZipCache::Entry
+//	entry name by index
+//-----------------------------------------------------------------------------
+bool eZipCache::Entry(const char* name, int index, char* entry)
+{
+	eLock lock(mutex);
+	eZipIndex* idx = Index(name, NULL);
+	if(!idx || index < 0 || index >= idx->count)
+		return false;
+	strcpy(entry, idx->entries[index].name);
+	return true;
+}
+
+//*****************************************************************************
+//	eUnpackJob
+//	entries are unpacked only when opened, several ones in parallel
+//-----------------------------------------------------------------------------
+struct eUnpackJob
+{
+	eUnpackJob() : archive(NULL), entry(NULL), data(NULL), offset(0) {}
+	xIo::eFileData* archive;
+	const eZipIndex::eEntry* entry;
+	xIo::eFileData* data;
+	size_t offset; // of stored entry data in archive
+	static void Run(void* arg);
+};
+static eThread unpack_threads[MAX_SLOTS - 1];
+//=============================================================================
+//	eUnpackJob::Run
+//-----------------------------------------------------------------------------
+void eUnpackJob::Run(void* arg)
+{
+	eUnpackJob* j = (eUnpackJob*)arg;
+	xIo::eStreamMemory mf(j->archive->Data(), j->archive->Size());
+	unzFile h = ZipOpen(&mf);
+	if(!h)
+		return;
+	unz64_file_pos pos = j->entry->pos;
+	if(unzGoToFilePos64(h, &pos) == UNZ_OK && unzOpenCurrentFile(h) == UNZ_OK)
+	{
+		if(j->entry->stored) // archive data used as is, span is made by caller thread
+			j->offset = (size_t)unzGetCurrentFileZStreamPos64(h);
+		else
+		{
+			xIo::eFileData* d = xIo::eFileData::Alloc(j->entry->size);
+			if(unzReadCurrentFile(h, d->Buffer(), j->entry->size) == int(j->entry->size))
+				j->data = d;
+			else
+				d->Release();
+		}
+		unzCloseCurrentFile(h);
+	}
 	unzClose(h);
+}
+//=============================================================================
+//	UnpackJobs
+//-----------------------------------------------------------------------------
+static void UnpackJobs(eUnpackJob* jobs, int count)
+{
+	assert(count <= MAX_SLOTS);
+	for(int i = 1; i < count; ++i)
+	{
+		unpack_threads[i - 1].Start(eUnpackJob::Run, &jobs[i]);
+	}
+	if(count)
+		eUnpackJob::Run(&jobs[0]);
+	for(int i = 1; i < count; ++i)
+	{
+		unpack_threads[i - 1].Wait();
+	}
+	for(int i = 0; i < count; ++i)
+	{
+		eUnpackJob& j = jobs[i];
+		if(j.entry->stored && j.offset)
+			j.data = j.archive->Span(j.offset, j.entry->size);
+	}
+}
+
+//*****************************************************************************
+//	eZipImage
+//	images of one type (disk set), unpacked data is kept if type isn't prepared in background
+//-----------------------------------------------------------------------------
+struct eZipImage : public eFileType::eImage
+{
+	eZipImage(eFileType* t) : type(t), count(0)
+	{
+		memset(images, 0, sizeof(images));
+		memset(data, 0, sizeof(data));
+	}
+	virtual ~eZipImage()
+	{
+		for(int i = 0; i < count; ++i)
+		{
+			SAFE_DELETE(images[i]);
+			if(data[i])
+				data[i]->Release();
+		}
+	}
+	void Add(xIo::eFileData* d)
+	{
+		if(type->AblePrepare())
+		{
+			images[count] = type->Prepare(NULL, d);
+			if(images[count])
+				++count;
+		}
+		else
+		{
+			d->AddRef();
+			data[count++] = d;
+		}
+	}
+	bool Apply() // following images are inserted only if the first one is opened
+	{
+		for(int i = 0; i < count; ++i)
+		{
+			bool ok = data[i] ? type->OpenFile(NULL, data[i]) : type->Apply(images[i], i);
+			images[i] = NULL;
+			if(!ok && !i)
+				return false;
+		}
+		return true;
+	}
+	eFileType* type;
+	int count;
+	eFileType::eImage* images[MAX_SLOTS];
+	xIo::eFileData* data[MAX_SLOTS];
+};
+
+//=============================================================================
+//	eFileTypeZIP::Prepare
+//	first image is prepared, following ones of the same type fill other slots (multi-disk games)
+//-----------------------------------------------------------------------------
+eFileType::eImage* eFileTypeZIP::Prepare(const char* name, xIo::eFileData* data)
+{
+	eZipIndex* idx = new eZipIndex; // cache copy, entries are used while unpacking
+	eZipImage* image = NULL;
+	if(zip_cache.Copy(name, data, idx))
+	{
+		for(int i = 0; i < idx->count && !image; ++i)
+		{
+			eFileType* t = eFileType::FindByName(idx->entries[i].name);
+			int slots = t->Slots();
+			if(slots > MAX_SLOTS)
+				slots = MAX_SLOTS;
+			eUnpackJob jobs[MAX_SLOTS];
+			int count = 0;
+			for(int j = i; j < idx->count && count < slots; ++j)
+			{
+				if(eFileType::FindByName(idx->entries[j].name) != t)
+					continue;
+				jobs[count].archive = data;
+				jobs[count].entry = &idx->entries[j];
+				++count;
+			}
+			UnpackJobs(jobs, count);
+			image = new eZipImage(t);
+			for(int j = 0; j < count; ++j)
+			{
+				if(jobs[j].data && (!j || image->count))
+					image->Add(jobs[j].data);
+				if(jobs[j].data)
+					jobs[j].data->Release();
+			}
+			if(!image->count)
+				SAFE_DELETE(image);
+		}
+	}
+	SAFE_DELETE(idx);
+	return image;
+}
+//=============================================================================
+//	eFileTypeZIP::Apply
+//-----------------------------------------------------------------------------
+bool eFileTypeZIP::Apply(eImage* image, int slot)
+{
+	if(!image)
+		return false;
+	bool ok = ((eZipImage*)image)->Apply();
+	SAFE_DELETE(image);
 	return ok;
 }
+//=============================================================================
+//	eFileTypeZIP::Entry
+//-----------------------------------------------------------------------------
+const char* eFileTypeZIP::Entry(const char* archive, int index)
+{
+	static char name[eZipIndex::MAX_NAME]; // ui thread only
+	return zip_cache.Entry(archive, index, name) ? name : NULL;
+}
+//=============================================================================
+//	eFileTypeZIP::Unpack
+//-----------------------------------------------------------------------------
+xIo::eFileData* eFileTypeZIP::Unpack(const char* archive, const char* entry)
+{
+	eUnpackJob job;
+	job.archive = xIo::eFileData::Map(archive);
+	if(!job.archive)
+		return NULL;
+	eZipIndex::eEntry e;
+	if(zip_cache.Entry(archive, job.archive, entry, &e))
+	{
+		job.entry = &e;
+		UnpackJobs(&job, 1);
+	}
+	job.archive->Release();
+	return job.data;
+}
 
 }
 //namespace xPlatform
@@ -0,0 +1,443 @@
+/*
+Portable ZX-Spectrum emulator.
+Copyright (C) 2001-2013 SMT, Dexus, Alone Coder, deathsoft, djdron, scor
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "std.h"
+#include "library.h"
+
+#ifdef USE_UI
+
+#include "speccy.h"
+#include "devices/ula.h"
+#include "z80/z80.h"
+#include "snapshot/snapshot.h"
+#include "platform/io.h"
+#include "tools/io_select.h"
+#include "tools/thread.h"
+#include "tools/file_data.h"
+#include "tools/hash.h"
+#include "file_type.h"
+#include <sys/stat.h>
+
+namespace xLibrary
+{
+
+enum { VERSION = 1, THUMB_THREADS = 2, THUMB_FRAMES = 100 };
+static const char MAGIC[] = "USPL";
+
+//=============================================================================
+//	eFolder::eFolder
+//-----------------------------------------------------------------------------
+eFolder::eFolder() : time(0), size(0), items_alloc(0), items(NULL)
+	, names_size(0), names_alloc(0), names(NULL), thumbs_count(0), thumbs_alloc(0), thumbs(NULL)
+{
+}
+//=============================================================================
+//	eFolder::~eFolder
+//-----------------------------------------------------------------------------
+eFolder::~eFolder()
+{
+	free(items);
+	free(names);
+	free(thumbs);
+}
+//=============================================================================
+//	eFolder::Find
+//	hint is checked first, folder order is usually the same on rescan
+//-----------------------------------------------------------------------------
+int eFolder::Find(const char* name, int hint) const
+{
+	if(hint >= 0 && hint < size && !strcmp(Name(hint), name))
+		return hint;
+	for(int i = 0; i < size; ++i)
+	{
+		if(!strcmp(Name(i), name))
+			return i;
+	}
+	return -1;
+}
+//=============================================================================
+//	eFolder::Find
+//	by contents, renamed or copied image keeps its thumbnail
+//-----------------------------------------------------------------------------
+int eFolder::Find(qword hash, dword _size) const
+{
+	for(int i = 0; i < size; ++i)
+	{
+		if(items[i].hash == hash && items[i].size == _size && !(items[i].flags & eItem::F_FOLDER))
+			return i;
+	}
+	return -1;
+}
+//=============================================================================
+//	eFolder::Add
+//-----------------------------------------------------------------------------
+int eFolder::Add(const char* name)
+{
+	if(size == items_alloc)
+	{
+		items_alloc = items_alloc ? items_alloc*2 : 256;
+		items = (eItem*)realloc(items, items_alloc*sizeof(eItem));
+	}
+	dword l = strlen(name) + 1;
+	if(names_size + l > names_alloc)
+	{
+		names_alloc = (names_size + l)*2;
+		names = (char*)realloc(names, names_alloc);
+	}
+	memcpy(names + names_size, name, l);
+	eItem& i = items[size];
+	memset(&i, 0, sizeof(i));
+	i.name = names_size;
+	names_size += l;
+	return size++;
+}
+//=============================================================================
+//	eFolder::AddThumbnail
+//-----------------------------------------------------------------------------
+byte* eFolder::AddThumbnail(int i)
+{
+	if(thumbs_count == thumbs_alloc)
+	{
+		thumbs_alloc = thumbs_alloc ? thumbs_alloc*2 : 64;
+		thumbs = (byte*)realloc(thumbs, thumbs_alloc*THUMB_SIZE);
+	}
+	items[i].thumb = thumbs_count++;
+	items[i].flags |= eItem::F_THUMB;
+	return thumbs + items[i].thumb*THUMB_SIZE;
+}
+//=============================================================================
+//	eFolder::Load
+//-----------------------------------------------------------------------------
+bool eFolder::Load(const char* file)
+{
+	FILE* f = fopen(file, "rb");
+	if(!f)
+		return false;
+	char magic[4];
+	dword h[5];
+	bool ok = fread(magic, sizeof(magic), 1, f) == 1 && !memcmp(magic, MAGIC, sizeof(magic))
+		&& fread(h, sizeof(h), 1, f) == 1 && h[0] == VERSION;
+	if(ok)
+	{
+		time = h[1];
+		size = items_alloc = h[2];
+		names_size = names_alloc = h[3];
+		thumbs_count = thumbs_alloc = h[4];
+		items = (eItem*)malloc(size*sizeof(eItem));
+		names = (char*)malloc(names_size);
+		thumbs = (byte*)malloc(thumbs_count*THUMB_SIZE);
+		ok = size >= 0 && (!size || (items && fread(items, size*sizeof(eItem), 1, f) == 1))
+			&& (!names_size || (names && fread(names, names_size, 1, f) == 1))
+			&& (!thumbs_count || (thumbs && fread(thumbs, thumbs_count*THUMB_SIZE, 1, f) == 1));
+	}
+	for(int i = 0; ok && i < size; ++i) // don't trust broken index
+	{
+		ok = items[i].name < names_size && (!(items[i].flags & eItem::F_THUMB) || items[i].thumb < thumbs_count);
+	}
+	fclose(f);
+	if(!ok)
+		size = 0;
+	return ok;
+}
+//=============================================================================
+//	eFolder::Save
+//-----------------------------------------------------------------------------
+bool eFolder::Save(const char* file) const
+{
+	FILE* f = fopen(file, "wb");
+	if(!f)
+		return false;
+	dword h[5] = { VERSION, time, dword(size), names_size, thumbs_count };
+	bool ok = fwrite(MAGIC, 4, 1, f) == 1 && fwrite(h, sizeof(h), 1, f) == 1
+		&& (!size || fwrite(items, size*sizeof(eItem), 1, f) == 1)
+		&& (!names_size || fwrite(names, names_size, 1, f) == 1)
+		&& (!thumbs_count || fwrite(thumbs, thumbs_count*THUMB_SIZE, 1, f) == 1);
+	fclose(f);
+	return ok;
+}
+
+//*****************************************************************************
+//	eThumbJob
+//	snapshot is run headless for few frames on worker's own speccy
+//-----------------------------------------------------------------------------
+struct eThumbJob
+{
+	eThumbJob() : speccy(NULL), data(NULL), item(0), ok(false) { *type = '\0'; }
+	static void Run(void* arg);
+	eSpeccy* speccy;
+	xIo::eFileData* data;
+	int item;
+	char type[4];
+	bool ok;
+	byte thumb[THUMB_SIZE];
+};
+static eThread thumb_threads[THUMB_THREADS];
+static eThumbJob thumb_jobs[THUMB_THREADS];
+//=============================================================================
+//	eThumbJob::Run
+//-----------------------------------------------------------------------------
+void eThumbJob::Run(void* arg)
+{
+	eThumbJob* j = (eThumbJob*)arg;
+	j->ok = false;
+	// ROMs are loaded when speccy is created, devices Init() isn't thread safe
+	j->speccy->CPU()->Reset();
+	j->speccy->Devices().Reset();
+	if(!xSnapshot::Load(j->speccy, j->type, j->data->Data(), j->data->Size()))
+		return;
+	for(int i = 0; i < THUMB_FRAMES; ++i)
+	{
+		while(!j->speccy->Update())
+			;
+	}
+	// paper area, most used color of each block
+	enum { BLOCK = eUla::SZX_WIDTH/THUMB_WIDTH };
+	const byte* scr = (const byte*)j->speccy->Device<eUla>()->Screen();
+	scr += (eUla::S_HEIGHT - eUla::SZX_HEIGHT)/2*eUla::S_WIDTH + (eUla::S_WIDTH - eUla::SZX_WIDTH)/2;
+	memset(j->thumb, 0, THUMB_SIZE);
+	for(int y = 0; y < THUMB_HEIGHT; ++y)
+	{
+		for(int x = 0; x < THUMB_WIDTH; ++x)
+		{
+			int counts[16];
+			memset(counts, 0, sizeof(counts));
+			const byte* b = scr + y*BLOCK*eUla::S_WIDTH + x*BLOCK;
+			for(int i = 0; i < BLOCK; ++i)
+			{
+				for(int k = 0; k < BLOCK; ++k)
+				{
+					++counts[b[i*eUla::S_WIDTH + k] & 0x0f];
+				}
+			}
+			int c = 0;
+			for(int i = 1; i < 16; ++i)
+			{
+				if(counts[i] > counts[c])
+					c = i;
+			}
+			j->thumb[(y*THUMB_WIDTH + x)/2] |= (x & 1) ? c : c << 4;
+		}
+	}
+	j->ok = true;
+}
+
+//*****************************************************************************
+//	eScan
+//	folder scan in background, unchanged items are taken from previous index
+//-----------------------------------------------------------------------------
+struct eScan
+{
+	eScan() : time(0), prev(NULL), result(NULL), done(false) { *path = *index = '\0'; }
+	static void Run(void* arg);
+	void ThumbDone(eThumbJob& j, int thread);
+	char path[xIo::MAX_PATH_LEN];
+	char index[xIo::MAX_PATH_LEN];	// on-disk index file
+	dword time;
+	eFolder* prev;
+	eFolder* result;
+	volatile bool done;
+};
+static eScan scan;
+static eThread scan_thread;
+static bool scanning = false;
+//=============================================================================
+//	eScan::ThumbDone
+//-----------------------------------------------------------------------------
+void eScan::ThumbDone(eThumbJob& j, int thread)
+{
+	thumb_threads[thread].Wait();
+	if(!j.data)
+		return;
+	if(j.ok)
+		memcpy(result->AddThumbnail(j.item), j.thumb, THUMB_SIZE);
+	j.data->Release();
+	j.data = NULL;
+}
+//=============================================================================
+//	eScan::Run
+//-----------------------------------------------------------------------------
+void eScan::Run(void* arg)
+{
+	eScan* s = (eScan*)arg;
+	eFolder* f = new eFolder;
+	f->time = s->time;
+	s->result = f;
+	int hint = 0;
+	int thread = 0;
+	for(xIo::eFileSelect fs(s->path); fs.Valid(); fs.Next())
+	{
+		const char* n = fs.Name();
+		if(fs.IsDir())
+		{
+			if(strcmp(n, ".") && strcmp(n, ".."))
+				f->Item(f->Add(n)).flags = eItem::F_FOLDER;
+			continue;
+		}
+		if(!fs.IsFile() || strlen(s->path) + strlen(n) >= xIo::MAX_PATH_LEN)
+			continue;
+		char name[xIo::MAX_PATH_LEN];
+		strcpy(name, s->path);
+		strcat(name, n);
+		struct stat st;
+		if(stat(name, &st) != 0)
+			continue;
+		int p = s->prev ? s->prev->Find(n, hint) : -1;
+		if(p >= 0 && s->prev->Item(p).size == dword(st.st_size) && s->prev->Item(p).time == dword(st.st_mtime))
+		{
+			hint = p + 1;
+			int i = f->Add(n);
+			eItem& it = f->Item(i);
+			const eItem& old = s->prev->Item(p);
+			it.hash = old.hash;
+			it.size = old.size;
+			it.time = old.time;
+			memcpy(it.type, old.type, sizeof(it.type));
+			if(s->prev->Thumbnail(p))
+				memcpy(f->AddThumbnail(i), s->prev->Thumbnail(p), THUMB_SIZE);
+			continue;
+		}
+		xIo::eFileData* d = xIo::eFileData::Map(name);
+		if(!d)
+			continue;
+		xPlatform::eFileType* t = xPlatform::eFileType::FindByData(d->Data(), d->Size());
+		if(!t)
+			t = xPlatform::eFileType::FindByName(n);
+		if(!t || !t->AbleOpen() || strlen(t->Type()) >= sizeof(eItem().type))
+		{
+			d->Release();
+			continue;
+		}
+		int i = f->Add(n);
+		eItem& it = f->Item(i);
+		it.hash = Hash(d->Data(), d->Size());
+		it.size = st.st_size;
+		it.time = st.st_mtime;
+		strcpy(it.type, t->Type());
+		p = s->prev ? s->prev->Find(it.hash, it.size) : -1;
+		if(p >= 0 && s->prev->Thumbnail(p))
+		{
+			memcpy(f->AddThumbnail(i), s->prev->Thumbnail(p), THUMB_SIZE);
+			d->Release();
+			continue;
+		}
+		if(strcmp(it.type, "sna") && strcmp(it.type, "z80") && strcmp(it.type, "szx")) // only snapshots are run
+		{
+			d->Release();
+			continue;
+		}
+		eThumbJob& j = thumb_jobs[thread];
+		s->ThumbDone(j, thread);
+		j.data = d;
+		j.item = i;
+		strcpy(j.type, it.type);
+		thumb_threads[thread].Start(eThumbJob::Run, &j);
+		thread = (thread + 1) % THUMB_THREADS;
+	}
+	for(int i = 0; i < THUMB_THREADS; ++i)
+	{
+		s->ThumbDone(thumb_jobs[i], i);
+	}
+	f->Save(s->index);
+	ThreadFence();
+	s->done = true;
+}
+
+static eFolder* folder = NULL;
+static char folder_path[xIo::MAX_PATH_LEN];
+
+//=============================================================================
+//	Folder
+//-----------------------------------------------------------------------------
+const eFolder* Folder(const char* path)
+{
+	int l = strlen(path);
+	if(!l || l >= xIo::MAX_PATH_LEN)
+		return NULL;
+	char dir[xIo::MAX_PATH_LEN];
+	strcpy(dir, path);
+	if(l > 1 && (dir[l - 1] == '/' || dir[l - 1] == '\\'))
+		dir[l - 1] = '\0';
+	struct stat st;
+	if(stat(dir, &st) != 0)
+		return NULL;
+	dword time = st.st_mtime;
+	if(scanning && scan.done)
+	{
+		scan_thread.Wait();
+		scanning = false;
+		SAFE_DELETE(scan.prev);
+		SAFE_DELETE(folder);
+		folder = scan.result;
+		strcpy(folder_path, scan.path);
+	}
+	if(folder && folder->time == time && !strcmp(folder_path, path))
+		return folder;
+
+	char index[32];
+	sprintf(index, "library_%016llx.idx", Hash((const byte*)path, l));
+	eFolder* f = new eFolder;
+	if(f->Load(xIo::ProfilePath(index)) && f->time == time)
+	{
+		SAFE_DELETE(folder);
+		folder = f;
+		strcpy(folder_path, path);
+		return folder;
+	}
+	if(scanning)
+	{
+		delete f;
+		return NULL;
+	}
+	for(int i = 0; i < THUMB_THREADS; ++i)
+	{
+		if(!thumb_jobs[i].speccy) // created here, ROMs loading isn't thread safe
+			thumb_jobs[i].speccy = new eSpeccy;
+	}
+	strcpy(scan.path, path);
+	strcpy(scan.index, xIo::ProfilePath(index));
+	scan.time = time;
+	scan.prev = f; // outdated index, unchanged items are reused
+	scan.result = NULL;
+	scan.done = false;
+	scanning = true;
+	scan_thread.Start(eScan::Run, &scan);
+	return NULL;
+}
+//=============================================================================
+//	Done
+//-----------------------------------------------------------------------------
+void Done()
+{
+	if(scanning)
+	{
+		scan_thread.Wait();
+		scanning = false;
+		SAFE_DELETE(scan.prev);
+		SAFE_DELETE(scan.result);
+	}
+	for(int i = 0; i < THUMB_THREADS; ++i)
+	{
+		SAFE_DELETE(thumb_jobs[i].speccy);
+	}
+	SAFE_DELETE(folder);
+}
+
+}
+//namespace xLibrary
+
+#endif//USE_UI
@@ -0,0 +1,95 @@
+/*
+Portable ZX-Spectrum emulator.
+Copyright (C) 2001-2013 SMT, Dexus, Alone Coder, deathsoft, djdron, scor
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef	__LIBRARY_H__
+#define	__LIBRARY_H__
+
+#include "std_types.h"
+#include "ui/ui.h"
+
+#pragma once
+
+#ifdef USE_UI
+
+namespace xLibrary
+{
+
+enum { THUMB_WIDTH = 64, THUMB_HEIGHT = 48, THUMB_SIZE = THUMB_WIDTH*THUMB_HEIGHT/2 };
+
+//*****************************************************************************
+//	eItem
+//	indexed folder entry, images are identified by contents
+//-----------------------------------------------------------------------------
+struct eItem
+{
+	enum eFlag { F_FOLDER = 0x01, F_THUMB = 0x02 };
+	qword	hash;		// contents fingerprint
+	dword	size;
+	dword	time;		// modification time
+	dword	name;		// offset in folder names
+	dword	thumb;		// thumbnail index if F_THUMB set
+	dword	flags;
+	char	type[4];	// detected by contents
+};
+
+//*****************************************************************************
+//	eFolder
+//-----------------------------------------------------------------------------
+class eFolder
+{
+public:
+	eFolder();
+	~eFolder();
+	int Size() const { return size; }
+	const eItem& Item(int i) const { return items[i]; }
+	eItem& Item(int i) { return items[i]; }
+	const char* Name(int i) const { return names + items[i].name; }
+	// 4 bits per pixel (palette index), screen after few frames of snapshot run
+	const byte* Thumbnail(int i) const { return (items[i].flags & eItem::F_THUMB) ? thumbs + items[i].thumb*THUMB_SIZE : NULL; }
+
+	int Find(const char* name, int hint) const;
+	int Find(qword hash, dword size) const;
+	int Add(const char* name);
+	byte* AddThumbnail(int i);
+	bool Load(const char* file);
+	bool Save(const char* file) const;
+
+	dword time; // folder modification time
+protected:
+	int size;
+	int items_alloc;
+	eItem* items;
+	dword names_size;
+	dword names_alloc;
+	char* names;
+	dword thumbs_count;
+	dword thumbs_alloc;
+	byte* thumbs;
+};
+
+// indexed folder (path with trailing slash), NULL if index isn't ready
+// (folder is scanned in background then), valid until next call
+const eFolder* Folder(const char* path);
+void Done();
+
+}
+//namespace xLibrary
+
+#endif//USE_UI
+
+#endif//__LIBRARY_H__
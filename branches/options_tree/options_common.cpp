@@ -28,6 +28,7 @@ OPTION_USING(eOptionBool, op_open_file);
 OPTION_USING(eOptionInt, op_palettes);
 
 OPTION_USING(eOptionInt, op_drive);
+OPTION_USING(eOptionBool, op_fdd_fast);
 OPTION_USING(eOptionBool, op_devices);
 OPTION_USING(eOptionInt, op_sound_chip);
 OPTION_USING(eOptionInt, op_ay_stereo);
@@ -116,6 +117,13 @@ static struct eOptionAutoPlayImage : public xOptions::eOptionBool
 } op_auto_play_image;
 DECLARE_OPTION_ACCESSOR(eOptionBool, op_auto_play_image);
 
+static struct eOptionQuickBoot : public xOptions::eOptionBool
+{
+	eOptionQuickBoot() { Set(true); }
+	virtual const char* Name() const { return "quick boot"; }
+} op_quick_boot;
+DECLARE_OPTION_ACCESSOR(eOptionBool, op_quick_boot);
+
 static struct eOptionQuit : public xOptions::eOptionBool
 {
 	eOptionQuit() { storeable = false; }
@@ -137,6 +145,7 @@ protected:
 		Option(op_load_state);
 		Option(op_save_state);
 		Option(OPTION_GET(op_auto_play_image));
+		Option(op_quick_boot);
 		Option(op_quit);
 	}
 } op_file;
@@ -155,8 +164,10 @@ protected:
 	virtual void OnOption()
 	{
 		Option(OPTION_GET(op_palettes));
+#ifndef USE_BENCHMARK
 		Option(OPTION_GET(op_zoom));
 		Option(OPTION_GET(op_filtering));
+#endif//USE_BENCHMARK
 #ifdef USE_WXWIDGETS
 		Option(OPTION_GET(op_window_size));
 		Option(OPTION_GET(op_full_screen));
@@ -216,6 +227,28 @@ protected:
 	}
 } op_tape;
 
+static struct eOptionReplay : public xOptions::eOptionB
+{
+	eOptionReplay() { storeable = false; }
+	virtual const char* Name() const { return "replay"; }
+	virtual const char* Value() const
+	{
+		int frame = Handler()->ReplayFrame();
+		if(frame < 0)
+			return "n/a";
+		static char value[16];
+		int sec = frame/50;
+		sprintf(value, "%d:%02d", sec/60, sec%60);
+		return value;
+	}
+	virtual void Change(bool next = true)
+	{
+		int frame = Handler()->ReplayFrame();
+		if(frame >= 0)
+			Handler()->OnReplaySeek(frame + (next ? 10*50 : -10*50));
+	}
+} op_replay;
+
 static struct eOptionJoy : public xOptions::eOptionInt
 {
 	eOptionJoy() { Set(J_KEMPSTON); }
@@ -258,12 +291,14 @@ protected:
 		Option(op_reset);
 		Option(op_pause);
 		Option(op_tape);
+		Option(op_replay);
 		Option(op_joy);
 #ifdef USE_OAL
 		Option(OPTION_GET(op_true_speed));
 #endif//USE_OAL
 		Option(OPTION_GET(op_reset_to_service_rom));
 		Option(OPTION_GET(op_drive));
+		Option(OPTION_GET(op_fdd_fast));
 		Option(OPTION_GET(op_sound_chip));
 		Option(OPTION_GET(op_ay_stereo));
 		Option(OPTION_GET(op_devices));
@@ -303,6 +338,28 @@ static struct eOptionVolume : public xOptions::eOptionInt
 } op_volume;
 DECLARE_OPTION_ACCESSOR(eOptionInt, op_volume);
 
+static struct eOptionFrameSlices : public xOptions::eOptionInt
+{
+	eOptionFrameSlices() { Set(FS_1); }
+	virtual const char* Name() const { return "frame slices"; }
+	virtual const char** Values() const
+	{
+		static const char* values[] = { "1", "2", "4", "8", NULL };
+		return values;
+	}
+	virtual void Change(bool next = true)
+	{
+		eOptionInt::Change(FS_LAST, next);
+	}
+} op_frame_slices;
+DECLARE_OPTION_ACCESSOR(eOptionInt, op_frame_slices);
+
+#ifdef USE_SDL
+int OpFrameSlices() { return 1 << op_frame_slices; }
+#else//USE_SDL
+int OpFrameSlices() { return 1; } // frontend loop isn't paced by slices
+#endif//USE_SDL
+
 static struct eOptionSound : public xOptions::eRootOption<xOptions::eOptionB>
 {
 	virtual const char* Name() const { return "sound"; }
@@ -312,6 +369,9 @@ protected:
 	{
 		Option(op_sound_source);
 		Option(op_volume);
+#ifdef USE_SDL
+		Option(op_frame_slices);
+#endif//USE_SDL
 	}
 } op_sound;
 
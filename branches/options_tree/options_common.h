@@ -31,16 +31,20 @@ namespace xPlatform
 enum eJoystick { J_FIRST, J_KEMPSTON = J_FIRST, J_CURSOR, J_QAOP, J_SINCLAIR2, J_LAST };
 enum eSound { S_FIRST, S_BEEPER = S_FIRST, S_AY, S_TAPE, S_LAST };
 enum eVolume { V_FIRST, V_MUTE = V_FIRST, V_10, V_20, V_30, V_40, V_50, V_60, V_70, V_80, V_90, V_100, V_LAST };
+enum eFrameSlices { FS_FIRST, FS_1 = FS_FIRST, FS_2, FS_4, FS_8, FS_LAST };
 
 OPTION_USING(eOptionString, op_last_file);
 const char* OpLastFolder();
 dword OpJoyKeyFlags();
+int OpFrameSlices(); // frame is emulated in parts to get sound earlier
 
 OPTION_USING(eOptionBool, op_load_state);
 OPTION_USING(eOptionBool, op_save_state);
 OPTION_USING(eOptionInt, op_joy);
+OPTION_USING(eOptionInt, op_frame_slices);
 OPTION_USING(eOptionBool, op_tape_fast);
 OPTION_USING(eOptionBool, op_auto_play_image);
+OPTION_USING(eOptionBool, op_quick_boot); // basic booted from cached machine state
 OPTION_USING(eOptionBool, op_filtering);
 OPTION_USING(eOptionInt, op_zoom);
 OPTION_USING(eOptionBool, op_quit);
@@ -34,10 +34,8 @@ void DoneSound()
 static eSoundMixer sound_mixer;
 int UpdateSound(byte* buf)
 {
-	sound_mixer.Update(buf);
-	dword size = sound_mixer.Ready();
-	sound_mixer.Use(size, buf);
-	return size;
+	sound_mixer.Update();
+	return sound_mixer.Read(buf, sound_mixer.Ready());
 }
 
 }
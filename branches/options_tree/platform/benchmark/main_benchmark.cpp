@@ -17,39 +17,240 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "../platform.h"
+#include "../io.h"
 #include "../../tools/tick.h"
+#include "../../tools/sound_mixer.h"
+#include "../../tools/thread.h"
+#include "../../options_common.h"
 
 #ifdef USE_BENCHMARK
 
+#ifdef _LINUX
+#include <unistd.h>
+#endif//_LINUX
+
+OPTION_USING(eOptionBool, op_fdd_fast);
+
+//*****************************************************************************
+//	eNullSink
+//	audio backend replacement, eats mixed sound at fixed rate (frame by frame)
+//	hash allows to compare output between sound engine changes
+//-----------------------------------------------------------------------------
+struct eNullSink
+{
+	enum { SAMPLE_RATE = 44100, FRAME_SIZE = SAMPLE_RATE/50*4, LATENCY_FRAMES = 2 };
+	eNullSink() : resampler(&mixer), hash(2166136261u), started(false) { resampler.Latency(FRAME_SIZE*LATENCY_FRAMES); }
+	void Update()
+	{
+		mixer.Update();
+		if(!started)
+		{
+			started = mixer.Ready() >= FRAME_SIZE*LATENCY_FRAMES;
+			if(!started)
+				return;
+		}
+		resampler.Fill(data, FRAME_SIZE);
+		for(dword i = 0; i < FRAME_SIZE; ++i)
+			hash = (hash ^ data[i]) * 16777619; // FNV-1a
+	}
+	eSoundMixer mixer;
+	eSoundResampler resampler;
+	dword hash;
+	bool started;
+	byte data[FRAME_SIZE];
+};
+
+//*****************************************************************************
+//	eFddWriteImage
+//	builtin "fdd_write" image, trd with basic boot which saves 100 files,
+//	then formats the disk over and over (prompts answered by 'R' key)
+//-----------------------------------------------------------------------------
+struct eFddWriteImage
+{
+	enum { SIZE = 32*256, FILES = 100 };
+	eFddWriteImage() : p(prog)
+	{
+		memset(trd, 0, sizeof(trd));
+		Line(10); Text("\xebi="); Num(1); Text("\xcc"); Num(FILES);	// FOR i=1 TO 100
+		Line(20); Usr(); Text("\xf8\"f\"+\xc1i\xaf" "0,1024");		// SAVE "f"+STR$ i CODE 0,1024
+		Line(30); Text("\xf3i");										// NEXT i
+		Line(40); Usr(); Text("\xd0\"bench\"");						// FORMAT "bench"
+		Line(0);
+		word len = p - prog;
+		*p++ = 0x80; *p++ = 0xaa; *p++ = 10; *p++ = 0; // autostart line
+		byte secs = (p - prog + 255) / 256;
+		byte* dir = trd;
+		memcpy(dir, "boot    B", 9);
+		dir[9] = dir[11] = len & 0xff;
+		dir[10] = dir[12] = len >> 8;
+		dir[13] = secs;
+		dir[14] = 0; dir[15] = 1;			// track 1 sector 0
+		memcpy(trd + 16*256, prog, p - prog);
+		byte* info = trd + 8*256;
+		info[0xe1] = secs; info[0xe2] = 1;	// first free sector
+		info[0xe3] = 0x16;					// 80T,DS
+		info[0xe4] = 1;						// files
+		word free_secs = 2544 - secs;
+		info[0xe5] = free_secs & 0xff; info[0xe6] = free_secs >> 8;
+		info[0xe7] = 0x10;					// trdos flag
+		memcpy(info + 0xf5, "BENCH   ", 8);
+	}
+	void Text(const char* s) { while(*s) *p++ = *s++; }
+	void Num(int v) // text and hidden 5 byte form
+	{
+		char s[8];
+		sprintf(s, "%d", v);
+		Text(s);
+		*p++ = 0x0e; *p++ = 0; *p++ = 0; *p++ = v & 0xff; *p++ = v >> 8; *p++ = 0;
+	}
+	void Usr() { Text("\xf9\xc0"); Num(15619); Text(":\xea:"); } // RANDOMIZE USR 15619: REM:
+	void Line(int n) // close current line and start new one
+	{
+		if(p != prog)
+		{
+			*p++ = 0x0d;
+			int len = p - line - 2;
+			line[0] = len & 0xff; line[1] = len >> 8;
+		}
+		if(!n)
+			return;
+		*p++ = n >> 8; *p++ = n & 0xff;
+		line = p;
+		p += 2;
+	}
+	byte trd[SIZE];
+	byte prog[512];
+	byte* p;
+	byte* line;
+};
+
 int main(int argc, char* argv[])
 {
-	if(argc != 2)
+	if(argc < 2)
 	{
-		printf("Usage : %s image_name\n", argv[0]);
+		printf("Usage : %s image_name [image_name ...]\n", argv[0]);
+		printf("builtin images : fdd_write - TR-DOS 100 files save and FORMAT via WD1793 emulation\n");
+		printf("                 fdd_write_fast - the same with fast disk traps\n");
+#ifdef _LINUX
+		printf("                 rzx_write_error - fdd_write recorded to full disk, error must be reported\n");
+#endif//_LINUX
+		printf("replay from frame : image_name.rzx@frame\n");
 		return 1;
 	}
 	int r = 0;
 	using namespace xPlatform;
 	Handler()->OnInit();
+	Handler()->AudioSampleRate(eNullSink::SAMPLE_RATE);
 	const int benchmark_real_time = 600;
-	if(Handler()->OnOpenFile(argv[1]))
+	bool fdd_fast_option = *OPTION_GET(op_fdd_fast);
+	for(int i = 1; i < argc; ++i)
 	{
-		printf("Emulating %d real sec. (%d frames)...", benchmark_real_time, benchmark_real_time*50);
+		Handler()->OnAction(A_RESET);
+		bool rzx_write_error = !strcmp(argv[i], "rzx_write_error");
+		bool fdd_fast = !strcmp(argv[i], "fdd_write_fast");
+		bool fdd_write = rzx_write_error || fdd_fast || !strcmp(argv[i], "fdd_write");
+		OPTION_GET(op_fdd_fast)->Set(fdd_write ? fdd_fast : fdd_fast_option);
+		char name[xIo::MAX_PATH_LEN];
+		strncpy(name, argv[i], xIo::MAX_PATH_LEN - 1);
+		name[xIo::MAX_PATH_LEN - 1] = '\0';
+		int seek = -1;
+		char* at = strrchr(name, '@');
+		if(at)
+		{
+			*at = '\0';
+			seek = atoi(at + 1);
+		}
+		if(fdd_write)
+		{
+			static eFddWriteImage image;
+			Handler()->OnOpenFile("fdd_write.trd", image.trd, sizeof(image.trd));
+		}
+		else if(!Handler()->OnOpenFile(name))
+		{
+			printf("Error : %s - unsupported image format\n", argv[i]);
+			r = 1;
+			continue;
+		}
+		while(Handler()->OpenProgress() >= 0 && Handler()->OpenProgress() < 100)
+		{
+			ThreadSleep(1); // image is inserted by the first OnLoop()
+		}
+		const char* record_error = NULL;
+		if(rzx_write_error)
+		{
+			// each write to /dev/full fails with ENOSPC, emulation must go on without recording
+			char rzx[xIo::MAX_PATH_LEN];
+			strcpy(rzx, xIo::ProfilePath("rzx_write_error.rzx"));
+			bool ok = false;
+#ifdef _LINUX
+			unlink(rzx);
+			ok = symlink("/dev/full", rzx) == 0;
+#endif//_LINUX
+			if(!ok || !Handler()->OnSaveFile(rzx))
+			{
+				printf("Error : %s - unable to start recording\n", argv[i]);
+				r = 1;
+				continue;
+			}
+		}
+		if(seek >= 0)
+		{
+			eTick tick_seek;
+			tick_seek.SetCurrent();
+			if(!Handler()->OnReplaySeek(seek))
+			{
+				printf("Error : %s - unable to seek replay\n", argv[i]);
+				r = 1;
+				continue;
+			}
+			printf("%s : seek to frame %d of %d done in %g sec.\n", name, Handler()->ReplayFrame(), Handler()->ReplayFrames(), tick_seek.Passed().Sec());
+		}
+		printf("%s : emulating %d real sec. (%d frames)...", argv[i], benchmark_real_time, benchmark_real_time*50);
 		fflush(stdout);
+		eNullSink sink;
+		bool fast_tape = false; // tape loader stats are shown then
 		eTick tick_start;
 		tick_start.SetCurrent();
 		for(int f = benchmark_real_time*50; --f >= 0;)
 		{
-			Handler()->OnLoop();
+			if(fdd_write && f % 50 == 0)
+				Handler()->OnKey('R', KF_DOWN);
+			if(fdd_write && f % 50 == 25)
+				Handler()->OnKey('R', 0);
+			const char* err = Handler()->OnLoop();
+			if(Handler()->FullSpeed())
+				fast_tape = true;
+			if(err && !record_error)
+			{
+				record_error = err;
+				printf("%s at frame %d...", err, benchmark_real_time*50 - f);
+				fflush(stdout);
+			}
+			sink.Update();
 		}
 		float t = tick_start.Passed().Sec();
 		printf("done in %g sec. (%g:1 ratio)\n", t, float(benchmark_real_time)/t);
+		if(rzx_write_error)
+		{
+#ifdef _LINUX
+			unlink(xIo::ProfilePath("rzx_write_error.rzx"));
+#endif//_LINUX
+			if(!record_error)
+			{
+				printf("Error : %s - write error isn't reported\n", argv[i]);
+				r = 1;
+			}
+		}
+		printf("audio hash : %08x, buffered : %u bytes, underruns : %u, overruns : %u, rate adjust : %d/65536\n",
+			sink.hash, sink.mixer.Ready(), sink.mixer.Underruns(), sink.mixer.Overruns(), sink.resampler.Adjust());
+		word pc;
+		dword hits, misses;
+		for(int l = 0; fast_tape && Handler()->TapeLoader(l, &pc, &hits, &misses); ++l)
+		{
+			printf("tape loader at %04x : %u passes skipped, %u emulated\n", pc, hits, misses);
+		}
 	}
-	else
-	{
-		printf("Error : %s - unsupported image format\n", argv[1]);
-		r = 1;
-	}
+	OPTION_GET(op_fdd_fast)->Set(fdd_fast_option);
 	Handler()->OnDone();
 	return r;
 }
@@ -51,18 +51,7 @@ void eAudio::GetData(void* _samples, uint32_t buffer_size)
 	pthread_mutex_lock(&mutex);
 	dword size = samples_count*2*sizeof(int16_t);
 	assert(size <= buffer_size);
-	byte* buf = (byte*)_samples;
-	if(size <= mixer.Ready())
-	{
-		memcpy(buf, mixer.Ptr(), size);
-		mixer.Use(size);
-	}
-	else
-	{
-		memcpy(buf, mixer.Ptr(), mixer.Ready());
-		memset(buf + mixer.Ready(), 0, size - mixer.Ready());
-		mixer.Use(mixer.Ready());
-	}
+	mixer.Fill(_samples, size);
 	pthread_mutex_unlock(&mutex);
 }
 
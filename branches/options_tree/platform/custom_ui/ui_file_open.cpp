@@ -23,6 +23,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "../../tools/io_select.h"
 #include "../platform.h"
 #include "../../options_common.h"
+#include "../../library.h"
 #include <ctype.h>
 
 #ifdef USE_UI
@@ -33,7 +34,7 @@ namespace xUi
 //=============================================================================
 //	eFileOpenDialog::eFileOpenDialog
 //-----------------------------------------------------------------------------
-eFileOpenDialog::eFileOpenDialog(const char* _path) : list(NULL), selected(NULL)
+eFileOpenDialog::eFileOpenDialog(const char* _path) : list(NULL), selected(NULL), lib(NULL), lib_poll(0), info(-1)
 {
 	strcpy(path, _path);
 	memset(folders, 0, sizeof(folders));
@@ -44,11 +45,11 @@ eFileOpenDialog::eFileOpenDialog(const char* _path) : list(NULL), selected(NULL)
 void eFileOpenDialog::Init()
 {
 	background = COLOR_BACKGROUND;
-	eRect r(8, 8, 120, 180);
+	eRect r(8, 8, 120 + xLibrary::THUMB_WIDTH + 12, 180);
 	ePoint margin(6, 6);
 	Bound() = r;
 	list = new eList;
-	list->Bound() = eRect(margin.x, margin.y, r.Width() - margin.x, r.Height() - margin.y);
+	list->Bound() = eRect(margin.x, margin.y, r.Width() - xLibrary::THUMB_WIDTH - 12 - margin.x, r.Height() - margin.y);
 	Insert(list);
 	OnChangePath();
 	int l = strlen(xPlatform::OpLastFolder());
@@ -82,6 +83,9 @@ void eFileOpenDialog::OnChangePath()
 {
 	list->Clear();
 	memset(folders, 0, sizeof(folders));
+	lib = NULL;
+	lib_poll = 0;
+	info = -1;
 
 	int i = 0;
 	if(!xIo::PathIsRoot(path))
@@ -89,27 +93,129 @@ void eFileOpenDialog::OnChangePath()
 		list->Insert("..");
 		folders[i++] = true;
 	}
+	// images inside of archive
+	char archive[xIo::MAX_PATH_LEN];
+	strcpy(archive, path);
+	int l = strlen(archive);
+	if(l)
+	{
+		archive[l - 1] = '\0';
+		if(xPlatform::Handler()->FileArchiveEntry(archive, 0))
+		{
+			const char* e = NULL;
+			for(int n = 0; i < MAX_ITEMS && (e = xPlatform::Handler()->FileArchiveEntry(archive, n)) != NULL; ++n)
+			{
+				list->Insert(e);
+				folders[i++] = false;
+			}
+			return;
+		}
+	}
+	// indexed in background, listed at once when ready
+	lib = xLibrary::Folder(path);
+	if(!lib)
+		lib_poll = LIB_POLL;
 	// put folder first
-	for(xIo::eFileSelect ds(path); i < MAX_ITEMS && ds.Valid(); ds.Next())
+	if(lib)
 	{
-		if(!ds.IsDir())
-			continue;
-		if(!strcmp(ds.Name(), ".") || !strcmp(ds.Name(), ".."))
-			continue;
-		list->Insert(ds.Name());
-		folders[i++] = true;
+		for(int n = 0; i < MAX_ITEMS && n < lib->Size(); ++n)
+		{
+			if(!(lib->Item(n).flags & xLibrary::eItem::F_FOLDER))
+				continue;
+			list->Insert(lib->Name(n));
+			folders[i++] = true;
+		}
+	}
+	else
+	{
+		for(xIo::eFileSelect ds(path); i < MAX_ITEMS && ds.Valid(); ds.Next())
+		{
+			if(!ds.IsDir())
+				continue;
+			if(!strcmp(ds.Name(), ".") || !strcmp(ds.Name(), ".."))
+				continue;
+			list->Insert(ds.Name());
+			folders[i++] = true;
+		}
 	}
 	int folder_count = list->Size();
 	qsort(list->Items(), folder_count, sizeof(const char*), NameCmp);
-	for(xIo::eFileSelect fs(path); i < MAX_ITEMS && fs.Valid(); fs.Next())
+	if(lib)
 	{
-		if(!fs.IsFile() || !xPlatform::Handler()->FileTypeSupported(fs.Name()))
-			continue;
-		list->Insert(fs.Name());
-		folders[i++] = false;
+		for(int n = 0; i < MAX_ITEMS && n < lib->Size(); ++n)
+		{
+			if(lib->Item(n).flags & xLibrary::eItem::F_FOLDER)
+				continue;
+			list->Insert(lib->Name(n));
+			folders[i++] = false;
+		}
+	}
+	else
+	{
+		for(xIo::eFileSelect fs(path); i < MAX_ITEMS && fs.Valid(); fs.Next())
+		{
+			if(!fs.IsFile() || !xPlatform::Handler()->FileTypeSupported(fs.Name()))
+				continue;
+			list->Insert(fs.Name());
+			folders[i++] = false;
+		}
 	}
 	qsort(list->Items() + folder_count, list->Size() - folder_count, sizeof(const char*), NameCmp);
 }
+//=============================================================================
+//	eFileOpenDialog::Update
+//-----------------------------------------------------------------------------
+void eFileOpenDialog::Update()
+{
+	bool redraw = changed;
+	eInherited::Update();
+	if(lib_poll && !--lib_poll)
+	{
+		lib = xLibrary::Folder(path);
+		lib_poll = lib ? 0 : LIB_POLL;
+		redraw = lib != NULL;
+	}
+	if(redraw || info != list->Selected())
+		DrawInfo();
+}
+//=============================================================================
+//	eFileOpenDialog::DrawInfo
+//	thumbnail, type & contents fingerprint of selected image
+//-----------------------------------------------------------------------------
+void eFileOpenDialog::DrawInfo()
+{
+	using namespace xLibrary;
+	info = list->Selected();
+	eRect sr = ScreenBound();
+	eRect r(list->ScreenBound().right + 6, sr.top + 6, sr.right - 6, sr.bottom - 6);
+	DrawRect(r, background);
+	if(!lib || info < 0 || folders[info])
+		return;
+	int i = lib->Find(list->Item(), -1);
+	if(i < 0)
+		return;
+	const byte* t = lib->Thumbnail(i);
+	for(int y = 0; t && y < THUMB_HEIGHT; ++y)
+	{
+		for(int x = 0; x < THUMB_WIDTH; ++x)
+		{
+			byte c = t[(y*THUMB_WIDTH + x)/2];
+			c = (x & 1) ? c & 0x0f : c >> 4;
+			DrawRect(eRect(r.left + x, r.top + y, r.left + x + 1, r.top + y + 1), ePalettedColor(COLOR_ZX + (c & 7)));
+		}
+	}
+	const eItem& it = lib->Item(i);
+	char s[16];
+	sprintf(s, "%.4s", it.type);
+	eRect tr(r.left, r.top + THUMB_HEIGHT + 4, r.right, r.top + THUMB_HEIGHT + 4 + FontSize().y);
+	DrawText(tr, s);
+	sprintf(s, "%08x", dword(it.hash >> 32));
+	tr.Move(ePoint(0, FontSize().y));
+	DrawText(tr, s);
+	sprintf(s, "%08x", dword(it.hash));
+	tr.Move(ePoint(0, FontSize().y));
+	DrawText(tr, s);
+}
 //=============================================================================
 //	GetUpLevel
 //-----------------------------------------------------------------------------
@@ -162,6 +268,12 @@ void eFileOpenDialog::OnNotify(byte n, byte from)
 		return;
 	}
 	strcat(path, list->Item());
+	if(xPlatform::Handler()->FileArchiveEntry(path, 1)) // several images inside, browse them
+	{
+		strcat(path, "/");
+		OnChangePath();
+		return;
+	}
 	selected = path;
 	eInherited::OnNotify(n, id);
 }
@@ -26,6 +26,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #ifdef USE_UI
 
+namespace xLibrary
+{
+class eFolder;
+}
+//namespace xLibrary
+
 namespace xUi
 {
 
@@ -33,20 +39,25 @@ class eList;
 
 class eFileOpenDialog : public eDialog
 {
-	enum { MAX_ITEMS = 2000 };
+	enum { MAX_ITEMS = 2000, LIB_POLL = 25 };
 	typedef eDialog eInherited;
 public:
 	eFileOpenDialog(const char* path);
 	virtual void Init();
+	virtual void Update();
 	const char* Selected() { return selected; }
 protected:
 	void OnNotify(byte n, byte from);
 	void OnChangePath();
+	void DrawInfo();
 protected:
 	char path[xIo::MAX_PATH_LEN];
 	eList* list;
 	bool folders[MAX_ITEMS];
 	const char* selected;
+	const xLibrary::eFolder* lib;	// folder index, thumbnails & fingerprints of images
+	int lib_poll;					// updates till next index query (folder is indexed in background)
+	int info;						// list item shown in info area
 };
 
 }
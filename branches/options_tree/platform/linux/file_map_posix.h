@@ -0,0 +1,83 @@
+/*
+Portable ZX-Spectrum emulator.
+Copyright (C) 2001-2013 SMT, Dexus, Alone Coder, deathsoft, djdron, scor
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef	__FILE_MAP_POSIX_H__
+#define	__FILE_MAP_POSIX_H__
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#pragma once
+
+namespace xIo
+{
+
+//*****************************************************************************
+//	eFileMapPosix
+//	read only file mapped in memory, pages are loaded on first access
+//-----------------------------------------------------------------------------
+class eFileMapPosix
+{
+public:
+	eFileMapPosix() : data(NULL), data_size(0) {}
+	~eFileMapPosix() { Close(); }
+	bool Open(const char* name)
+	{
+		Close();
+		int fd = open(name, O_RDONLY);
+		if(fd < 0)
+			return false;
+		struct stat st;
+		bool ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+		if(ok && st.st_size)
+		{
+			void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			ok = p != MAP_FAILED;
+			if(ok)
+			{
+				data = (const byte*)p;
+				data_size = st.st_size;
+			}
+		}
+		close(fd);
+		return ok;
+	}
+	void Close()
+	{
+		if(data)
+			munmap((void*)data, data_size);
+		data = NULL;
+		data_size = 0;
+	}
+	const byte* Data() const { return data; }
+	size_t Size() const { return data_size; }
+protected:
+	const byte* data;
+	size_t data_size;
+};
+
+typedef eFileMapPosix eFileMap;
+
+}
+//namespace xIo
+
+#define FILE_MAP_DECLARED
+
+#endif//__FILE_MAP_POSIX_H__
@@ -0,0 +1,136 @@
+/*
+Portable ZX-Spectrum emulator.
+Copyright (C) 2001-2013 SMT, Dexus, Alone Coder, deathsoft, djdron, scor
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef	__THREAD_POSIX_H__
+#define	__THREAD_POSIX_H__
+
+#include <pthread.h>
+#include <unistd.h>
+
+#pragma once
+
+//*****************************************************************************
+//	eThreadPosix
+//	worker thread running one job at a time, Start() waits for previous job completion
+//-----------------------------------------------------------------------------
+class eThreadPosix
+{
+public:
+	typedef void (*eProc)(void* arg);
+	eThreadPosix() : created(false), busy(false), quit(false), proc(NULL), arg(NULL)
+	{
+		pthread_mutex_init(&mutex, NULL);
+		pthread_cond_init(&cond, NULL);
+	}
+	~eThreadPosix()
+	{
+		if(created)
+		{
+			pthread_mutex_lock(&mutex);
+			while(busy)
+				pthread_cond_wait(&cond, &mutex);
+			quit = true;
+			pthread_cond_broadcast(&cond);
+			pthread_mutex_unlock(&mutex);
+			pthread_join(thread, NULL);
+		}
+		pthread_cond_destroy(&cond);
+		pthread_mutex_destroy(&mutex);
+	}
+	// returns false if job was done in place (no thread available)
+	bool	Start(eProc _proc, void* _arg)
+	{
+		Wait();
+		if(!created)
+			created = pthread_create(&thread, NULL, Entry, this) == 0;
+		if(!created)
+		{
+			_proc(_arg);
+			return false;
+		}
+		pthread_mutex_lock(&mutex);
+		proc = _proc;
+		arg = _arg;
+		busy = true;
+		pthread_cond_broadcast(&cond);
+		pthread_mutex_unlock(&mutex);
+		return true;
+	}
+	void	Wait()
+	{
+		if(!created)
+			return;
+		pthread_mutex_lock(&mutex);
+		while(busy)
+			pthread_cond_wait(&cond, &mutex);
+		pthread_mutex_unlock(&mutex);
+	}
+
+protected:
+	static void* Entry(void* param)
+	{
+		eThreadPosix* t = (eThreadPosix*)param;
+		pthread_mutex_lock(&t->mutex);
+		for(;;)
+		{
+			while(!t->busy && !t->quit)
+				pthread_cond_wait(&t->cond, &t->mutex);
+			if(t->quit)
+				break;
+			pthread_mutex_unlock(&t->mutex);
+			t->proc(t->arg);
+			pthread_mutex_lock(&t->mutex);
+			t->busy = false;
+			pthread_cond_broadcast(&t->cond);
+		}
+		pthread_mutex_unlock(&t->mutex);
+		return NULL;
+	}
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool created;
+	bool busy;
+	bool quit;
+	eProc proc;
+	void* arg;
+};
+
+//*****************************************************************************
+//	eMutexPosix
+//-----------------------------------------------------------------------------
+class eMutexPosix
+{
+public:
+	eMutexPosix() { pthread_mutex_init(&mutex, NULL); }
+	~eMutexPosix() { pthread_mutex_destroy(&mutex); }
+	void	Lock() { pthread_mutex_lock(&mutex); }
+	void	Unlock() { pthread_mutex_unlock(&mutex); }
+protected:
+	pthread_mutex_t mutex;
+};
+
+// full memory barrier for lock-free data exchange between threads
+inline void ThreadFence() { __sync_synchronize(); }
+inline void ThreadSleep(dword ms) { usleep(ms*1000); }
+
+#define THREAD_DECLARED
+typedef eThreadPosix eThread;
+typedef eMutexPosix eMutex;
+
+#endif//__THREAD_POSIX_H__
@@ -33,108 +33,124 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "../../tools/options.h"
 #include "../../tools/sound_mixer.h"
+#include "../../tools/thread.h"
 
 namespace xPlatform
 {
 
-void DoneSound();
-void InitSound();
-
 static struct eOptionTrueSpeed : public xOptions::eOptionBool
 {
 	eOptionTrueSpeed() { Set(true); }
 	virtual const char* Name() const { return "true speed"; }
-protected:
-	virtual void OnOption()
-	{
-		if(changed)
-		{
-			DoneSound();
-			InitSound();
-		}
-	}
 } op_true_speed;
 DECLARE_OPTION_ACCESSOR(eOptionBool, op_true_speed);
 
+// sound devices render directly at this rate
+static const dword sample_rate = 48000;
+
+//*****************************************************************************
+//	eSource
+//	mixer is filled by emulation, small OpenAL buffers are refilled from it
+//	by stream thread (or from main loop if threads unavailable)
+//-----------------------------------------------------------------------------
 struct eSource
 {
-	void Clear()
-	{
-		source = 0;
-		free_buf = 0;
-		first_fill = true;
-		memset(buffers, 0, sizeof(buffers));
-	}
+	eSource() : source(0), streaming(false), threaded(false), resampler(&mixer) { memset(buffers, 0, sizeof(buffers)); }
 	void Init()
 	{
-		Clear();
+		resampler.Latency(sample_rate*2*2/50*LATENCY_FRAMES);
 		alGetError();
 		alGenBuffers(BUFFER_COUNT, buffers);
 		alGetError();
 		alGenSources(1, &source);
+		for(int i = 0; i < BUFFER_COUNT; ++i)
+		{
+			Queue(buffers[i]);
+		}
+		alSourcePlay(source);
+		streaming = true;
+		threaded = thread.Start(Nop, NULL); // check that stream thread can be created
+		if(threaded)
+			thread.Start(StreamProc, this);
 	}
 	void Done()
 	{
+		streaming = false;
+		thread.Wait();
+		threaded = false;
 		alSourceStop(source);
 		alDeleteSources(1, &source);
 		alDeleteBuffers(BUFFER_COUNT, buffers);
-		Clear();
+		source = 0;
+		memset(buffers, 0, sizeof(buffers));
 	}
-	enum eUpdateResult { U_OK, U_SKIP, U_MUCH, U_LESS  };
-	eUpdateResult Update();
-	enum { BUFFER_COUNT = 4 };
+	bool Update();
+	void Stream();
+	void Queue(ALuint buf);
+	static void StreamProc(void* arg);
+	static void Nop(void* arg) {}
+
+	enum { BUFFER_COUNT = 3, BUFFER_SAMPLES = 256, STREAM_SLEEP_MS = 2 };
+	enum { LATENCY_FRAMES = 2 }; // mixed data ahead of OpenAL queue, kept by resampler
 	ALuint buffers[BUFFER_COUNT];
 	ALuint source;
-	ALuint free_buf;
-	bool first_fill;
+	volatile bool streaming;
+	bool threaded;
+	eThread thread;
 	eSoundMixer mixer;
+	eSoundResampler resampler;
+	byte data[BUFFER_SAMPLES*4];
 };
-eSource::eUpdateResult eSource::Update()
+//=============================================================================
+//	eSource::Update
+//	emulation side, returns true if resampler can't keep up with emulation
+//-----------------------------------------------------------------------------
+bool eSource::Update()
 {
 	mixer.Update();
-	const float fps = op_true_speed ? 50.0f : 60.0f;
-	const float fps_org = 50.0f;
-	dword frame_data = 44100*2*2/fps_org;
-	dword data_ready = mixer.Ready();
-	if(data_ready < frame_data*2)
-		return U_LESS;
-
-	bool next_buf = first_fill;
-	if(!next_buf)
-	{
-		ALint buffers_processed = 0;
-		alGetSourcei(source, AL_BUFFERS_PROCESSED, &buffers_processed);
-		if(buffers_processed)
-		{
-			ALuint buf = 0;
-			alSourceUnqueueBuffers(source, 1, &buf);
-			assert(buf == buffers[free_buf]);
-			next_buf = true;
-		}
-	}
-	if(next_buf)
+	if(!threaded)
+		Stream();
+	return mixer.Ready() > sample_rate*2*2/50*LATENCY_FRAMES*2;
+}
+//=============================================================================
+//	eSource::Queue
+//-----------------------------------------------------------------------------
+void eSource::Queue(ALuint buf)
+{
+	resampler.Fill(data, sizeof(data));
+	alBufferData(buf, AL_FORMAT_STEREO16, data, sizeof(data), sample_rate);
+	alSourceQueueBuffers(source, 1, &buf);
+}
+//=============================================================================
+//	eSource::Stream
+//	audio side, refills processed buffers
+//-----------------------------------------------------------------------------
+void eSource::Stream()
+{
+	ALint buffers_processed = 0;
+	alGetSourcei(source, AL_BUFFERS_PROCESSED, &buffers_processed);
+	while(--buffers_processed >= 0)
 	{
-		alBufferData(buffers[free_buf], AL_FORMAT_STEREO16, mixer.Ptr(), data_ready, 44100*fps/fps_org);
-		mixer.Use(data_ready);
-		alSourceQueueBuffers(source, 1, &buffers[free_buf]);
-		if(++free_buf == BUFFER_COUNT)
-		{
-			free_buf = 0;
-			first_fill = false;
-		}
+		ALuint buf = 0;
+		alSourceUnqueueBuffers(source, 1, &buf);
+		Queue(buf);
 	}
 	ALint state = 0;
 	alGetSourcei(source, AL_SOURCE_STATE, &state);
 	if(state != AL_PLAYING)
+		alSourcePlay(source); // all buffers were played out
+}
+//=============================================================================
+//	eSource::StreamProc
+//-----------------------------------------------------------------------------
+void eSource::StreamProc(void* arg)
+{
+	eSource* s = (eSource*)arg;
+	while(s->streaming)
 	{
-		ALint queued_buffers = 0;
-		alGetSourcei(source, AL_BUFFERS_QUEUED, &queued_buffers);
-		if(queued_buffers)
-		{
-			alSourcePlay(source);
-		}
+		s->Stream();
+		ThreadSleep(STREAM_SLEEP_MS);
 	}
-	return next_buf ? U_OK : (data_ready > frame_data*3 ? U_MUCH : U_SKIP);
 }
 
 static eSource source_mixed;
@@ -152,6 +168,7 @@ void InitSound()
 	alcMakeContextCurrent(context);
 	alcProcessContext(context);
 	source_mixed.Init();
+	Handler()->AudioSampleRate(sample_rate);
 }
 
 void DoneSound()
@@ -178,7 +195,7 @@ void OnLoopSound()
 	if(!device || !context)
 		return;
 	static bool video_paused = false;
-	bool video_paused_new = source_mixed.Update() == eSource::U_MUCH;
+	bool video_paused_new = source_mixed.Update();
 	if(video_paused_new != video_paused)
 	{
 		video_paused = video_paused_new;
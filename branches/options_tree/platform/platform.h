@@ -63,12 +63,13 @@ enum eKeyFlags
 enum eMouseAction { MA_MOVE, MA_BUTTON, MA_WHEEL };
 enum eAction
 {
-	A_RESET, A_TAPE_TOGGLE, A_TAPE_QUERY
+	A_RESET, A_TAPE_TOGGLE, A_TAPE_QUERY, A_OPEN_QUERY
 };
 enum eActionResult
 {
 	AR_OK,
 	AR_TAPE_STARTED, AR_TAPE_STOPPED, AR_TAPE_NOT_INSERTED,
+	AR_OPEN_LOADING, AR_OPEN_DONE, AR_OPEN_FAILED,
 	AR_ERROR = -1
 };
 
@@ -86,7 +87,12 @@ struct eHandler
 	virtual bool OnOpenFile(const char* name, const void* data = NULL, size_t data_size = 0) = 0;
 	virtual bool OnSaveFile(const char* name) = 0;
 	virtual bool FileTypeSupported(const char* name) = 0;
+	// images inside of archive, opened as "name/entry", NULL if index is out of range
+	virtual const char* FileArchiveEntry(const char* name, int index) = 0;
 	virtual eActionResult OnAction(eAction action) = 0;
+	// tapes & disks are opened in background (OnOpenFile() returns true if started),
+	// percents done or -1 if nothing is being opened, see A_OPEN_QUERY for result
+	virtual int OpenProgress() const = 0;
 
 	// data to draw
 	virtual void* VideoData() = 0;
@@ -94,13 +100,23 @@ struct eHandler
 	// pause/resume function for sync video by audio
 	virtual void VideoPaused(bool paused) = 0;
 	virtual void VideoFrameRate(int v) = 0;
+	// frame is emulated in slices, video data is complete between frames only
+	virtual bool InsideFrame() const = 0;
 	// audio
+	virtual void AudioSampleRate(dword v) = 0;
 	virtual int	AudioSources() = 0;
 	virtual void* AudioData(int source) = 0;
 	virtual dword AudioDataReady(int source) = 0;
 	virtual void AudioDataUse(int source, dword size) = 0;
 
 	virtual bool FullSpeed() const = 0;
+	// fast tape loader loops: address, loop passes skipped & emulated, false if index is out of range
+	virtual bool TapeLoader(int index, word* pc, dword* hits, dword* misses) const = 0;
+
+	// .rzx replay position in frames, -1 if no replay active
+	virtual int ReplayFrame() const = 0;
+	virtual int ReplayFrames() const = 0;
+	virtual bool OnReplaySeek(int frame) = 0;
 };
 
 eHandler* Handler();
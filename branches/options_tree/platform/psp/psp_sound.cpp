@@ -67,17 +67,7 @@ static void AudioCallback(void* buf, unsigned int length, void* userdata)
 {
 	eAutoMutex lock(sound_mutex);
 	length *= 4; // translate samples to bytes
-	if(length <= sound_mixer.Ready())
-	{
-		memcpy(buf, sound_mixer.Ptr(), length);
-		sound_mixer.Use(length);
-	}
-	else
-	{
-		memcpy(buf, sound_mixer.Ptr(), sound_mixer.Ready());
-		memset((byte*)buf + sound_mixer.Ready(), 0, length - sound_mixer.Ready());
-		sound_mixer.Use(sound_mixer.Ready());
-	}
+	sound_mixer.Fill(buf, length);
 }
 
 void InitAudio()
@@ -60,7 +60,7 @@ enum { BUF_WIDTH = 512, SCR_WIDTH = 480, SCR_HEIGHT = 272 };
 
 static dword __attribute__((aligned(16))) gu_direct[262144];
 static word  __attribute__((aligned(16))) clut[16];
-static dword __attribute__((aligned(16))) clut_ui[8];
+static dword __attribute__((aligned(16))) clut_ui[16];
 static byte* buffer = NULL; // allocated in vram
 static byte* buffer_ui = NULL;
 
@@ -226,7 +226,7 @@ void UpdateScreen()
 
 		PROFILER_BEGIN(u_vid2);
 		sceGuClutMode(GU_PSM_8888, 0, 0x0f, 0);
-		sceGuClutLoad(1, clut_ui);
+		sceGuClutLoad((xUi::PALETTE_SIZE + 7)/8, clut_ui); // blocks of 8 entries
 		sceGuTexMode(GU_PSM_T8, 0, 0, GU_TRUE);
 		sceGuTexFunc(GU_TFX_REPLACE, GU_TCC_RGBA);
 		sceGuTexImage(0, 512, 256, 512, buffer_ui);
@@ -120,9 +120,10 @@ static void Loop()
 			}
 		}
 		Handler()->OnLoop();
-		UpdateScreen();
+		if(!Handler()->InsideFrame())
+			UpdateScreen();
 		UpdateAudio();
-		while(last_tick.Passed().Ms() < 15)
+		while(last_tick.Passed().Ms() < 15/OpFrameSlices())
 		{
 			SDL_Delay(3);
 		}
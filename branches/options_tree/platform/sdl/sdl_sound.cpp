@@ -29,20 +29,15 @@ namespace xPlatform
 {
 
 static eSoundMixer sound_mixer;
+static eSoundResampler sound_resampler(&sound_mixer);
+static dword sample_rate = 44100;
+static volatile dword latency = sample_rate*2*2/50*2; // 2-frame data (or 2 frame slices)
 
 static void AudioCallback(void* userdata, Uint8* stream, int len)
 {
-	if((dword)len <= sound_mixer.Ready())
-	{
-		memcpy(stream, sound_mixer.Ptr(), len);
-		sound_mixer.Use(len);
-	}
-	else
-	{
-		memcpy(stream, sound_mixer.Ptr(), sound_mixer.Ready());
-		memset(stream + sound_mixer.Ready(), 0, len - sound_mixer.Ready());
-		sound_mixer.Use(sound_mixer.Ready());
-	}
+	// resampler is used by audio thread only, emulation thread just publishes latency
+	sound_resampler.Latency(latency);
+	sound_resampler.Fill(stream, len);
 }
 
 bool InitAudio()
@@ -59,7 +54,7 @@ bool InitAudio()
 
 	SDL_AudioSpec audio;
 	memset(&audio, 0, sizeof(audio));
-	audio.freq = 44100;
+	audio.freq = sample_rate;
 	audio.channels = 2;
 	audio.format = AUDIO_S16SYS;
 #ifndef SDL_AUDIO_SAMPLES
@@ -67,8 +62,10 @@ bool InitAudio()
 #endif//SDL_AUDIO_SAMPLES
 	audio.samples = SDL_AUDIO_SAMPLES;
 	audio.callback = AudioCallback;
+	sound_resampler.Latency(latency);
 	if(SDL_OpenAudio(&audio, NULL) < 0)
 		return false;
+	Handler()->AudioSampleRate(sample_rate);
 	SDL_PauseAudio(0);
 	return true;
 }
@@ -79,16 +76,16 @@ void DoneAudio()
 
 void UpdateAudio()
 {
-	SDL_LockAudio();
-	sound_mixer.Update();
+	sound_mixer.Update(); // audio callback reads mixer without locking
+	latency = sample_rate*2*2/50*2/OpFrameSlices();
 	static bool audio_filled = false;
-	bool audio_filled_new = sound_mixer.Ready() > 44100*2*2/50*7; // 7-frame data
+	// resampler keeps latency by itself, stop emulation only if it can't catch up
+	bool audio_filled_new = sound_mixer.Ready() > latency*2;
 	if(audio_filled != audio_filled_new)
 	{
 		audio_filled = audio_filled_new;
 		Handler()->VideoPaused(audio_filled);
 	}
-	SDL_UnlockAudio();
 }
 
 }
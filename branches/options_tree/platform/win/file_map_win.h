@@ -0,0 +1,83 @@
+/*
+Portable ZX-Spectrum emulator.
+Copyright (C) 2001-2013 SMT, Dexus, Alone Coder, deathsoft, djdron, scor
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef	__FILE_MAP_WIN_H__
+#define	__FILE_MAP_WIN_H__
+
+#include <windows.h>
+
+#pragma once
+
+namespace xIo
+{
+
+//*****************************************************************************
+//	eFileMapWin
+//	read only file mapped in memory, pages are loaded on first access
+//-----------------------------------------------------------------------------
+class eFileMapWin
+{
+public:
+	eFileMapWin() : data(NULL), data_size(0) {}
+	~eFileMapWin() { Close(); }
+	bool Open(const char* name)
+	{
+		Close();
+		HANDLE file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if(file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		bool ok = GetFileSizeEx(file, &size) != 0;
+		if(ok && size.QuadPart)
+		{
+			HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			ok = mapping != NULL;
+			if(ok)
+			{
+				data = (const byte*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				ok = data != NULL;
+				if(ok)
+					data_size = (size_t)size.QuadPart;
+				CloseHandle(mapping); // view keeps mapping alive
+			}
+		}
+		CloseHandle(file);
+		return ok;
+	}
+	void Close()
+	{
+		if(data)
+			UnmapViewOfFile(data);
+		data = NULL;
+		data_size = 0;
+	}
+	const byte* Data() const { return data; }
+	size_t Size() const { return data_size; }
+protected:
+	const byte* data;
+	size_t data_size;
+};
+
+typedef eFileMapWin eFileMap;
+
+}
+//namespace xIo
+
+#define FILE_MAP_DECLARED
+
+#endif//__FILE_MAP_WIN_H__
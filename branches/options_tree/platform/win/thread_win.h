@@ -0,0 +1,121 @@
+/*
+Portable ZX-Spectrum emulator.
+Copyright (C) 2001-2013 SMT, Dexus, Alone Coder, deathsoft, djdron, scor
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef	__THREAD_WIN_H__
+#define	__THREAD_WIN_H__
+
+#include <windows.h>
+
+#pragma once
+
+//*****************************************************************************
+//	eThreadWin
+//	worker thread running one job at a time, Start() waits for previous job completion
+//-----------------------------------------------------------------------------
+class eThreadWin
+{
+public:
+	typedef void (*eProc)(void* arg);
+	eThreadWin() : thread(NULL), job(NULL), done(NULL), busy(false), quit(false), proc(NULL), arg(NULL) {}
+	~eThreadWin()
+	{
+		if(!thread)
+			return;
+		Wait();
+		quit = true;
+		SetEvent(job);
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+		CloseHandle(job);
+		CloseHandle(done);
+	}
+	// returns false if job was done in place (no thread available)
+	bool	Start(eProc _proc, void* _arg)
+	{
+		Wait();
+		if(!thread)
+		{
+			job = CreateEvent(NULL, FALSE, FALSE, NULL);
+			done = CreateEvent(NULL, FALSE, FALSE, NULL);
+			thread = CreateThread(NULL, 0, Entry, this, 0, NULL);
+		}
+		if(!thread)
+		{
+			_proc(_arg);
+			return false;
+		}
+		proc = _proc;
+		arg = _arg;
+		busy = true;
+		SetEvent(job);
+		return true;
+	}
+	void	Wait()
+	{
+		if(!busy)
+			return;
+		WaitForSingleObject(done, INFINITE);
+		busy = false;
+	}
+
+protected:
+	static DWORD WINAPI Entry(LPVOID param)
+	{
+		eThreadWin* t = (eThreadWin*)param;
+		for(;;)
+		{
+			WaitForSingleObject(t->job, INFINITE);
+			if(t->quit)
+				break;
+			t->proc(t->arg);
+			SetEvent(t->done);
+		}
+		return 0;
+	}
+	HANDLE thread;
+	HANDLE job;
+	HANDLE done;
+	bool busy; // owner thread only
+	volatile bool quit;
+	eProc proc;
+	void* arg;
+};
+
+//*****************************************************************************
+//	eMutexWin
+//-----------------------------------------------------------------------------
+class eMutexWin
+{
+public:
+	eMutexWin() { InitializeCriticalSection(&cs); }
+	~eMutexWin() { DeleteCriticalSection(&cs); }
+	void	Lock() { EnterCriticalSection(&cs); }
+	void	Unlock() { LeaveCriticalSection(&cs); }
+protected:
+	CRITICAL_SECTION cs;
+};
+
+// full memory barrier for lock-free data exchange between threads
+inline void ThreadFence() { MemoryBarrier(); }
+inline void ThreadSleep(dword ms) { Sleep(ms); }
+
+#define THREAD_DECLARED
+typedef eThreadWin eThread;
+typedef eMutexWin eMutex;
+
+#endif//__THREAD_WIN_H__
@@ -137,7 +137,17 @@ void GLCanvas::OnIdle(wxIdleEvent& event)
 		GetParent()->Close(true);
 		return;
 	}
+	bool opening = Handler()->OnAction(A_OPEN_QUERY) == AR_OPEN_LOADING;
 	const char* err = Handler()->OnLoop();
+	if(!err && opening)
+	{
+		switch(Handler()->OnAction(A_OPEN_QUERY))
+		{
+		case AR_OPEN_DONE:		err = "open_done";		break;
+		case AR_OPEN_FAILED:	err = "open_failed";	break;
+		default: break;
+		}
+	}
 	if(err)
 	{
 		wxCommandEvent ev(evtSetStatusText);
@@ -397,12 +397,12 @@ void Frame::OnOpenFile(wxCommandEvent& event)
 {
 	wxFileDialog fd(this, wxFileSelectorPromptStr, wxConvertMB2WX(OpLastFolder()));
 	fd.SetWildcard(
-			L"Supported files|*.sna;*.z80;*.szx;*.rzx;*.trd;*.scl;*.fdi;*.tap;*.csw;*.tzx;*.zip;"
-							L"*.SNA;*.Z80;*.SZX;*.RZX;*.TRD;*.SCL;*.FDI;*.TAP;*.CSW;*.TZX;*.ZIP|"
+			L"Supported files|*.sna;*.z80;*.szx;*.rzx;*.trd;*.scl;*.fdi;*.udi;*.tap;*.csw;*.tzx;*.zip;"
+							L"*.SNA;*.Z80;*.SZX;*.RZX;*.TRD;*.SCL;*.FDI;*.UDI;*.TAP;*.CSW;*.TZX;*.ZIP|"
 			L"All files|*.*|"
 			L"Snapshot files (*.sna;*.z80;*.szx)|*.sna;*.z80;*.szx;*.SNA;*.Z80;*.SZX|"
 			L"Replay files (*.rzx)|*.rzx;*.RZX|"
-			L"Disk images (*.trd;*.scl;*.fdi)|*.trd;*.scl;*.fdi;*.TRD;*.SCL;*.FDI|"
+			L"Disk images (*.trd;*.scl;*.fdi;*.udi)|*.trd;*.scl;*.fdi;*.udi;*.TRD;*.SCL;*.FDI;*.UDI|"
 			L"Tape files (*.tap;*.csw;*.tzx)|*.tap;*.csw;*.tzx;*.TAP;*.CSW;*.TZX|"
 			L"ZIP archives (*.zip)|*.zip;*.ZIP"
 		);
@@ -410,7 +410,10 @@ void Frame::OnOpenFile(wxCommandEvent& event)
 	{
 		if(Handler()->OnOpenFile(wxConvertWX2MB(fd.GetPath().c_str())))
 		{
-			SetStatusText(_("File open OK"));
+			if(Handler()->OnAction(A_OPEN_QUERY) == AR_OPEN_LOADING)
+				SetStatusText(_("File opening..."));
+			else
+				SetStatusText(_("File open OK"));
 			menu_quick_save->Enable(true);
 		}
 		else
@@ -633,6 +636,12 @@ void Frame::OnSetStatusText(wxCommandEvent& event)
 		SetStatusText(_("RZX error - invalid data"));
 	else if(event.GetString() == L"rzx_unsupported")
 		SetStatusText(_("RZX error - unsupported format"));
+	else if(event.GetString() == L"open_done")
+		SetStatusText(_("File open OK"));
+	else if(event.GetString() == L"open_failed")
+		SetStatusText(_("File open FAILED"));
+	else if(event.GetString() == L"fdd_write_failed")
+		SetStatusText(_("Disk write back FAILED, will retry"));
 }
 //=============================================================================
 //	Frame::OnQuickLoad
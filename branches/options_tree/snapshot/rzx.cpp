@@ -41,6 +41,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "../platform/io.h"
 #include "../tools/stream_memory.h"
 #include "../options_common.h"
+#include "../tools/thread.h"
+#include "../tools/file_data.h"
+#include "snapshot.h"
 #include "rzx.h"
 
 #ifdef USE_ZIP
@@ -55,30 +58,34 @@ public:
 #ifdef USE_ZIP
 		,zbuf(NULL)
 #endif//USE_ZIP
+		, frame(0), frames(0), scanning(false), pos_count(0), pos_step(POS_STEP), key_count(0), key_step(KEY_STEP)
 	{}
 	~eImpl() { Close(); }
-	eError Open(const void* data, size_t data_size, eHandler* handler);
+	eError Open(xIo::eFileData* data, eHandler* handler);
 	eError Update(int* icount);
 	eError IoRead(byte* data);
 	eError CheckSync() const { return INcount == INmax ? E_OK : E_SYNC_LOST; }
+	eError Seek(int frame);
+	int Frame() const { return frame; }
+	int Frames() const { return frames; }
 
 private:
 	class eStream : public xIo::eStreamMemory
 	{
 	public:
-		eStream(const void* _data, size_t _data_size) : xIo::eStreamMemory(_data, _data_size)
+		eStream(xIo::eFileData* _file_data) : xIo::eStreamMemory(_file_data->Data(), _file_data->Size()), file_data(_file_data)
 		{
-			// we need copy of the data
-			byte* d = new byte[data_size];
-			memcpy(d, _data, data_size);
-			data = d;
+			// keep mapped data alive while replaying
+			file_data->AddRef();
 			Open();
 		}
 		~eStream()
 		{
 			Close();
-			SAFE_DELETE_ARRAY(data);
+			file_data->Release();
 		}
+	protected:
+		xIo::eFileData* file_data;
 	};
 	enum eBlockId
 	{
@@ -127,7 +134,62 @@ private:
 	int ZipClose();
 #endif//USE_ZIP
 	eError ReadBlock();
+	eError ReadFrame(int* icount);
 	void Close();
+
+	int frame;		// frames replayed
+	int frames;		// total frames in recording
+	bool scanning;	// snapshot blocks skipped
+
+	// stream index built on open, state to continue reading from frame
+	enum { POS_MAX = 128, POS_STEP = 3000 };
+	struct ePos
+	{
+		int frame;
+		long block_start;
+		dword block_length;
+		byte status;
+		dword framecount;
+		long file_pos; // not consumed zip input read again
+#ifdef USE_ZIP
+		z_stream* zs;
+#endif//USE_ZIP
+		word INmax;
+		byte* inputs;
+	};
+	ePos pos[POS_MAX];
+	int pos_count;
+	int pos_step;
+	void AddPos();
+	void RestorePos(const ePos& p);
+	void FreePos(ePos& p);
+
+	// machine keyframes stored while replaying, key_step frames apart at least
+	enum { KEY_MAX = 128, KEY_STEP = 250 };
+	struct eKey
+	{
+		int frame;
+		byte* data;
+		size_t size;
+	};
+	eKey keys[KEY_MAX];
+	int key_count;
+	int key_step;
+	void AddKey();
+	// keyframe captured by emulation thread, szx encoded by key thread
+	struct eKeyJob
+	{
+		eKeyJob() : state(NULL), data(NULL), size(0), frame(-1), busy(false) {}
+		xSnapshot::eState* state;
+		byte*	data;	// MAX_SIZE, allocated once
+		size_t	size;
+		int		frame;	// -1 - no keyframe in progress
+		volatile bool busy;
+	};
+	eKeyJob key_job;
+	eThread key_thread;
+	static void EncodeKey(void* job);
+	void CollectKey(bool wait);
 };
 
 
@@ -192,6 +254,8 @@ eRZX::eError eRZX::eImpl::ReadBlock()
 		switch(block.type)
 		{
 		case RZXBLK_SNAP:
+			if(scanning)
+				break;
 			{
 				file->Read(block.buff, 12);
 				char snap_filename[xIo::MAX_PATH_LEN];
@@ -285,10 +349,10 @@ eRZX::eError eRZX::eImpl::ReadBlock()
 }
 
 
-eRZX::eError eRZX::eImpl::Open(const void* _data, size_t _data_size, eHandler* _handler)
+eRZX::eError eRZX::eImpl::Open(xIo::eFileData* _data, eHandler* _handler)
 {
 	assert(!file);
-	file = new eStream(_data, _data_size);
+	file = new eStream(_data);
 	handler = _handler;
 	if(!handler)
 		return E_INVALID;
@@ -316,9 +380,176 @@ eRZX::eError eRZX::eImpl::Open(const void* _data, size_t _data_size, eHandler* _
 	}
 	INcount = 0;
 	INold = 0xFFFF;
+	// build stream index
+	scanning = true;
+	for(;;)
+	{
+		if(frame % pos_step == 0)
+			AddPos();
+		int icount = 0;
+		if(ReadFrame(&icount) != E_OK)
+			break;
+	}
+	scanning = false;
+	frames = frame;
+	RestorePos(pos[0]);
 	return E_OK;
 }
 
+void eRZX::eImpl::AddPos()
+{
+	if(pos_count == POS_MAX)
+	{
+		for(int i = 1; i < POS_MAX; i += 2)
+		{
+			FreePos(pos[i]);
+		}
+		for(int i = 1; i < POS_MAX/2; ++i)
+		{
+			pos[i] = pos[i*2];
+		}
+		pos_count = POS_MAX/2;
+		pos_step *= 2;
+		if(frame % pos_step)
+			return;
+	}
+	ePos& p = pos[pos_count++];
+	p.frame = frame;
+	p.block_start = block.start;
+	p.block_length = block.length;
+	p.status = status;
+	p.framecount = framecount;
+	p.file_pos = file->Pos();
+#ifdef USE_ZIP
+	p.zs = NULL;
+	if(zbuf)
+	{
+		p.file_pos -= zs.avail_in;
+		p.zs = new z_stream;
+		inflateCopy(p.zs, &zs);
+	}
+#endif//USE_ZIP
+	p.INmax = INmax;
+	p.inputs = new byte[INmax];
+	memcpy(p.inputs, inputbuffer, INmax);
+}
+void eRZX::eImpl::RestorePos(const ePos& p)
+{
+#ifdef USE_ZIP
+	ZipClose();
+	if(p.zs)
+	{
+		zbuf = (byte*)malloc(ZBUFLEN);
+		inflateCopy(&zs, p.zs);
+		zs.next_in = zbuf;
+		zs.avail_in = 0;
+	}
+#endif//USE_ZIP
+	frame = p.frame;
+	block.start = p.block_start;
+	block.length = p.block_length;
+	status = p.status;
+	framecount = p.framecount;
+	file->Seek(p.file_pos);
+	INmax = INcount = p.INmax;
+	memcpy(inputbuffer, p.inputs, INmax);
+}
+void eRZX::eImpl::FreePos(ePos& p)
+{
+#ifdef USE_ZIP
+	if(p.zs)
+		inflateEnd(p.zs);
+	SAFE_DELETE(p.zs);
+#endif//USE_ZIP
+	SAFE_DELETE_ARRAY(p.inputs);
+}
+void eRZX::eImpl::AddKey()
+{
+	if(key_count == KEY_MAX)
+	{
+		for(int i = 1; i < KEY_MAX; i += 2)
+		{
+			SAFE_DELETE_ARRAY(keys[i].data);
+		}
+		for(int i = 1; i < KEY_MAX/2; ++i)
+		{
+			keys[i] = keys[i*2];
+		}
+		key_count = KEY_MAX/2;
+		key_step *= 2;
+		if(frame < keys[key_count - 1].frame + key_step)
+			return;
+	}
+	eKeyJob& j = key_job;
+	if(!j.state)
+	{
+		j.state = new xSnapshot::eState;
+		j.data = new byte[xSnapshot::MAX_SIZE];
+	}
+	if(!handler->RZX_OnCaptureState(j.state))
+		return;
+	j.frame = frame;
+	j.busy = true;
+	ThreadFence();
+	key_thread.Start(EncodeKey, &j);
+}
+void eRZX::eImpl::EncodeKey(void* job)
+{
+	eKeyJob* j = (eKeyJob*)job;
+	j->size = xSnapshot::Store(*j->state, "szx", j->data, xSnapshot::MAX_SIZE, true);
+	ThreadFence();
+	j->busy = false;
+}
+void eRZX::eImpl::CollectKey(bool wait)
+{
+	eKeyJob& j = key_job;
+	if(j.frame < 0 || (j.busy && !wait))
+		return;
+	key_thread.Wait();
+	if(j.size)
+	{
+		eKey& k = keys[key_count++];
+		k.frame = j.frame;
+		k.size = j.size;
+		k.data = new byte[j.size];
+		memcpy(k.data, j.data, j.size);
+	}
+	j.frame = -1;
+}
+eRZX::eError eRZX::eImpl::Seek(int to)
+{
+	if(!file)
+		return E_FINISHED;
+	if(to < 0)
+		to = 0;
+	if(to > frames)
+		to = frames;
+	CollectKey(true);
+	int k = -1;
+	for(int i = 0; i < key_count && keys[i].frame <= to; ++i)
+	{
+		k = i;
+	}
+	if(k < 0 || (frame <= to && keys[k].frame <= frame))
+		return frame <= to ? E_OK : E_INVALID; // replay from current frame is nearer
+	const eKey& key = keys[k];
+	if(!handler->RZX_OnOpenSnapshot("keyframe.szx", key.data, key.size))
+		return E_UNSUPPORTED;
+	int p = 0;
+	while(p + 1 < pos_count && pos[p + 1].frame <= key.frame)
+		++p;
+	RestorePos(pos[p]);
+	scanning = true;
+	eError err = E_OK;
+	while(err == E_OK && frame < key.frame)
+	{
+		int icount = 0;
+		err = ReadFrame(&icount);
+	}
+	scanning = false;
+	return err;
+}
+
 void eRZX::eImpl::Close()
 {
 #ifdef USE_ZIP
@@ -327,10 +558,35 @@ void eRZX::eImpl::Close()
 	SAFE_DELETE(file);
 	status = RZX_INIT;
 	SAFE_DELETE_ARRAY(inputbuffer);
+	for(int i = 0; i < pos_count; ++i)
+	{
+		FreePos(pos[i]);
+	}
+	pos_count = 0;
+	key_thread.Wait();
+	key_job.frame = -1;
+	SAFE_DELETE(key_job.state);
+	SAFE_DELETE_ARRAY(key_job.data);
+	for(int i = 0; i < key_count; ++i)
+	{
+		SAFE_DELETE_ARRAY(keys[i].data);
+	}
+	key_count = 0;
 }
 
 
 eRZX::eError eRZX::eImpl::Update(int* icount)
+{
+	// retried each frame while machine state can't be captured
+	CollectKey(false);
+	if(key_job.frame < 0 && (!key_count || frame >= keys[key_count - 1].frame + key_step))
+		AddKey();
+	eError err = ReadFrame(icount);
+	if(err != E_OK)
+		Close();
+	return err;
+}
+eRZX::eError eRZX::eImpl::ReadFrame(int* icount)
 {
 	/* check if we are at the beginning */
 	if((status & RZX_IRB) && (!framecount))
@@ -345,12 +601,8 @@ eRZX::eError eRZX::eImpl::Update(int* icount)
 		if(file->Seek(block.start) != 0) // bugfix with possible buffer overread when readed zipped data
 			return E_INVALID;
 		eError err = ReadBlock();
-		if(err != E_OK)
-		{
-			/* no more IRBs, finished */
-			Close();
+		if(err != E_OK) /* no more IRBs, finished */
 			return err;
-		}
 	}
 
 	/* fetch the instruction and IN counters */
@@ -381,6 +633,7 @@ eRZX::eError eRZX::eImpl::Update(int* icount)
 		INmax = INold;
 	INcount = 0;
 	--framecount;
+	++frame;
 	return E_OK;
 }
 eRZX::eError eRZX::eImpl::IoRead(byte* data)
@@ -391,9 +644,222 @@ eRZX::eError eRZX::eImpl::IoRead(byte* data)
 	return E_OK;
 }
 
-eRZX::eRZX() { impl = new eImpl; }
-eRZX::~eRZX() { delete impl; }
-eRZX::eError eRZX::Open(const void* data, size_t data_size, eHandler* handler) { return impl->Open(data, data_size, handler); }
+
+/* ======================================================================== */
+
+class eRZX::eWriter
+{
+public:
+	eWriter() : file(NULL), current(0), in_count(0), in_prev_count(0), tact(0), packed(NULL), packed_size(0), ok(true)
+	{
+		for(int i = 0; i < 2; ++i)
+		{
+			chunks[i].owner = this;
+			chunks[i].data = NULL;
+		}
+	}
+	~eWriter() { Close(); }
+	eError Open(const char* name, const char* snapshot_type, const void* snapshot, size_t snapshot_size, int tact);
+	bool Frame(int icount, int tact);
+	bool Close();
+	void Io(byte data)
+	{
+		if(in_count < RZXINPUTMAX)
+			in[in_count++] = data;
+	}
+
+private:
+	enum { RZXBLK_CREATOR = 0x10, RZXBLK_SNAP = 0x30, RZXBLK_DATA = 0x80 };
+	enum { RZXINPUTMAX = 32768, CHUNK_SIZE = 256*1024 };
+	// recorded data waiting for packing, whole chunk goes to one block
+	struct eChunk
+	{
+		eWriter* owner;
+		byte type;
+		byte* data;
+		size_t size;
+		dword frames;
+		dword tact;
+		char ext[4];
+	};
+	static void WriteChunk(void* chunk) { eChunk* c = (eChunk*)chunk; c->owner->Write(*c); }
+	void Write(const eChunk& c);
+	bool Flush();
+
+	FILE* file;
+	eThread thread;
+	eChunk chunks[2];
+	int current;
+	byte in[RZXINPUTMAX];
+	byte in_prev[RZXINPUTMAX];
+	word in_count;
+	word in_prev_count;
+	int tact;
+	byte* packed;
+	size_t packed_size;
+	bool ok;
+};
+
+static void SetWord(byte* p, word v) { p[0] = v; p[1] = v >> 8; }
+static void SetDword(byte* p, dword v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+
+eRZX::eError eRZX::eWriter::Open(const char* name, const char* snapshot_type, const void* snapshot, size_t snapshot_size, int _tact)
+{
+	assert(!file);
+	if(snapshot_size > CHUNK_SIZE)
+		return E_UNSUPPORTED;
+	file = fopen(name, "wb");
+	if(!file)
+		return E_INVALID;
+	packed_size = CHUNK_SIZE + CHUNK_SIZE/1000 + 64; // zlib worst case
+	packed = new byte[packed_size];
+	for(int i = 0; i < 2; ++i)
+	{
+		chunks[i].data = new byte[CHUNK_SIZE];
+		chunks[i].size = 0;
+		chunks[i].frames = 0;
+		chunks[i].tact = 0;
+	}
+	byte h[10 + 29];
+	memset(h, 0, sizeof(h));
+	memcpy(h, "RZX!", 4);
+	h[4] = 0; h[5] = 12; // version 0.12
+	byte* c = h + 10;
+	c[0] = RZXBLK_CREATOR;
+	SetDword(c + 1, 29);
+	strcpy((char*)c + 5, "Unreal Speccy");
+	SetWord(c + 25, 0); SetWord(c + 27, 56);
+	ok = fwrite(h, 1, sizeof(h), file) == sizeof(h);
+
+	eChunk& s = chunks[1];
+	s.type = RZXBLK_SNAP;
+	memset(s.ext, 0, sizeof(s.ext));
+	strncpy(s.ext, snapshot_type, 3);
+	memcpy(s.data, snapshot, snapshot_size);
+	s.size = snapshot_size;
+	thread.Start(WriteChunk, &s);
+	current = 0;
+	chunks[current].type = RZXBLK_DATA;
+	chunks[current].tact = tact = _tact;
+	return ok ? E_OK : E_INVALID;
+}
+void eRZX::eWriter::Write(const eChunk& c)
+{
+	const byte* data = c.data;
+	size_t size = c.size;
+	dword flags = 0;
+#ifdef USE_ZIP
+	uLongf size_z = packed_size;
+	if(compress2(packed, &size_z, c.data, c.size, Z_DEFAULT_COMPRESSION) == Z_OK)
+	{
+		data = packed;
+		size = size_z;
+		flags |= 0x02;
+	}
+#endif//USE_ZIP
+	byte h[5 + 13];
+	size_t h_size = 5 + 12;
+	h[0] = c.type;
+	if(c.type == RZXBLK_SNAP)
+	{
+		SetDword(h + 5, flags);
+		memcpy(h + 9, c.ext, 4);
+		SetDword(h + 13, c.size);
+	}
+	else
+	{
+		h_size = 5 + 13;
+		SetDword(h + 5, c.frames);
+		h[9] = 0;
+		SetDword(h + 10, c.tact);
+		SetDword(h + 14, flags);
+	}
+	SetDword(h + 1, h_size + size);
+	if(fwrite(h, 1, h_size, file) != h_size || fwrite(data, 1, size, file) != size)
+		ok = false;
+}
+bool eRZX::eWriter::Frame(int icount, int _tact)
+{
+	eChunk& c = chunks[current];
+	byte* d = c.data + c.size;
+	SetWord(d, icount);
+	if(in_count && in_count == in_prev_count && !memcmp(in, in_prev, in_count))
+	{
+		SetWord(d + 2, 0xffff); // same input as in previous frame
+		c.size += 4;
+	}
+	else
+	{
+		SetWord(d + 2, in_count);
+		memcpy(d + 4, in, in_count);
+		c.size += 4 + in_count;
+		memcpy(in_prev, in, in_count);
+		in_prev_count = in_count;
+	}
+	in_count = 0;
+	++c.frames;
+	tact = _tact;
+	if(c.size + 4 + RZXINPUTMAX > CHUNK_SIZE)
+		return Flush();
+	return true;
+}
+// false if writing of previous chunk failed
+bool eRZX::eWriter::Flush()
+{
+	eChunk& c = chunks[current];
+	thread.Wait();
+	if(!ok)
+		return false;
+	if(!c.frames)
+		return true;
+	thread.Start(WriteChunk, &c);
+	current ^= 1;
+	eChunk& n = chunks[current];
+	n.type = RZXBLK_DATA;
+	n.size = 0;
+	n.frames = 0;
+	n.tact = tact;
+	return true;
+}
+bool eRZX::eWriter::Close()
+{
+	if(!file)
+		return false;
+	Flush();
+	thread.Wait();
+	bool r = (fclose(file) == 0) && ok;
+	file = NULL;
+	SAFE_DELETE_ARRAY(packed);
+	for(int i = 0; i < 2; ++i)
+	{
+		SAFE_DELETE_ARRAY(chunks[i].data);
+	}
+	return r;
+}
+
+eRZX::eRZX() : writer(NULL) { impl = new eImpl; }
+eRZX::~eRZX() { delete impl; SAFE_DELETE(writer); }
+eRZX::eError eRZX::Open(xIo::eFileData* data, eHandler* handler) { return impl->Open(data, handler); }
 eRZX::eError eRZX::Update(int* icount) { return impl->Update(icount); }
 eRZX::eError eRZX::IoRead(byte* data) { return impl->IoRead(data); }
 eRZX::eError eRZX::CheckSync() const { return impl->CheckSync(); }
+eRZX::eError eRZX::Seek(int frame) { return impl->Seek(frame); }
+int eRZX::Frame() const { return impl->Frame(); }
+int eRZX::Frames() const { return impl->Frames(); }
+eRZX::eError eRZX::Record(const char* name, const char* snapshot_type, const void* snapshot, size_t snapshot_size, int tact)
+{
+	SAFE_DELETE(writer);
+	writer = new eWriter;
+	eError err = writer->Open(name, snapshot_type, snapshot, snapshot_size, tact);
+	if(err != E_OK)
+		SAFE_DELETE(writer);
+	return err;
+}
+eRZX::eError eRZX::RecordFrame(int icount, int tact) { return writer->Frame(icount, tact) ? E_OK : E_INVALID; }
+void eRZX::RecordIo(byte data) { writer->Io(data); }
+eRZX::eError eRZX::RecordStop()
+{
+	bool ok = writer && writer->Close();
+	SAFE_DELETE(writer);
+	return ok ? E_OK : E_INVALID;
+}
@@ -21,6 +21,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "../std_types.h"
 
+namespace xIo { class eFileData; }
+namespace xSnapshot { struct eState; }
+
 class eRZX
 {
 public:
@@ -33,16 +36,34 @@ public:
 	{
 	public:
 		virtual bool RZX_OnOpenSnapshot(const char* name, const void* data, size_t data_size) = 0;
+		// keyframe for seeking, false if machine state can't be captured now
+		virtual bool RZX_OnCaptureState(xSnapshot::eState* state) = 0;
 	};
 
-	eError Open(const void* data, size_t data_size, eHandler* handler);
+	// data is referenced (not copied) until replay is done
+	eError Open(xIo::eFileData* data, eHandler* handler);
 	eError Update(int* icount);
 	eError IoRead(byte* data);
 	eError CheckSync() const;
+	// restores nearest keyframe, frames left to target are replayed by Update()
+	eError Seek(int frame);
+	int Frame() const;
+	int Frames() const;
+
+	// recording with embedded snapshot taken at tact of frame,
+	// input blocks packed & written in background
+	eError Record(const char* name, const char* snapshot_type, const void* snapshot, size_t snapshot_size, int tact);
+	// E_INVALID if writing failed, recording should be stopped then
+	eError RecordFrame(int icount, int tact);
+	void RecordIo(byte data);
+	// finishes file, E_INVALID if it wasn't written completely
+	eError RecordStop();
 
 private:
 	class eImpl;
 	eImpl* impl;
+	class eWriter;
+	eWriter* writer;
 };
 
 #endif//__RZX_H__
@@ -21,9 +21,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "../devices/memory.h"
 #include "../devices/ula.h"
 #include "../devices/sound/ay.h"
+#include "../devices/fdd/wd1793.h"
 #include "../speccy.h"
 #include "../platform/endian.h"
 #include "../platform/platform.h"
+#include "../platform/io.h"
+#include "../tools/thread.h"
 
 #include "snapshot.h"
 
@@ -74,6 +77,7 @@ struct eZ80Accessor : public xZ80::eZ80
 	bool SetState(const eSnapshot_SNA* s, size_t buf_size);
 	size_t StoreState(eSnapshot_SNA* s);
 	bool SetState(const eSnapshot_Z80* s, size_t buf_size);
+	void Capture(eState* s);
 	void UnpackPage(byte* dst, int dstlen, byte* src, int srclen);
 	void SetupDevices(bool model48k)
 	{
@@ -295,7 +299,121 @@ void eZ80Accessor::UnpackPage(byte* dst, int dstlen, byte* src, int srclen)
 	}
 }
 
+void eZ80Accessor::Capture(eState* s)
+{
+	s->af = af; s->bc = bc; s->de = de; s->hl = hl;
+	s->alt_af = alt.af; s->alt_bc = alt.bc; s->alt_de = alt.de; s->alt_hl = alt.hl;
+	s->ix = ix; s->iy = iy; s->sp = sp; s->pc = pc; s->memptr = memptr;
+	s->i = i; s->r = (r_low & 0x7F)+r_hi; s->im = im;
+	s->iff1 = iff1; s->iff2 = iff2; s->halted = halted; s->ei_last = eipos == t;
+	s->t = t; s->frame_tacts = frame_tacts;
+	eMemory* m = devices->Get<eMemory>();
+	s->model48k = m->Mode48k();
+	s->p7FFD = memory->Page(3) - eMemory::P_RAM0;
+	if(!devices->Get<eUla>()->FirstScreen())
+		s->p7FFD |= 0x08;
+	if(m->Page(0) & 1) // 48 basic or tr-dos rom
+		s->p7FFD |= 0x10;
+	if(s->model48k)
+		s->p7FFD = 0x30;
+	s->border = devices->Get<eUla>()->BorderColor();
+	eAY* ay = devices->Get<eAY>();
+	s->ay_reg = ay->Selected();
+	memcpy(s->ay, ay->Regs(), sizeof(s->ay));
+	s->dos = m->DosSelected();
+	devices->Get<eWD1793>()->GetRegs(s->fdc);
+	for(int p = 0; p < 8; ++p)
+	{
+		memcpy(s->ram[p], memory->Get(eMemory::P_RAM0 + p), eState::PAGE_SIZE);
+	}
+}
+
+// .z80 RLE, returns packed size or 0 if it isn't smaller than source
+static size_t PackPage(byte* dst, const byte* src, size_t srclen)
+{
+	byte* d = dst;
+	byte* end = dst + srclen - 4;
+	for(size_t i = 0; i < srclen;)
+	{
+		if(d > end)
+			return 0;
+		byte v = src[i];
+		size_t run = 1;
+		while(i + run < srclen && src[i + run] == v && run < 255)
+			++run;
+		if(run >= 5 || (v == 0xED && run >= 2))
+		{
+			*d++ = 0xED; *d++ = 0xED; *d++ = run; *d++ = v;
+			i += run;
+			continue;
+		}
+		*d++ = src[i++];
+		if(v == 0xED && i < srclen) // byte after single ED is never packed
+			*d++ = src[i++];
+	}
+	return d - dst;
+}
+// .z80 version 3 with RLE packed pages
+static size_t StoreZ80(const eState& s, byte* data, size_t data_size)
+{
+	enum { HEADER_SIZE = 30, EXT_HEADER_SIZE = 54, BLOCK_SIZE = 3 + eState::PAGE_SIZE };
+	size_t pages = s.model48k ? 3 : 8;
+	if(data_size < size_t(HEADER_SIZE + 2 + EXT_HEADER_SIZE) + pages * BLOCK_SIZE)
+		return 0;
+	byte* h = data;
+	memset(h, 0, HEADER_SIZE + 2 + EXT_HEADER_SIZE);
+	h[0] = s.af >> 8; h[1] = s.af & 0xff;
+	h[2] = s.bc & 0xff; h[3] = s.bc >> 8;
+	h[4] = s.hl & 0xff; h[5] = s.hl >> 8;
+	// pc = 0 - version 2+ header follows
+	h[8] = s.sp & 0xff; h[9] = s.sp >> 8;
+	h[10] = s.i;
+	h[11] = s.r & 0x7f;
+	h[12] = (s.r >> 7) | ((s.border & 7) << 1);
+	h[13] = s.de & 0xff; h[14] = s.de >> 8;
+	h[15] = s.alt_bc & 0xff; h[16] = s.alt_bc >> 8;
+	h[17] = s.alt_de & 0xff; h[18] = s.alt_de >> 8;
+	h[19] = s.alt_hl & 0xff; h[20] = s.alt_hl >> 8;
+	h[21] = s.alt_af >> 8; h[22] = s.alt_af & 0xff;
+	h[23] = s.iy & 0xff; h[24] = s.iy >> 8;
+	h[25] = s.ix & 0xff; h[26] = s.ix >> 8;
+	h[27] = s.iff1 ? 1 : 0;
+	h[28] = s.iff2 ? 1 : 0;
+	h[29] = s.im & 3;
+	byte* x = h + HEADER_SIZE;
+	x[0] = EXT_HEADER_SIZE; x[1] = 0;
+	x[2] = s.pc & 0xff; x[3] = s.pc >> 8;
+	x[4] = s.model48k ? 0 : 9;	// 48k or pentagon 128k
+	x[5] = s.p7FFD;
+	x[7] = 0x07;				// r & ldir emulation, ay in use
+	x[8] = s.ay_reg;
+	memcpy(x + 9, s.ay, sizeof(s.ay));
+	dword quarter = s.frame_tacts / 4;
+	dword lo = quarter - (s.t % quarter) - 1;
+	x[25] = lo & 0xff; x[26] = lo >> 8;
+	x[27] = (s.t / quarter + 3) % 4;
+	x[31] = x[32] = 0xff;		// rom at 0000-3fff
+	byte* d = x + 2 + EXT_HEADER_SIZE;
+	static const byte pages48[] = { 5, 2, 0 };
+	static const byte blocks48[] = { 8, 4, 5 };
+	for(size_t i = 0; i < pages; ++i)
+	{
+		int p = s.model48k ? pages48[i] : int(i);
+		size_t len = PackPage(d + 3, s.ram[p], eState::PAGE_SIZE);
+		if(!len)
+		{
+			memcpy(d + 3, s.ram[p], eState::PAGE_SIZE);
+			len = 0xffff;
+		}
+		d[0] = len & 0xff; d[1] = len >> 8;
+		d[2] = s.model48k ? blocks48[i] : p + 3;
+		d += 3 + (len == 0xffff ? size_t(eState::PAGE_SIZE) : len);
+	}
+	return d - data;
+}
+
 bool LoadSZX(eSpeccy* speccy, const void* data, size_t data_size);
+size_t StoreSZX(const eState& s, byte* data, size_t data_size, bool fast);
 
 bool Load(eSpeccy* speccy, const char* type, const void* data, size_t data_size)
 {
@@ -313,21 +431,128 @@ bool Load(eSpeccy* speccy, const char* type, const void* data, size_t data_size)
 	return ok;
 }
 
-bool Store(eSpeccy* speccy, const char* file)
+void Capture(eSpeccy* speccy, eState* s)
+{
+	((eZ80Accessor*)speccy->CPU())->Capture(s);
+}
+
+size_t Store(const eState& s, const char* type, void* data, size_t data_size, bool fast)
+{
+	if(!strcmp(type, "z80"))
+		return StoreZ80(s, (byte*)data, data_size);
+	if(!strcmp(type, "szx"))
+		return StoreSZX(s, (byte*)data, data_size, fast);
+	return 0;
+}
+
+size_t Store(eSpeccy* speccy, const char* type, void* data, size_t data_size)
+{
+	eZ80Accessor* z80 = (eZ80Accessor*)speccy->CPU();
+	if(!strcmp(type, "sna"))
+	{
+		if(data_size < sizeof(eSnapshot_SNA))
+			return 0;
+		return z80->StoreState((eSnapshot_SNA*)data);
+	}
+	eState* s = new eState;
+	z80->Capture(s);
+	size_t size = Store(*s, type, data, data_size);
+	delete s;
+	return size;
+}
+
+// file is removed if it can't be written completely
+static bool Write(const char* file, const void* data, size_t size)
 {
 	FILE* f = fopen(file, "wb");
 	if(!f)
 		return false;
-	eSnapshot_SNA* s = new eSnapshot_SNA;
-	eZ80Accessor* z80 = (eZ80Accessor*)speccy->CPU();
-	size_t size = z80->StoreState(s);
-	bool ok = false;
-	if(size)
-		ok = fwrite(s, 1, size, f) == size;
-	delete s;
-	fclose(f);
+	bool ok = fwrite(data, 1, size, f) == size;
+	ok = (fclose(f) == 0) && ok;
+	if(!ok)
+		remove(file);
 	return ok;
 }
 
+//*****************************************************************************
+//	eStoreJob
+//	state is captured by emulation thread, encoded & written by store thread
+//-----------------------------------------------------------------------------
+struct eStoreJob
+{
+	eStoreJob() : data(NULL), size(0), failures(0) { *file = *type = '\0'; }
+	~eStoreJob() { SAFE_DELETE_ARRAY(data); }
+	static void Run(void* arg);
+	eState state;
+	char file[xIo::MAX_PATH_LEN];
+	char type[4];
+	byte* data;
+	size_t size;			// encoded by emulation thread (sna)
+	volatile int failures;	// changed by store thread only
+};
+static eStoreJob store_job;
+static eThread store_thread;
+static int store_failures = 0; // already reported
+//=============================================================================
+//	eStoreJob::Run
+//-----------------------------------------------------------------------------
+void eStoreJob::Run(void* arg)
+{
+	eStoreJob* j = (eStoreJob*)arg;
+	if(!j->size)
+		j->size = Store(j->state, j->type, j->data, MAX_SIZE);
+	bool ok = j->size && Write(j->file, j->data, j->size); // nothing is created if encoding failed
+	ThreadFence();
+	if(!ok)
+		++j->failures;
+}
+
+bool Store(eSpeccy* speccy, const char* file)
+{
+	const char* ext = strrchr(file, '.');
+	char type[4];
+	strncpy(type, ext ? ext + 1 : "sna", 3);
+	type[3] = 0;
+	for(char* t = type; *t; ++t)
+	{
+		if(*t >= 'A' && *t <= 'Z')
+			*t += 'a' - 'A';
+	}
+	if(strcmp(type, "z80") && strcmp(type, "szx"))
+		strcpy(type, "sna");
+	if(strlen(file) >= xIo::MAX_PATH_LEN)
+		return false;
+	store_thread.Wait(); // previous store is still in progress
+	eStoreJob& j = store_job;
+	if(!j.data)
+		j.data = new byte[MAX_SIZE];
+	strcpy(j.file, file);
+	strcpy(j.type, type);
+	j.size = 0;
+	eZ80Accessor* z80 = (eZ80Accessor*)speccy->CPU();
+	if(!strcmp(type, "sna"))
+	{
+		j.size = z80->StoreState((eSnapshot_SNA*)j.data);
+		if(!j.size)
+			return false;
+	}
+	else
+		z80->Capture(&j.state);
+	store_thread.Start(eStoreJob::Run, &j);
+	return true;
+}
+bool StoreFailed()
+{
+	int f = store_job.failures;
+	if(f == store_failures)
+		return false;
+	store_failures = f;
+	return true;
+}
+void StoreWait()
+{
+	store_thread.Wait();
+}
+
 }
 //namespace xSnapshot
@@ -28,7 +28,37 @@ class eSpeccy;
 namespace xSnapshot
 {
 bool Load(eSpeccy* speccy, const char* type, const void* data, size_t data_size);
+// type by file extension, machine state is captured at once,
+// encoded & written in background (false if store wasn't started)
 bool Store(eSpeccy* speccy, const char* file);
+// true once after background store failure (file is removed then)
+bool StoreFailed();
+void StoreWait();
+// returns stored size, 0 if failed (MAX_SIZE is enough for any type)
+size_t Store(eSpeccy* speccy, const char* type, void* data, size_t data_size);
+enum { MAX_SIZE = 160*1024 };
+
+// machine state captured for snapshot writers
+struct eState
+{
+	enum { PAGE_SIZE = 16384 };
+	word af, bc, de, hl;
+	word alt_af, alt_bc, alt_de, alt_hl;
+	word ix, iy, sp, pc, memptr;
+	byte i, r, im;
+	byte iff1, iff2, halted, ei_last;
+	dword t, frame_tacts;
+	bool model48k;
+	byte p7FFD, border;
+	byte ay_reg, ay[16];
+	bool dos;       // tr-dos rom paged
+	byte fdc[5];    // beta128 system, wd1793 track, sector, data & status registers
+	byte ram[8][PAGE_SIZE];
+};
+// state is captured at once, it can be encoded later by any thread
+void Capture(eSpeccy* speccy, eState* s);
+// z80 & szx only, fast - lower szx compression
+size_t Store(const eState& s, const char* type, void* data, size_t data_size, bool fast = false);
 }
 //namespace xSnapshot
 
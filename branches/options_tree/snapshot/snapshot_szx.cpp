@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "../devices/memory.h"
 #include "../devices/ula.h"
 #include "../devices/sound/ay.h"
+#include "../devices/fdd/wd1793.h"
 #include "../speccy.h"
 #include "../platform/endian.h"
 #include "../tools/stream_memory.h"
@@ -147,6 +148,28 @@ typedef struct _tagZXSTAYBLOCK
 	BYTE chAyRegs[16];
 } ZXSTAYBLOCK, *LPZXSTAYBLOCK;
 
+// Beta 128 disk interface flags
+#define ZXSTBETAF_CONNECTED  1
+#define ZXSTBETAF_CUSTOMROM  2
+#define ZXSTBETAF_PAGED      4
+#define ZXSTBETAF_AUTOBOOT   8
+#define ZXSTBETAF_SEEKLOWER  16
+#define ZXSTBETAF_COMPRESSED 32
+
+// Beta 128 disk interface, custom rom data follows if used
+typedef struct _tagZXSTBETA128
+{
+	ZXSTBLOCK blk;
+	DWORD dwFlags;
+	BYTE chNumDrives;
+	BYTE chSysReg;
+	BYTE chTrackReg;
+	BYTE chSectorReg;
+	BYTE chDataReg;
+	BYTE chStatusReg;
+	BYTE chRomData[1];
+} ZXSTBETA128, *LPZXSTBETA128;
+
 #pragma pack(pop)
 
 struct eZ80AccessorSZX : public xZ80::eZ80
@@ -292,6 +315,19 @@ bool eZ80AccessorSZX::SetState(xIo::eStreamMemory& is)
 				devices->Get<eAY>()->Select(ay_state.chCurrentRegister);
 			}
 			break;
+		case FOURCC('B', '1', '2', '8'):
+			{
+				ZXSTBETA128 beta;
+				size_t size = sizeof(ZXSTBETA128) - sizeof(ZXSTBLOCK) - 1;
+				if(block.dwSize < size || !ReadBlock(is, &beta, block, size))
+					return false;
+				if(is.Seek(block.dwSize - size, xIo::eStreamMemory::S_CUR) != 0) // custom rom
+					return false;
+				devices->Get<eWD1793>()->SetRegs(&beta.chSysReg);
+				if(Dword((const byte*)&beta.dwFlags) & ZXSTBETAF_PAGED)
+					devices->Get<eMemory>()->SetRomPage(eMemory::P_ROM_DOS);
+			}
+			break;
 		default:
 			if(is.Seek(block.dwSize, xIo::eStreamMemory::S_CUR) != 0)
 				return false;
@@ -310,5 +346,99 @@ bool LoadSZX(eSpeccy* speccy, const void* data, size_t data_size)
 	return z80->SetState(is);
 }
 
+static void SetDword(byte* p, dword v)
+{
+	p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+template<class B> static B* AddBlock(byte*& d, dword id, size_t size = sizeof(B))
+{
+	B* b = (B*)d;
+	memset(b, 0, size);
+	b->blk.dwId = id;
+	SetDword((byte*)&b->blk.dwSize, size - sizeof(ZXSTBLOCK));
+	d += size;
+	return b;
+}
+
+size_t StoreSZX(const eState& s, byte* data, size_t data_size, bool fast)
+{
+	enum { PAGE_HEADER_SIZE = sizeof(ZXSTRAMPAGE) - 1 };
+	int pages = s.model48k ? 3 : 8;
+	size_t max_size = sizeof(ZXSTHEADER) + sizeof(ZXSTZ80REGS) + sizeof(ZXSTSPECREGS) + sizeof(ZXSTAYBLOCK)
+						+ sizeof(ZXSTBETA128) - 1 + pages * (PAGE_HEADER_SIZE + eState::PAGE_SIZE);
+	if(data_size < max_size)
+		return 0;
+	byte* d = data;
+	ZXSTHEADER* header = (ZXSTHEADER*)d;
+	header->dwMagic = FOURCC('Z', 'X', 'S', 'T');
+	header->chMajorVersion = 1;
+	header->chMinorVersion = 4;
+	header->chMachineId = s.model48k ? ZXSTMID_48K : ZXSTMID_PENTAGON128;
+	header->chFlags = 0;
+	d += sizeof(ZXSTHEADER);
+
+	ZXSTZ80REGS* regs = AddBlock<ZXSTZ80REGS>(d, FOURCC('Z', '8', '0', 'R'));
+	regs->AF = SwapWord(s.af);
+	regs->BC = SwapWord(s.bc);
+	regs->DE = SwapWord(s.de);
+	regs->HL = SwapWord(s.hl);
+	regs->AF1 = SwapWord(s.alt_af);
+	regs->BC1 = SwapWord(s.alt_bc);
+	regs->DE1 = SwapWord(s.alt_de);
+	regs->HL1 = SwapWord(s.alt_hl);
+	regs->IX = SwapWord(s.ix);
+	regs->IY = SwapWord(s.iy);
+	regs->SP = SwapWord(s.sp);
+	regs->PC = SwapWord(s.pc);
+	regs->I = s.i;
+	regs->R = s.r;
+	regs->IFF1 = s.iff1;
+	regs->IFF2 = s.iff2;
+	regs->IM = s.im;
+	SetDword((byte*)&regs->dwCyclesStart, s.t);
+	regs->chFlags = (s.ei_last ? ZXSTZF_EILAST : 0) | (s.halted ? ZXSTZF_HALTED : 0);
+	regs->wMemPtr = SwapWord(s.memptr);
+
+	ZXSTSPECREGS* spec = AddBlock<ZXSTSPECREGS>(d, FOURCC('S', 'P', 'C', 'R'));
+	spec->chBorder = s.border & 7;
+	spec->ch7ffd = s.p7FFD;
+	spec->chFe = s.border & 7;
+
+	ZXSTAYBLOCK* ay = AddBlock<ZXSTAYBLOCK>(d, FOURCC('A', 'Y', '\0', '\0'));
+	ay->chFlags = s.model48k ? 0 : ZXSTAYF_128AY;
+	ay->chCurrentRegister = s.ay_reg;
+	memcpy(ay->chAyRegs, s.ay, sizeof(ay->chAyRegs));
+
+	ZXSTBETA128* beta = AddBlock<ZXSTBETA128>(d, FOURCC('B', '1', '2', '8'), sizeof(ZXSTBETA128) - 1);
+	SetDword((byte*)&beta->dwFlags, ZXSTBETAF_CONNECTED | (s.dos ? ZXSTBETAF_PAGED : 0));
+	beta->chNumDrives = eWD1793::FDD_COUNT;
+	memcpy(&beta->chSysReg, s.fdc, sizeof(s.fdc));
+
+	static const byte pages48[] = { 5, 2, 0 };
+	for(int i = 0; i < pages; ++i)
+	{
+		int p = s.model48k ? pages48[i] : i;
+		ZXSTRAMPAGE* page = (ZXSTRAMPAGE*)d;
+		size_t size = 0;
+#ifdef USE_ZIP
+		uLongf packed = eState::PAGE_SIZE - 1;
+		if(compress2(page->chData, &packed, s.ram[p], eState::PAGE_SIZE, fast ? Z_BEST_SPEED : Z_BEST_COMPRESSION) == Z_OK)
+			size = packed;
+#endif//USE_ZIP
+		word flags = size ? ZXSTRF_COMPRESSED : 0;
+		if(!size)
+		{
+			memcpy(page->chData, s.ram[p], eState::PAGE_SIZE);
+			size = eState::PAGE_SIZE;
+		}
+		page->blk.dwId = FOURCC('R', 'A', 'M', 'P');
+		SetDword((byte*)&page->blk.dwSize, PAGE_HEADER_SIZE - sizeof(ZXSTBLOCK) + size);
+		page->wFlags = SwapWord(flags);
+		page->chPageNo = p;
+		d += PAGE_HEADER_SIZE + size;
+	}
+	return d - data;
+}
+
 }
 //namespace xSnapshot
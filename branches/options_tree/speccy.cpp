@@ -41,7 +41,7 @@ PROFILER_DECLARE(frame);
 //	eSpeccy::eSpeccy
 //-----------------------------------------------------------------------------
 eSpeccy::eSpeccy() : cpu(NULL), memory(NULL), frame_tacts(0)
-	, int_len(0), nmi_pending(0), t_states(0)
+	, int_len(0), nmi_pending(0), frame_slices(1), slice(0), t_states(0)
 {
 	// pentagon timings
 	frame_tacts = 71680;
@@ -72,33 +72,73 @@ eSpeccy::~eSpeccy()
 //-----------------------------------------------------------------------------
 void eSpeccy::Reset()
 {
+	CompleteFrame();
 	cpu->Reset();
 	devices.Init();
 	devices.Reset();
 }
 //=============================================================================
+//	eSpeccy::CompleteFrame
+//-----------------------------------------------------------------------------
+void eSpeccy::CompleteFrame()
+{
+	while(slice)
+	{
+		Update();
+	}
+}
+//=============================================================================
 //	eSpeccy::Update
 //-----------------------------------------------------------------------------
-void eSpeccy::Update(int* fetches)
+bool eSpeccy::Update(int* fetches)
 {
+	if(fetches)
+	{
+		{
+			PROFILER_SECTION(dev_s);
+			devices.FrameStart(0);
+		}
+		{
+			PROFILER_SECTION(frame);
+			cpu->Replay(*fetches);
+		}
+		{
+			PROFILER_SECTION(dev);
+			devices.FrameUpdate();
+		}
+		{
+			PROFILER_SECTION(dev_e);
+			devices.FrameEnd(cpu->T());
+		}
+		t_states += cpu->T();
+		return true;
+	}
+	if(!slice)
 	{
 		PROFILER_SECTION(dev_s);
-		devices.FrameStart(fetches ? 0 : cpu->T());
+		devices.FrameStart(cpu->T());
+		cpu->FrameStart(int_len);
 	}
 	{
 		PROFILER_SECTION(frame);
-		if(fetches)
-			cpu->Replay(*fetches);
-		else
-			cpu->Update(int_len, &nmi_pending);
+		cpu->FrameUpdate(frame_tacts*(slice + 1)/frame_slices);
+	}
+	if(++slice < frame_slices)
+	{
+		PROFILER_SECTION(dev_s);
+		devices.FrameSlice(cpu->T());
+		return false;
 	}
+	slice = 0;
+	cpu->FrameEnd();
 	{
 		PROFILER_SECTION(dev);
 		devices.FrameUpdate();
 	}
 	{
 		PROFILER_SECTION(dev_e);
-		devices.FrameEnd(fetches ? cpu->T() : cpu->FrameTacts() + cpu->T());
+		devices.FrameEnd(cpu->FrameTacts() + cpu->T());
 	}
-	t_states += fetches ? cpu->T() : cpu->FrameTacts();
+	t_states += cpu->FrameTacts();
+	return true;
 }
@@ -36,7 +36,13 @@ public:
 	virtual ~eSpeccy();
 
 	void Reset();
-	void Update(int* fetches = NULL);
+	bool Update(int* fetches = NULL); // returns true when frame is done
+
+	// frame is executed by parts (one per Update() call) to get sound earlier,
+	// .rzx replay frames (fetches) are executed at once
+	void FrameSlices(int v) { frame_slices = v; }
+	bool InsideFrame() const { return slice != 0; }
+	void CompleteFrame(); // runs rest of sliced frame, state changes happen between frames
 
 	xZ80::eZ80*	CPU() const { return cpu; }
 	eMemory*	Memory() const { return memory; }
@@ -52,6 +58,8 @@ protected:
 	int		frame_tacts;	// t-states per frame
 	int		int_len;		// length of INT signal (for Z80)
 	int		nmi_pending;
+	int		frame_slices;
+	int		slice;			// current part of frame
 	qword	t_states;
 };
 
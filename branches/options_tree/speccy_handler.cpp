@@ -33,9 +33,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "ui/ui_desktop.h"
 #include "platform/custom_ui/ui_main.h"
 #include "tools/profiler.h"
+#include "tools/thread.h"
+#include "tools/hash.h"
 #include "options_common.h"
 #include "file_type.h"
 #include "snapshot/rzx.h"
+#include "library.h"
+
+OPTION_USING(eOptionInt, op_drive);
 
 namespace xPlatform
 {
@@ -43,7 +48,7 @@ namespace xPlatform
 class eMacro
 {
 public:
-	eMacro() : frame(-1) {}
+	eMacro(int frames_passed = 0) : frame(frames_passed - 1) {}
 	virtual ~eMacro() {}
 	virtual bool Do() = 0;
 	virtual bool Update()
@@ -55,9 +60,99 @@ protected:
 	int frame;
 };
 
+// image is read & parsed on worker thread, applied by emulation thread at frame boundary
+struct eOpenJob
+{
+	eOpenJob() : type(NULL), archive_type(NULL), entry(NULL), data(NULL), image(NULL), progress(0) { *name = *archive = '\0'; }
+	~eOpenJob()
+	{
+		SAFE_DELETE(image);
+		if(data)
+			data->Release();
+	}
+	void Read()
+	{
+		if(!data) // image inside of archive
+			data = archive_type->Unpack(archive, entry);
+	}
+	static void Run(void* arg)
+	{
+		eOpenJob* j = (eOpenJob*)arg;
+		j->Read();
+		j->progress = 50;
+		if(j->data)
+			j->image = j->type->Prepare((j->archive_type || !*j->name) ? NULL : j->name, j->data);
+		ThreadFence();
+		j->progress = 100;
+	}
+	eFileType* type;
+	eFileType* archive_type;
+	char name[xIo::MAX_PATH_LEN];
+	char archive[xIo::MAX_PATH_LEN];
+	const char* entry; // inside of name
+	xIo::eFileData* data;
+	eFileType::eImage* image;
+	volatile int progress; // 100 - ready to apply
+};
+static eThread open_thread;
+
+enum { BOOT_FRAMES = 100 }; // basic is ready for keys after reset
+enum { BOOT_VERSION = 1 }; // cached states are built again when changed (machine or szx format)
+
+// machine state after boot from rom page, built once per rom set & cached in profile folder
+static xIo::eFileData* BootState(eSpeccy* speccy, int rom_page)
+{
+	const byte* roms = speccy->Memory()->Get(0);
+	char name[64];
+	sprintf(name, "boot_v%d_%d_%d_%016llx.szx", BOOT_VERSION, BOOT_FRAMES, rom_page, Hash(roms, eMemory::P_RAM0*eMemory::PAGE_SIZE));
+	char path[xIo::MAX_PATH_LEN];
+	strncpy(path, xIo::ProfilePath(name), xIo::MAX_PATH_LEN - 1);
+	path[xIo::MAX_PATH_LEN - 1] = '\0';
+	xIo::eFileData* d = xIo::eFileData::Map(path);
+	if(d)
+		return d;
+	eSpeccy* s = new eSpeccy;
+	s->Device<eMemory>()->SetRomPage(rom_page);
+	for(int f = 0; f < BOOT_FRAMES; ++f)
+	{
+		while(!s->Update())
+			;
+	}
+	byte* buf = new byte[xSnapshot::MAX_SIZE];
+	size_t size = xSnapshot::Store(s, "szx", buf, xSnapshot::MAX_SIZE);
+	delete s;
+	if(size)
+	{
+		d = xIo::eFileData::Copy(buf, size);
+		// written to temporary file & renamed, so partially written state is never mapped
+		char tmp[xIo::MAX_PATH_LEN + 4];
+		strcpy(tmp, path);
+		strcat(tmp, ".tmp");
+		FILE* f = fopen(tmp, "wb");
+		if(f)
+		{
+			bool ok = fwrite(buf, 1, size, f) == size;
+			ok = (fclose(f) == 0) && ok;
+#ifdef _WINDOWS
+			if(ok)
+				remove(path); // rename doesn't replace files here
+#endif//_WINDOWS
+			if(!ok || rename(tmp, path) != 0)
+				remove(tmp);
+		}
+	}
+	delete[] buf;
+	return d;
+}
+
 static struct eSpeccyHandler : public eHandler, public eRZX::eHandler, public xZ80::eZ80::eHandlerIo
 {
-	eSpeccyHandler() : speccy(NULL), macro(NULL), replay(NULL), video_paused(0), inside_replay_update(false) {}
+	eSpeccyHandler() : speccy(NULL), macro(NULL), replay(NULL), record(NULL), record_error(eRZX::E_OK), video_paused(0), inside_replay_update(false)
+		, open_job(NULL), open_result(AR_OK)
+	{
+		for(int i = 0; i < eMemory::P_RAM0; ++i)
+			boot_state[i] = NULL;
+	}
 	virtual ~eSpeccyHandler() { assert(!speccy); }
 	virtual void OnInit();
 	virtual void OnDone();
@@ -79,11 +174,21 @@ static struct eSpeccyHandler : public eHandler, public eRZX::eHandler, public xZ
 		eFileType* t = eFileType::FindByName(name);
 		return t && t->AbleOpen();
 	}
+	virtual const char* FileArchiveEntry(const char* name, int index)
+	{
+		eFileType* t = eFileType::FindByName(name);
+		return t ? t->Entry(name, index) : NULL;
+	}
 	virtual bool OnOpenFile(const char* name, const void* data, size_t data_size);
 	bool OpenFile(const char* name, const void* data, size_t data_size);
 	virtual bool OnSaveFile(const char* name);
 	virtual eActionResult OnAction(eAction action);
+	virtual int OpenProgress() const { return open_job ? open_job->progress : -1; }
+	virtual bool InsideFrame() const { return speccy->InsideFrame(); }
+	void OpenApply();
+	void OpenCancel();
 
+	virtual void AudioSampleRate(dword v) { for(int i = 0; i < SOUND_DEV_COUNT; ++i) sound_dev[i]->SampleRate(v); }
 	virtual int	AudioSources() { return FullSpeed() ? 0 : SOUND_DEV_COUNT; }
 	virtual void* AudioData(int source) { return sound_dev[source]->AudioData(); }
 	virtual dword AudioDataReady(int source) { return sound_dev[source]->AudioDataReady(); }
@@ -91,25 +196,72 @@ static struct eSpeccyHandler : public eHandler, public eRZX::eHandler, public xZ
 	virtual void VideoPaused(bool paused) {	paused ? ++video_paused : --video_paused; }
 	virtual void VideoFrameRate(int v) { for(int i = 0; i < SOUND_DEV_COUNT; ++i) sound_dev[i]->FrameRate(v); }
 
-	virtual bool FullSpeed() const { return speccy->CPU()->HandlerStep() != NULL; }
+	virtual bool FullSpeed() const { return speccy->CPU()->HandlerStep() == fast_tape_emul; }
+	virtual bool TapeLoader(int index, word* pc, dword* hits, dword* misses) const
+	{
+		const eTape* tape = speccy->Device<eTape>();
+		if(index < 0 || dword(index) >= tape->Loaders())
+			return false;
+		const eTape::eLoaderStats& s = tape->Loader(index);
+		*pc = s.pc;
+		*hits = s.hits;
+		*misses = s.misses;
+		return true;
+	}
 
 	void PlayMacro(eMacro* m) { SAFE_DELETE(macro); macro = m; }
+	bool QuickBoot();
+	int ResetToBasic();
 	virtual bool RZX_OnOpenSnapshot(const char* name, const void* data, size_t data_size) { return OpenFile(name, data, data_size); }
+	virtual bool RZX_OnCaptureState(xSnapshot::eState* state)
+	{
+		// szx doesn't keep controller command in progress
+		if(speccy->Device<eWD1793>()->Busy())
+			return false;
+		xSnapshot::Capture(speccy, state);
+		return true;
+	}
+	virtual int ReplayFrame() const { return replay ? replay->Frame() : -1; }
+	virtual int ReplayFrames() const { return replay ? replay->Frames() : -1; }
+	virtual bool OnReplaySeek(int frame);
+	eRZX::eError ReplayUpdate();
 	virtual byte Z80_IoRead(word port, int tact)
 	{
 		byte r = 0xff;
-		replay->IoRead(&r);
+		if(replay)
+			replay->IoRead(&r);
+		else
+		{
+			r = speccy->Devices().IoRead(port, tact);
+			if(record)
+				record->RecordIo(r);
+		}
 		return r;
 	}
+	virtual void Z80_Frame(int fetches, int tact)
+	{
+		if(record && record->RecordFrame(fetches, tact) != eRZX::E_OK)
+			record_error = eRZX::E_INVALID;
+	}
 	const char* RZXErrorDesc(eRZX::eError err) const;
 	void Replay(eRZX* r)
 	{
 		speccy->CPU()->HandlerIo(NULL);
+		RecordStop();
 		SAFE_DELETE(replay);
 		replay = r;
 		if(replay)
 			speccy->CPU()->HandlerIo(this);
 	}
+	bool Record(const char* name);
+	void RecordStop()
+	{
+		if(record && record->RecordStop() != eRZX::E_OK)
+			record_error = eRZX::E_INVALID;
+		SAFE_DELETE(record);
+		if(!replay)
+			speccy->CPU()->HandlerIo(NULL);
+	}
 
 	eSpeccy* speccy;
 #ifdef USE_UI
@@ -117,8 +269,13 @@ static struct eSpeccyHandler : public eHandler, public eRZX::eHandler, public xZ
 #endif//USE_UI
 	eMacro* macro;
 	eRZX* replay;
+	eRZX* record;
+	eRZX::eError record_error; // reported by next OnLoop()
 	int video_paused;
 	bool inside_replay_update;
+	eOpenJob* open_job;
+	eActionResult open_result;
+	xIo::eFileData* boot_state[eMemory::P_RAM0]; // per rom page
 
 	enum { SOUND_DEV_COUNT = 3 };
 	eDeviceSound* sound_dev[SOUND_DEV_COUNT];
@@ -128,6 +285,7 @@ void eSpeccyHandler::OnInit()
 {
 	assert(!speccy);
 	speccy = new eSpeccy;
+	speccy->Devices().BindOptions(true);
 #ifdef USE_UI
 	ui_desktop = new xUi::eDesktop;
 	ui_desktop->Insert(new xUi::eMainDialog);
@@ -137,13 +295,28 @@ void eSpeccyHandler::OnInit()
 	sound_dev[2] = speccy->Device<eTape>();
 	xOptions::Init();
 	OnAction(A_RESET);
+	QuickBoot();
 }
 void eSpeccyHandler::OnDone()
 {
+#ifdef USE_UI
+	xLibrary::Done();
+#endif//USE_UI
+	OpenCancel();
 	xOptions::Done();
 	SAFE_DELETE(macro);
 	SAFE_DELETE(replay);
+	RecordStop();
+	xSnapshot::StoreWait();
 	SAFE_DELETE(speccy);
+	for(int i = 0; i < eMemory::P_RAM0; ++i)
+	{
+		if(boot_state[i])
+		{
+			boot_state[i]->Release();
+			boot_state[i] = NULL;
+		}
+	}
 #ifdef USE_UI
 	SAFE_DELETE(ui_desktop);
 #endif//USE_UI
@@ -152,24 +325,21 @@ void eSpeccyHandler::OnDone()
 const char* eSpeccyHandler::OnLoop()
 {
 	const char* error = NULL;
+	if(open_job && !speccy->InsideFrame())
+		OpenApply();
 	if(FullSpeed() || !video_paused)
 	{
-		if(macro)
+		bool frame_start = !speccy->InsideFrame();
+		if(frame_start)
+			speccy->FrameSlices(OpFrameSlices());
+		if(macro && frame_start)
 		{
 			if(!macro->Update())
 				SAFE_DELETE(macro);
 		}
-		if(replay)
+		if(replay && frame_start)
 		{
-			int icount = 0;
-			inside_replay_update = true;
-			eRZX::eError err = replay->Update(&icount);
-			inside_replay_update = false;
-			if(err == eRZX::E_OK)
-			{
-				speccy->Update(&icount);
-				err = replay->CheckSync();
-			}
+			eRZX::eError err = ReplayUpdate();
 			if(err != eRZX::E_OK)
 			{
 				Replay(NULL);
@@ -179,12 +349,69 @@ const char* eSpeccyHandler::OnLoop()
 		else
 			speccy->Update(NULL);
 	}
+	if(record_error != eRZX::E_OK)
+	{
+		RecordStop();
+		error = RZXErrorDesc(record_error);
+		record_error = eRZX::E_OK;
+	}
+	if(!error && xSnapshot::StoreFailed())
+		error = "save_failed";
+	if(!error && speccy->Device<eWD1793>()->WriteError())
+		error = "fdd_write_failed";
 #ifdef USE_UI
 	ui_desktop->Update();
 #endif//USE_UI
 	xOptions::Apply();
 	return error;
 }
+eRZX::eError eSpeccyHandler::ReplayUpdate()
+{
+	int icount = 0;
+	inside_replay_update = true;
+	eRZX::eError err = replay->Update(&icount);
+	inside_replay_update = false;
+	if(err == eRZX::E_OK)
+	{
+		speccy->Update(&icount);
+		err = replay->CheckSync();
+	}
+	return err;
+}
+bool eSpeccyHandler::OnReplaySeek(int frame)
+{
+	if(!replay)
+		return false;
+	speccy->CompleteFrame(); // seek from frame boundary
+	inside_replay_update = true; // keyframe snapshot opening resets
+	eRZX::eError err = replay->Seek(frame);
+	inside_replay_update = false;
+	while(err == eRZX::E_OK && replay->Frame() < frame && replay->Frame() < replay->Frames())
+	{
+		err = ReplayUpdate();
+	}
+	if(err != eRZX::E_OK)
+	{
+		Replay(NULL);
+		return false;
+	}
+	return true;
+}
+bool eSpeccyHandler::Record(const char* name)
+{
+	Replay(NULL);
+	byte* snapshot = new byte[xSnapshot::MAX_SIZE];
+	size_t size = xSnapshot::Store(speccy, "szx", snapshot, xSnapshot::MAX_SIZE);
+	record = new eRZX;
+	if(!size || record->Record(name, "szx", snapshot, size, speccy->CPU()->T()) != eRZX::E_OK)
+		SAFE_DELETE(record);
+	SAFE_DELETE_ARRAY(snapshot);
+	if(!record)
+		return false;
+	speccy->CPU()->HandlerStep(NULL);
+	speccy->CPU()->HandlerIo(this);
+	return true;
+}
 const char* eSpeccyHandler::RZXErrorDesc(eRZX::eError err) const
 {
 	switch(err)
@@ -262,34 +489,69 @@ void eSpeccyHandler::OnMouse(eMouseAction action, byte a, byte b)
 bool eSpeccyHandler::OnOpenFile(const char* name, const void* data, size_t data_size)
 {
 	OPTION_GET(op_last_file)->Set(name);
+	OpenCancel(); // image being opened is replaced
 	return OpenFile(name, data, data_size);
 }
 bool eSpeccyHandler::OpenFile(const char* name, const void* data, size_t data_size)
 {
+	open_thread.Wait(); // archive unpacking threads may be in use
+	speccy->CompleteFrame(); // files opened in place change machine state
 	eFileType* t = eFileType::FindByName(name);
-	if(!t)
-		return false;
-
 	if(data && data_size)
-		return t->Open(data, data_size);
-
-	FILE* f = fopen(name, "rb");
-	if(!f)
-		return false;
-	fseek(f, 0, SEEK_END);
-	size_t size = ftell(f);
-	fseek(f, 0, SEEK_SET);
-	byte* buf = new byte[size];
-	size_t r = fread(buf, 1, size, f);
-	fclose(f);
-	if(r != size)
-	{
-		delete[] buf;
+	{
+		if(!t) // unknown extension, detect by contents
+			t = eFileType::FindByData(data, data_size);
+		return t && t->Open(data, data_size);
+	}
+	eOpenJob* j = new eOpenJob;
+	if(strlen(name) < xIo::MAX_PATH_LEN)
+		strcpy(j->name, name);
+	j->data = xIo::eFileData::Map(name);
+	if(j->data)
+	{
+		if(!t)
+			t = eFileType::FindByData(j->data->Data(), j->data->Size());
+	}
+	else if(t) // image inside of archive
+		j->archive_type = eFileType::FindArchive(j->name, j->archive, &j->entry);
+	j->type = t;
+	if(!t || (!j->data && !j->archive_type))
+	{
+		delete j;
 		return false;
 	}
-	bool ok = t->Open(buf, size);
-	delete[] buf;
-	return ok;
+	if(!t->AblePrepare()) // snapshots are small, opened in place
+	{
+		j->Read();
+		bool ok = j->data && t->OpenFile(j->archive_type ? NULL : name, j->data);
+		delete j;
+		return ok;
+	}
+	open_job = j;
+	open_result = AR_OPEN_LOADING;
+	open_thread.Start(eOpenJob::Run, j);
+	return true;
+}
+// prepared image is inserted at frame boundary, devices see it changed between frames
+void eSpeccyHandler::OpenApply()
+{
+	if(open_job->progress < 100)
+		return;
+	open_thread.Wait();
+	eOpenJob* j = open_job;
+	open_job = NULL;
+	bool ok = j->type->Apply(j->image, 0);
+	j->image = NULL;
+	delete j;
+	open_result = ok ? AR_OPEN_DONE : AR_OPEN_FAILED;
+}
+void eSpeccyHandler::OpenCancel()
+{
+	if(!open_job)
+		return;
+	open_thread.Wait();
+	SAFE_DELETE(open_job);
+	open_result = AR_OK;
 }
 bool eSpeccyHandler::OnSaveFile(const char* name)
 {
@@ -300,6 +562,33 @@ bool eSpeccyHandler::OnSaveFile(const char* name)
 	return t->Store(name);
 }
 
+// just reset machine goes BOOT_FRAMES ahead at once (used on start up & before tape auto play),
+// false if quick boot is off or cached state can't be restored (machine stays reset then)
+bool eSpeccyHandler::QuickBoot()
+{
+	if(!*OPTION_GET(op_quick_boot))
+		return false;
+	eMemory* m = speccy->Device<eMemory>();
+	int page = m->Page(0);
+	if(page < 0 || page >= eMemory::P_RAM0)
+		return false;
+	if(!boot_state[page])
+		boot_state[page] = BootState(speccy, page);
+	if(boot_state[page] && xSnapshot::Load(speccy, "szx", boot_state[page]->Data(), boot_state[page]->Size()))
+		return true;
+	OnAction(A_RESET);
+	m->SetRomPage(page);
+	return false;
+}
+// returns frames the machine is ahead of reset
+int eSpeccyHandler::ResetToBasic()
+{
+	OnAction(A_RESET);
+	eMemory* m = speccy->Device<eMemory>();
+	m->SetRomPage(m->ROM_SOS());
+	return QuickBoot() ? BOOT_FRAMES : 0;
+}
+
 eActionResult eSpeccyHandler::OnAction(eAction action)
 {
 	switch(action)
@@ -307,6 +596,7 @@ eActionResult eSpeccyHandler::OnAction(eAction action)
 	case A_RESET:
 		if(!inside_replay_update) // can be called from replay->Update()
 			SAFE_DELETE(replay);
+		RecordStop(); // reset can't be recorded
 		SAFE_DELETE(macro);
 		speccy->Reset();
 		if(inside_replay_update)
@@ -319,7 +609,7 @@ eActionResult eSpeccyHandler::OnAction(eAction action)
 				return AR_TAPE_NOT_INSERTED;
 			if(!tape->Started())
 			{
-				if(OPTION_GET(op_tape_fast))
+				if(OPTION_GET(op_tape_fast) && !speccy->CPU()->HandlerIo()) // fast tape traps can't be recorded or replayed
 					speccy->CPU()->HandlerStep(fast_tape_emul);
 				else
 					speccy->CPU()->HandlerStep(NULL);
@@ -336,6 +626,8 @@ eActionResult eSpeccyHandler::OnAction(eAction action)
 				return AR_TAPE_NOT_INSERTED;
 			return tape->Started() ? AR_TAPE_STARTED : AR_TAPE_STOPPED;
 		}
+	case A_OPEN_QUERY:
+		return open_job ? AR_OPEN_LOADING : open_result;
 	}
 	return AR_ERROR;
 }
@@ -343,9 +635,16 @@ eActionResult eSpeccyHandler::OnAction(eAction action)
 static struct eFileTypeRZX : public eFileType
 {
 	virtual bool Open(const void* data, size_t data_size)
+	{
+		xIo::eFileData* d = xIo::eFileData::Copy(data, data_size);
+		bool ok = OpenFile(NULL, d);
+		d->Release();
+		return ok;
+	}
+	virtual bool OpenFile(const char* name, xIo::eFileData* data)
 	{
 		eRZX* rzx = new eRZX;
-		if(rzx->Open(data, data_size, &sh) == eRZX::E_OK)
+		if(rzx->Open(data, &sh) == eRZX::E_OK)
 		{
 			sh.Replay(rzx);
 			return true;
@@ -357,7 +656,9 @@ static struct eFileTypeRZX : public eFileType
 		}
 		return false;
 	}
+	virtual bool Store(const char* name) { return sh.Record(name); }
 	virtual const char* Type() { return "rzx"; }
+	virtual bool Detect(const void* data, size_t data_size) { return data_size >= 10 && !memcmp(data, "RZX!", 4); }
 } ft_rzx;
 
 static struct eFileTypeZ80 : public eFileType
@@ -367,19 +668,30 @@ static struct eFileTypeZ80 : public eFileType
 		sh.OnAction(A_RESET);
 		return xSnapshot::Load(sh.speccy, Type(), data, data_size);
 	}
+	virtual bool Store(const char* name)
+	{
+		return xSnapshot::Store(sh.speccy, name);
+	}
 	virtual const char* Type() { return "z80"; }
+	virtual bool Detect(const void* data, size_t data_size)
+	{
+		// v2/v3 only, v1 header has no signature to check
+		const byte* d = (const byte*)data;
+		if(data_size < 34 || d[6] || d[7])
+			return false;
+		word ext = d[30] | (d[31] << 8);
+		return ext == 23 || ext == 54 || ext == 55;
+	}
 } ft_z80;
 static struct eFileTypeSZX : public eFileTypeZ80
 {
 	virtual const char* Type() { return "szx"; }
+	virtual bool Detect(const void* data, size_t data_size) { return data_size >= 8 && !memcmp(data, "ZXST", 4); }
 } ft_szx;
 static struct eFileTypeSNA : public eFileTypeZ80
 {
-	virtual bool Store(const char* name)
-	{
-		return xSnapshot::Store(sh.speccy, name);
-	}
 	virtual const char* Type() { return "sna"; }
+	virtual bool Detect(const void* data, size_t data_size) { return data_size == 49179 || data_size == 131103 || data_size == 147487; }
 } ft_sna;
 
 class eMacroDiskRun : public eMacro
@@ -407,11 +719,33 @@ class eMacroDiskRun : public eMacro
 
 static struct eFileTypeTRD : public eFileType
 {
+	struct eDiskImage : public eImage { eFdd fdd; };
 	virtual bool Open(const void* data, size_t data_size)
 	{
+		xIo::eFileData* d = xIo::eFileData::Copy(data, data_size);
+		bool ok = OpenFile(NULL, d);
+		d->Release();
+		return ok;
+	}
+	virtual bool OpenFile(const char* name, xIo::eFileData* data) { return Apply(Prepare(name, data), 0); }
+	virtual bool AblePrepare() { return true; }
+	virtual eImage* Prepare(const char* name, xIo::eFileData* data)
+	{
+		eDiskImage* image = new eDiskImage;
+		if(!image->fdd.Open(Type(), data, name))
+			SAFE_DELETE(image);
+		return image;
+	}
+	virtual int Slots() { return eWD1793::FDD_COUNT; }
+	virtual bool Apply(eImage* image, int slot)
+	{
+		if(!image)
+			return false;
 		eWD1793* wd = sh.speccy->Device<eWD1793>();
-		bool ok = wd->Open(Type(), data, data_size);
-		if(ok && OPTION_GET(op_auto_play_image))
+		int drive = (*OPTION_GET(op_drive) + slot) % eWD1793::FDD_COUNT;
+		wd->Insert(&((eDiskImage*)image)->fdd, drive);
+		SAFE_DELETE(image); // with previous disk
+		if(!slot && OPTION_GET(op_auto_play_image))
 		{
 			sh.OnAction(A_RESET);
 			if(wd->BootExist())
@@ -422,21 +756,42 @@ static struct eFileTypeTRD : public eFileType
 				sh.PlayMacro(new eMacroDiskRun);
 			}
 		}
-		return ok;
+		return true;
+	}
+	virtual bool Store(const char* name)
+	{
+		return sh.speccy->Device<eWD1793>()->Store(Type(), name);
 	}
 	virtual const char* Type() { return "trd"; }
+	virtual bool Detect(const void* data, size_t data_size)
+	{
+		// tr-dos disk info in sector 9 of track 0
+		const byte* d = (const byte*)data;
+		return !(data_size & 0xff) && data_size >= 0x900 && data_size <= 655360 && d[0x8e7] == 0x10;
+	}
 } ft_trd;
 static struct eFileTypeSCL : public eFileTypeTRD
 {
 	virtual const char* Type() { return "scl"; }
+	virtual bool Detect(const void* data, size_t data_size) { return data_size >= 9 && !memcmp(data, "SINCLAIR", 8); }
 } ft_scl;
 static struct eFileTypeFDI : public eFileTypeTRD
 {
+	virtual bool Store(const char* name) { return false; }
 	virtual const char* Type() { return "fdi"; }
+	virtual bool Detect(const void* data, size_t data_size) { return data_size >= 14 && !memcmp(data, "FDI", 3); }
 } ft_fdi;
+static struct eFileTypeUDI : public eFileTypeTRD
+{
+	virtual const char* Type() { return "udi"; }
+	virtual bool Detect(const void* data, size_t data_size) { return data_size >= 16 && !memcmp(data, "UDI!", 4); }
+} ft_udi;
 
 class eMacroTapeLoad : public eMacro
 {
+public:
+	eMacroTapeLoad(int frames_passed) : eMacro(frames_passed) {}
+protected:
 	virtual bool Do()
 	{
 		switch(frame)
@@ -473,25 +828,74 @@ static struct eFileTypeTAP : public eFileType
 {
 	virtual bool Open(const void* data, size_t data_size)
 	{
-		bool ok = sh.speccy->Device<eTape>()->Open(Type(), data, data_size);
-		if(ok && OPTION_GET(op_auto_play_image))
-		{
-			sh.OnAction(A_RESET);
-			eMemory* m = sh.speccy->Devices().Get<eMemory>();
-			m->SetRomPage(m->ROM_SOS());
-			sh.PlayMacro(new eMacroTapeLoad);
-		}
+		xIo::eFileData* d = xIo::eFileData::Copy(data, data_size);
+		bool ok = OpenFile(NULL, d);
+		d->Release();
 		return ok;
 	}
+	virtual bool OpenFile(const char* name, xIo::eFileData* data) { return Apply(Prepare(name, data), 0); }
+	struct eTapeImage : public eImage
+	{
+		eTapeImage() : tape(NULL) { tape.Init(); }
+		eTape tape;
+	};
+	virtual bool AblePrepare() { return true; }
+	virtual eImage* Prepare(const char* name, xIo::eFileData* data)
+	{
+		eTapeImage* image = new eTapeImage;
+		if(!image->tape.Open(Type(), data))
+			SAFE_DELETE(image);
+		return image;
+	}
+	virtual bool Apply(eImage* image, int slot)
+	{
+		if(!image)
+			return false;
+		sh.speccy->Device<eTape>()->Insert(&((eTapeImage*)image)->tape);
+		SAFE_DELETE(image);
+		if(OPTION_GET(op_auto_play_image))
+			sh.PlayMacro(new eMacroTapeLoad(sh.ResetToBasic()));
+		return true;
+	}
+	virtual bool Store(const char* name)
+	{
+		return sh.speccy->Device<eTape>()->Store(Type(), name);
+	}
 	virtual const char* Type() { return "tap"; }
+	virtual bool Detect(const void* data, size_t data_size)
+	{
+		// whole file is chain of blocks with valid checksums
+		const byte* d = (const byte*)data;
+		const byte* end = d + data_size;
+		if(data_size < 4)
+			return false;
+		while(d < end)
+		{
+			if(end - d < 2)
+				return false;
+			dword size = d[0] | (d[1] << 8);
+			d += 2;
+			if(!size || dword(end - d) < size)
+				return false;
+			byte x = 0;
+			for(dword i = 0; i < size; ++i)
+				x ^= d[i];
+			if(x)
+				return false;
+			d += size;
+		}
+		return true;
+	}
 } ft_tap;
 static struct eFileTypeCSW : public eFileTypeTAP
 {
 	virtual const char* Type() { return "csw"; }
+	virtual bool Detect(const void* data, size_t data_size) { return data_size >= 0x20 && !memcmp(data, "Compressed Square Wave\x1a", 23); }
 } ft_csw;
 static struct eFileTypeTZX : public eFileTypeTAP
 {
 	virtual const char* Type() { return "tzx"; }
+	virtual bool Detect(const void* data, size_t data_size) { return data_size >= 10 && !memcmp(data, "ZXTape!\x1a", 8); }
 } ft_tzx;
 
 }
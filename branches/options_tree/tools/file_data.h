@@ -0,0 +1,111 @@
+/*
+Portable ZX-Spectrum emulator.
+Copyright (C) 2001-2013 SMT, Dexus, Alone Coder, deathsoft, djdron, scor
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef	__FILE_DATA_H__
+#define	__FILE_DATA_H__
+
+#include "file_map.h"
+
+#pragma once
+
+namespace xIo
+{
+
+//*****************************************************************************
+//	eFileData
+//	image data passed to file types without copying.
+//	data is valid during Open() only, formats using it later (tape, rzx)
+//	must AddRef() it and Release() when done, never keep raw pointers alone
+//-----------------------------------------------------------------------------
+class eFileData
+{
+public:
+	// read only memory mapped file, NULL if unable to open
+	static eFileData* Map(const char* name)
+	{
+		eFileData* d = new eFileData;
+		d->map = new eFileMap;
+		if(!d->map->Open(name))
+		{
+			d->Release();
+			return NULL;
+		}
+		d->data = d->map->Data();
+		d->data_size = d->map->Size();
+		return d;
+	}
+	// owned writable buffer
+	static eFileData* Alloc(size_t size)
+	{
+		eFileData* d = new eFileData;
+		d->buffer = new byte[size];
+		d->data = d->buffer;
+		d->data_size = size;
+		return d;
+	}
+	// own copy of data which lifetime isn't known
+	static eFileData* Copy(const void* data, size_t size)
+	{
+		eFileData* d = Alloc(size);
+		memcpy(d->buffer, data, size);
+		return d;
+	}
+	// part of data sharing it (zip stored entry)
+	eFileData* Span(size_t offset, size_t size)
+	{
+		if(offset > data_size || size > data_size - offset)
+			return NULL;
+		eFileData* d = new eFileData;
+		d->parent = this;
+		AddRef();
+		d->data = data + offset;
+		d->data_size = size;
+		return d;
+	}
+	const byte* Data() const { return data; }
+	size_t Size() const { return data_size; }
+	byte* Buffer() const { return buffer; }
+
+	void AddRef() { ++refs; }
+	void Release()
+	{
+		if(!--refs)
+			delete this;
+	}
+
+protected:
+	eFileData() : data(NULL), data_size(0), refs(1), buffer(NULL), map(NULL), parent(NULL) {}
+	~eFileData()
+	{
+		delete[] buffer;
+		delete map;
+		if(parent)
+			parent->Release();
+	}
+	const byte* data;
+	size_t data_size;
+	int refs;
+	byte* buffer;
+	eFileMap* map;
+	eFileData* parent;
+};
+
+}
+//namespace xIo
+
+#endif//__FILE_DATA_H__
@@ -0,0 +1,38 @@
+/*
+Portable ZX-Spectrum emulator.
+Copyright (C) 2001-2013 SMT, Dexus, Alone Coder, deathsoft, djdron, scor
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef	__FILE_MAP_H__
+#define	__FILE_MAP_H__
+
+#include "../std_types.h"
+
+#pragma once
+
+#if defined(_LINUX) || defined(_MAC)
+#include "../platform/linux/file_map_posix.h"
+#endif//_LINUX || _MAC
+
+#ifdef _WINDOWS
+#include "../platform/win/file_map_win.h"
+#endif//_WINDOWS
+
+#ifndef FILE_MAP_DECLARED
+#include "file_map_none.h"
+#endif//FILE_MAP_DECLARED
+
+#endif//__FILE_MAP_H__
@@ -0,0 +1,74 @@
+/*
+Portable ZX-Spectrum emulator.
+Copyright (C) 2001-2013 SMT, Dexus, Alone Coder, deathsoft, djdron, scor
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef	__FILE_MAP_NONE_H__
+#define	__FILE_MAP_NONE_H__
+
+#include <stdio.h>
+
+#pragma once
+
+namespace xIo
+{
+
+//*****************************************************************************
+//	eFileMapNone
+//	platforms without memory mapped files - whole file is read on open
+//-----------------------------------------------------------------------------
+class eFileMapNone
+{
+public:
+	eFileMapNone() : data(NULL), data_size(0) {}
+	~eFileMapNone() { Close(); }
+	bool Open(const char* name)
+	{
+		Close();
+		FILE* f = fopen(name, "rb");
+		if(!f)
+			return false;
+		fseek(f, 0, SEEK_END);
+		data_size = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		data = new byte[data_size];
+		bool ok = fread(data, 1, data_size, f) == data_size;
+		fclose(f);
+		if(!ok)
+			Close();
+		return ok;
+	}
+	void Close()
+	{
+		delete[] data;
+		data = NULL;
+		data_size = 0;
+	}
+	const byte* Data() const { return data; }
+	size_t Size() const { return data_size; }
+protected:
+	byte* data;
+	size_t data_size;
+};
+
+typedef eFileMapNone eFileMap;
+
+}
+//namespace xIo
+
+#define FILE_MAP_DECLARED
+
+#endif//__FILE_MAP_NONE_H__
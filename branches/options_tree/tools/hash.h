@@ -0,0 +1,42 @@
+/*
+Portable ZX-Spectrum emulator.
+Copyright (C) 2001-2013 SMT, Dexus, Alone Coder, deathsoft, djdron, scor
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef	__HASH_H__
+#define	__HASH_H__
+
+#include "../std_types.h"
+
+#pragma once
+
+//=============================================================================
+//	Hash
+//	FNV-1a
+//-----------------------------------------------------------------------------
+inline qword Hash(const byte* data, size_t size)
+{
+	qword h = 0xcbf29ce484222325ull;
+	for(size_t i = 0; i < size; ++i)
+	{
+		h ^= data[i];
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+#endif//__HASH_H__
@@ -54,13 +54,17 @@ bool eOptionB::applied = true;
 
 using namespace tinyxml2;
 
-eOptionB::eOptionB() : next(NULL), sub_options(NULL), customizable(true), storeable(true)
-	, changed(false), loading_node(NULL)
+eOptionB::eOptionB() : next(NULL), sub_options(NULL), parent(NULL), customizable(true), storeable(true)
+	, changed(false), dirty(true), observers(NULL), observers_count(0), loading_node(NULL)
 {
 }
 void eOptionB::Changing()
 {
 	changed = true;
+	for(eOptionB* p = parent; p && !p->dirty; p = p->parent)
+	{
+		p->dirty = true;
+	}
 	applied = false;
 }
 bool eOptionB::Apply(XMLElement* owner)
@@ -74,8 +78,16 @@ bool eOptionB::Apply(XMLElement* owner)
 	sub_options = NULL;
 	OnOption();
 	loading_node = NULL;
+	dirty = false;
 	bool res = changed;
 	changed = false;
+	if(res)
+	{
+		for(int i = 0; i < observers_count; ++i)
+		{
+			observers[i]->OnOptionChanged(this);
+		}
+	}
 	return res;
 }
 bool eOptionB::Option(eOptionB& o)
@@ -90,6 +102,9 @@ bool eOptionB::Option(eOptionB& o)
 	else
 		sub_options = &o;
 	o.next = NULL;
+	o.parent = this;
+	if(!loading && !o.changed && !o.dirty) // up to date, relinked only
+		return false;
 	XMLElement* xe = NULL;
 	if(loading && loading_node)
 	{
@@ -109,6 +124,22 @@ eOptionB* eOptionB::Find(const char* name) const
 	}
 	return NULL;
 }
+void eOptionB::Observe(eObserver* o)
+{
+	observers = (eObserver**)realloc(observers, (observers_count + 1)*sizeof(eObserver*));
+	observers[observers_count++] = o;
+}
+void eOptionB::Unobserve(eObserver* o)
+{
+	for(int i = 0; i < observers_count; ++i)
+	{
+		if(observers[i] == o)
+		{
+			observers[i] = observers[--observers_count];
+			break;
+		}
+	}
+}
 void eOptionB::Store(XMLElement* owner, XMLDocument* doc)
 {
 	if(!(storeable && Value()) && !sub_options)
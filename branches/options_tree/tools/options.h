@@ -42,6 +42,13 @@ namespace xOptions
 
 class eOptionB;
 
+// notified when options are applied after observed option change
+class eObserver
+{
+public:
+	virtual void OnOptionChanged(eOptionB* o) = 0;
+};
+
 class eRootOptionB : public eList<eRootOptionB>
 {
 public:
@@ -60,7 +67,7 @@ class eOptionB
 {
 public:
 	eOptionB();
-	virtual ~eOptionB() {}
+	virtual ~eOptionB() { free(observers); }
 
 	eOptionB* Next() const { return next; }
 	eOptionB* SubOptions() const { return sub_options; }
@@ -74,6 +81,8 @@ public:
 	virtual bool Apply(tinyxml2::XMLElement* owner = NULL);
 	eOptionB* Find(const char* name) const;
 	void Store(tinyxml2::XMLElement* owner, tinyxml2::XMLDocument* doc);
+	void Observe(eObserver* o);
+	void Unobserve(eObserver* o);
 protected:
 	virtual const char** Values() const { return NULL; }
 	void Changing();
@@ -83,9 +92,13 @@ protected:
 protected:
 	eOptionB* next;
 	eOptionB* sub_options;
+	eOptionB* parent;	// this one is sub option of
 	bool customizable;
 	bool storeable;
 	bool changed;
+	bool dirty;			// sub options changed, only changed branches are applied
+	eObserver** observers;
+	int observers_count;
 	tinyxml2::XMLElement* loading_node;
 	static bool loading;
 	static bool applied;
@@ -17,19 +17,96 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "sound_mixer.h"
+#include "thread.h"
 #include "../std.h"
 #include "../platform/platform.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIXER_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MIXER_NEON
+#endif
+
+//=============================================================================
+//	Silent
+//-----------------------------------------------------------------------------
+static bool Silent(const byte* data, dword size)
+{
+	const dword* p = (const dword*)data;
+	dword x = 0;
+	for(dword i = 0; i < size/4; ++i)
+	{
+		x |= p[i];
+	}
+	return x == 0;
+}
+//=============================================================================
+//	AddSaturated
+//-----------------------------------------------------------------------------
+static void AddSaturated(byte* _dst, const byte* _src, dword size)
+{
+	short* dst = (short*)_dst;
+	const short* src = (const short*)_src;
+	dword count = size/2;
+	dword i = 0;
+#if defined(MIXER_SSE2)
+	for(; i + 8 <= count; i += 8)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(dst + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_adds_epi16(a, b));
+	}
+#elif defined(MIXER_NEON)
+	for(; i + 8 <= count; i += 8)
+	{
+		vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+	}
+#endif
+	for(; i < count; ++i)
+	{
+		int v = dst[i] + src[i];
+		if(v > 32767)
+			v = 32767;
+		else if(v < -32768)
+			v = -32768;
+		dst[i] = v;
+	}
+}
+
+//=============================================================================
+//	eSoundMixer::Mix
+//-----------------------------------------------------------------------------
+void eSoundMixer::Mix(byte* dst, dword offset, dword size, int sources)
+{
+	using namespace xPlatform;
+	bool mixed = false;
+	for(int s = 0; s < sources; ++s)
+	{
+		const byte* src = (const byte*)Handler()->AudioData(s) + offset;
+		if(Silent(src, size))
+			continue;
+		if(mixed)
+			AddSaturated(dst, src, size);
+		else
+		{
+			memcpy(dst, src, size);
+			mixed = true;
+		}
+	}
+	if(!mixed)
+		memset(dst, 0, size);
+}
 //=============================================================================
 //	eSoundMixer::Update
 //-----------------------------------------------------------------------------
-void eSoundMixer::Update(byte* ext_buf)
+void eSoundMixer::Update()
 {
 	using namespace xPlatform;
 	int x = Handler()->AudioSources();
 	if(!x)
 		return;
-	assert(x == 3); // for some optimizations
 	dword ready_min = Handler()->AudioDataReady(0);
 	for(int s = 1; s < x; ++s)
 	{
@@ -37,53 +114,212 @@ void eSoundMixer::Update(byte* ext_buf)
 		if(ready_min > ready_s)
 			ready_min = ready_s;
 	}
-	if(ready + ready_min > BUF_SIZE)
+	ready_min &= ~3;
+	dword size = ready_min;
+	if(size > Free())
 	{
-		ready = 0;
-		ready_min = 0;
+		size = Free(); // not enough room, drop the rest
+		++overruns;
 	}
-	if(ready_min)
+	if(size)
 	{
-		byte* buf = ext_buf ? ext_buf : buffer;
-		int* p = (int*)(buf + ready);
-		int* s0 = (int*)Handler()->AudioData(0);
-		int* s1 = (int*)Handler()->AudioData(1);
-		int* s2 = (int*)Handler()->AudioData(2);
-		for(int i = ready_min/4; --i >= 0;)
+		ThreadFence();
+		dword pos = write_pos & (BUF_SIZE - 1);
+		dword size0 = BUF_SIZE - pos;
+		if(size0 > size)
+			size0 = size;
+		Mix(buffer + pos, 0, size0, x);
+		if(size > size0)
+			Mix(buffer, size0, size - size0, x);
+		ThreadFence();
+		write_pos += size;
+	}
+	for(int s = 0; s < x; ++s)
+	{
+		Handler()->AudioDataUse(s, ready_min);
+	}
+}
+//=============================================================================
+//	eSoundMixer::Read
+//-----------------------------------------------------------------------------
+dword eSoundMixer::Read(void* _dst, dword size)
+{
+	dword ready = Ready();
+	if(size > ready)
+		size = ready;
+	if(!size)
+		return 0;
+	ThreadFence();
+	byte* dst = (byte*)_dst;
+	dword pos = read_pos & (BUF_SIZE - 1);
+	dword size0 = BUF_SIZE - pos;
+	if(size0 > size)
+		size0 = size;
+	memcpy(dst, buffer + pos, size0);
+	if(size > size0)
+		memcpy(dst + size0, buffer, size - size0);
+	ThreadFence();
+	read_pos += size;
+	return size;
+}
+//=============================================================================
+//	eSoundMixer::Fill
+//-----------------------------------------------------------------------------
+dword eSoundMixer::Fill(void* dst, dword size)
+{
+	dword ready = Read(dst, size);
+	if(ready < size)
+	{
+		memset((byte*)dst + ready, 0, size - ready);
+		if(write_pos) // stream started
+			++underruns;
+	}
+	return ready;
+}
+
+//=============================================================================
+//	eResamplerInit
+//	windowed sinc kernels for PHASES fractional positions, each phase sums to 1 << 14
+//-----------------------------------------------------------------------------
+static short resampler_kernel[1 << 8][8];
+static struct eResamplerInit
+{
+	eResamplerInit()
+	{
+		const double pi = 3.14159265358979323846;
+		const int taps = sizeof(resampler_kernel[0])/sizeof(resampler_kernel[0][0]);
+		const int phases = sizeof(resampler_kernel)/sizeof(resampler_kernel[0]);
+		const int half = taps/2;
+		for(int p = 0; p < phases; ++p)
 		{
-			if(i > 8)
+			double h[taps];
+			double sum = 0;
+			for(int i = 0; i < taps; ++i)
 			{
-				*p++ = (*s0++) + (*s1++) + (*s2++);
-				*p++ = (*s0++) + (*s1++) + (*s2++);
-				*p++ = (*s0++) + (*s1++) + (*s2++);
-				*p++ = (*s0++) + (*s1++) + (*s2++);
-				*p++ = (*s0++) + (*s1++) + (*s2++);
-				*p++ = (*s0++) + (*s1++) + (*s2++);
-				*p++ = (*s0++) + (*s1++) + (*s2++);
-				*p++ = (*s0++) + (*s1++) + (*s2++);
-				i -= 8;
+				double x = i - (half - 1) - double(p)/phases;
+				double s = x ? sin(pi*x)/(pi*x) : 1.0;
+				double w = 0.42 + 0.5*cos(pi*x/half) + 0.08*cos(2*pi*x/half);
+				h[i] = s*w;
+				sum += h[i];
 			}
-			*p++ = (*s0++) + (*s1++) + (*s2++);
+			int total = 0, peak = 0;
+			for(int i = 0; i < taps; ++i)
+			{
+				resampler_kernel[p][i] = (short)floor(h[i]/sum*(1 << 14) + 0.5);
+				total += resampler_kernel[p][i];
+				if(resampler_kernel[p][i] > resampler_kernel[p][peak])
+					peak = i;
+			}
+			resampler_kernel[p][peak] += (1 << 14) - total;
 		}
-		ready += ready_min;
 	}
-	for(int s = 0; s < x; ++s)
+} resampler_init;
+
+//=============================================================================
+//	eSoundResampler::eSoundResampler
+//-----------------------------------------------------------------------------
+eSoundResampler::eSoundResampler(eSoundMixer* _mixer)
+	: mixer(_mixer), step_nominal(1 << 16), step(1 << 16), pos(0), in_size(0)
+	, target(0), fill_avg(0), adjust(0)
+	, drift(0), window_fill(-1), window_in(0), window_out(0), window_underruns(0)
+{
+	assert(sizeof(resampler_kernel) == sizeof(short)*PHASES*TAPS);
+	memset(in, 0, sizeof(in));
+}
+//=============================================================================
+//	eSoundResampler::Rate
+//-----------------------------------------------------------------------------
+void eSoundResampler::Rate(dword in_rate, dword out_rate)
+{
+	step_nominal = (dword)(((qword)in_rate << 16)/out_rate);
+	if(step_nominal > (MAX_RATIO - 1) << 16) // room for adjust
+		step_nominal = (MAX_RATIO - 1) << 16;
+	UpdateStep();
+}
+//=============================================================================
+//	eSoundResampler::UpdateDrift
+//	input arrived within window = read from mixer + fill level change,
+//	compared with input expected for produced output at nominal ratio
+//-----------------------------------------------------------------------------
+void eSoundResampler::UpdateDrift(int fill)
+{
+	if(window_fill >= 0 && window_out < DRIFT_WINDOW)
+		return;
+	long long expected = ((qword)window_out*step_nominal) >> 16;
+	long long arrived = (long long)window_in + fill - window_fill;
+	if(window_fill >= 0 && window_underruns == mixer->Underruns() && expected && arrived > 0)
 	{
-		Handler()->AudioDataUse(s, Handler()->AudioDataReady(s));
+		int measured = (int)((arrived - expected)*65536/expected);
+		drift += (measured - drift)/2;
+		if(drift > MAX_DRIFT)
+			drift = MAX_DRIFT;
+		else if(drift < -MAX_DRIFT)
+			drift = -MAX_DRIFT;
 	}
+	window_fill = fill;
+	window_in = window_out = 0;
+	window_underruns = mixer->Underruns();
 }
 //=============================================================================
-//	eSoundMixer::Use
+//	eSoundResampler::UpdateStep
+//	follow drift, consume a bit faster when mixer fills up, slower when it drains
 //-----------------------------------------------------------------------------
-void eSoundMixer::Use(dword size, byte* ext_buf)
+void eSoundResampler::UpdateStep()
 {
-	if(size)
+	if(target)
+	{
+		int fill = mixer->Ready()/4;
+		UpdateDrift(fill);
+		fill_avg += (fill - fill_avg) >> FILL_FF;
+		int correction = (fill_avg - target)*MAX_ADJUST/target;
+		if(correction > MAX_ADJUST)
+			correction = MAX_ADJUST;
+		else if(correction < -MAX_ADJUST)
+			correction = -MAX_ADJUST;
+		adjust = drift + correction;
+	}
+	step = step_nominal + (((int)step_nominal*adjust) >> 16);
+}
+//=============================================================================
+//	eSoundResampler::Fill
+//-----------------------------------------------------------------------------
+void eSoundResampler::Fill(void* dst, dword size)
+{
+	UpdateStep();
+	short* out = (short*)dst;
+	for(dword count = size/4; count;)
 	{
-		if(ready > size)
+		dword n = count > OUT_BLOCK ? OUT_BLOCK : count;
+		dword need = (dword)(((qword)pos + (qword)step*(n - 1)) >> 16) + TAPS;
+		if(need > in_size)
 		{
-			byte* buf = ext_buf ? ext_buf : buffer;
-			memmove(buf, buf + size, ready - size);
+			window_in += mixer->Fill(in + in_size*2, (need - in_size)*4)/4;
+			in_size = need;
+		}
+		for(dword i = 0; i < n; ++i)
+		{
+			const short* s = in + (pos >> 16)*2;
+			const short* k = resampler_kernel[(pos >> (16 - PHASES_FF)) & (PHASES - 1)];
+			int l = 0, r = 0;
+			for(int t = 0; t < TAPS; ++t)
+			{
+				l += s[t*2]*k[t];
+				r += s[t*2 + 1]*k[t];
+			}
+			l >>= 14;
+			r >>= 14;
+			if(l < -0x8000) l = -0x8000; else if(l > 0x7fff) l = 0x7fff;
+			if(r < -0x8000) r = -0x8000; else if(r > 0x7fff) r = 0x7fff;
+			*out++ = l;
+			*out++ = r;
+			pos += step;
 		}
-		ready -= size;
+		// keep history for next block
+		dword used = pos >> 16;
+		memmove(in, in + used*2, (in_size - used)*4);
+		in_size -= used;
+		pos &= 0xffff;
+		count -= n;
+		window_out += n;
 	}
 }
@@ -23,19 +23,75 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+//*****************************************************************************
+//	eSoundMixer
+//	mixes all sound sources into a ring buffer (16-bit stereo, saturated)
+//	Update() is the only writer and Read()/Fill() the only reader, so they
+//	may run in different threads (emulation and audio callback) without locking
+//-----------------------------------------------------------------------------
 class eSoundMixer
 {
 public:
-	eSoundMixer() : ready(0) {}
-	void	Update(byte* ext_buf = NULL);
-	dword	Ready() const { return ready; }
-	const void*	Ptr() const { return buffer; }
-	void	Use(dword size, byte* ext_buf = NULL);
+	eSoundMixer() : write_pos(0), read_pos(0), overruns(0), underruns(0) {}
+	void	Update();
+	dword	Ready() const { return write_pos - read_pos; } // fill level (bytes)
+	dword	Free() const { return BUF_SIZE - Ready(); }
+	dword	Read(void* dst, dword size);
+	dword	Fill(void* dst, dword size); // Read() padded with silence
+
+	dword	Overruns() const { return overruns; } // mixed data dropped (ring full)
+	dword	Underruns() const { return underruns; } // silence inserted (ring empty)
+
+protected:
+	void	Mix(byte* dst, dword offset, dword size, int sources);
 
 protected:
-	enum { BUF_SIZE = 65536 };
+	enum { BUF_SIZE = 65536 }; // must be power of 2
 	byte	buffer[BUF_SIZE];
-	dword	ready;
+	volatile dword write_pos;
+	volatile dword read_pos;
+	dword	overruns; // writer side
+	dword	underruns; // reader side
+};
+
+//*****************************************************************************
+//	eSoundResampler
+//	reader side of mixer, converts mixed sound to output rate (polyphase FIR),
+//	ratio follows measured drift between mixer input and output clocks,
+//	and is nudged by mixer fill level to keep it near requested latency
+//-----------------------------------------------------------------------------
+class eSoundResampler
+{
+public:
+	eSoundResampler(eSoundMixer* _mixer);
+	void	Rate(dword in_rate, dword out_rate);
+	void	Latency(dword size) { target = size/4; } // mixer fill level to keep (bytes)
+	void	Fill(void* dst, dword size);
+	int		Adjust() const { return adjust; } // current ratio correction (1/65536 units)
+
+protected:
+	void	UpdateStep();
+	void	UpdateDrift(int fill);
+
+protected:
+	enum { TAPS = 8, PHASES_FF = 8, PHASES = 1 << PHASES_FF };
+	enum { OUT_BLOCK = 1024, MAX_RATIO = 4, IN_LEN = OUT_BLOCK*MAX_RATIO + TAPS + 1 };
+	enum { FILL_FF = 4, MAX_ADJUST = 328 }; // 0.5% around drift
+	enum { DRIFT_WINDOW = 32768, MAX_DRIFT = 6554 }; // output samples, 10%
+	eSoundMixer* mixer;
+	dword	step_nominal; // input samples per output sample (16.16)
+	dword	step;
+	dword	pos; // fraction of in[0] (16.16)
+	dword	in_size;
+	int		target;
+	int		fill_avg;
+	int		adjust;
+	int		drift; // measured input/output clock mismatch (1/65536 units)
+	int		window_fill; // mixer fill level at window start (samples)
+	dword	window_in; // samples read from mixer within window
+	dword	window_out; // samples produced within window
+	dword	window_underruns; // window with stalled input isn't measured
+	short	in[IN_LEN*2];
 };
 
 #endif//__SOUND_MIXER_H__
@@ -0,0 +1,48 @@
+/*
+Portable ZX-Spectrum emulator.
+Copyright (C) 2001-2013 SMT, Dexus, Alone Coder, deathsoft, djdron, scor
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef	__THREAD_H__
+#define	__THREAD_H__
+
+#include "../std_types.h"
+
+#pragma once
+
+#ifdef _WINDOWS
+#include "../platform/win/thread_win.h"
+#endif//_WINDOWS
+
+#if defined(_LINUX) || defined(_MAC)
+#include "../platform/linux/thread_posix.h"
+#endif//_LINUX || _MAC
+
+#ifndef THREAD_DECLARED
+#include "thread_none.h"
+#endif//THREAD_DECLARED
+
+// mutex is held inside of scope
+class eLock
+{
+public:
+	eLock(eMutex& _m) : m(_m) { m.Lock(); }
+	~eLock() { m.Unlock(); }
+protected:
+	eMutex& m;
+};
+
+#endif//__THREAD_H__
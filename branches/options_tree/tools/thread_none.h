@@ -0,0 +1,54 @@
+/*
+Portable ZX-Spectrum emulator.
+Copyright (C) 2001-2013 SMT, Dexus, Alone Coder, deathsoft, djdron, scor
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef	__THREAD_NONE_H__
+#define	__THREAD_NONE_H__
+
+#pragma once
+
+//*****************************************************************************
+//	eThreadNone
+//	platforms without threads - job is done inside Start()
+//-----------------------------------------------------------------------------
+class eThreadNone
+{
+public:
+	typedef void (*eProc)(void* arg);
+	bool	Start(eProc proc, void* arg) { proc(arg); return false; }
+	void	Wait() {}
+};
+class eMutexNone
+{
+public:
+	void	Lock() {}
+	void	Unlock() {}
+};
+
+// audio callbacks may still interrupt us on single core systems
+#ifdef __GNUC__
+inline void ThreadFence() { __asm__ __volatile__("" ::: "memory"); }
+#else//__GNUC__
+inline void ThreadFence() {}
+#endif//__GNUC__
+inline void ThreadSleep(dword ms) {}
+
+#define THREAD_DECLARED
+typedef eThreadNone eThread;
+typedef eMutexNone eMutex;
+
+#endif//__THREAD_NONE_H__
@@ -35,11 +35,13 @@ namespace xUi
 
 #ifdef UI_REAL_ALPHA
 
-eRGBAColor palette[] = { 0x00000000, 0xffffffff, 0xffb06000, 0x80202020, 0xff008000, 0xff0000b0, 0xff800080 };
+eRGBAColor palette[] = { 0x00000000, 0xffffffff, 0xffb06000, 0x80202020, 0xff008000, 0xff0000b0, 0xff800080
+	, 0xff000000, 0xffc80000, 0xff0000c8, 0xffc800c8, 0xff00c800, 0xffc8c800, 0xff00c8c8, 0xffc8c8c8 };
 
 #else//UI_REAL_ALPHA
 
-eRGBAColor palette[] = { 0x00000000, 0x08ffffff, 0x08b06000, 0x01202020, 0x08008000, 0x080000b0, 0x08800080 };
+eRGBAColor palette[] = { 0x00000000, 0x08ffffff, 0x08b06000, 0x01202020, 0x08008000, 0x080000b0, 0x08800080
+	, 0x08000000, 0x08c80000, 0x080000c8, 0x08c800c8, 0x0800c800, 0x08c8c800, 0x0800c8c8, 0x08c8c8c8 };
 
 #endif//UI_REAL_ALPHA
 
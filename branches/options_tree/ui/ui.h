@@ -66,7 +66,8 @@ struct eRGBAColor
 	};
 };
 
-enum ePalettedColor { COLOR_NONE, COLOR_WHITE, COLOR_CURSOR, COLOR_BACKGROUND, COLOR_FOCUSED, COLOR_PUSHED, COLOR_PUSHED_FOCUSED, PALETTE_SIZE };
+// COLOR_ZX + zx color (bright isn't used, palette has to fit 16 entries)
+enum ePalettedColor { COLOR_NONE, COLOR_WHITE, COLOR_CURSOR, COLOR_BACKGROUND, COLOR_FOCUSED, COLOR_PUSHED, COLOR_PUSHED_FOCUSED, COLOR_ZX, PALETTE_SIZE = COLOR_ZX + 8 };
 extern eRGBAColor palette[];
 
 extern byte screen[];
@@ -26,32 +26,24 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 namespace xZ80
 {
 
+// offsets to b,c,d,e,h,l,<unused>,a  from cpu.c
+const eZ80::REGP eZ80::reg_offset[8] =
+{
+	&eZ80::b, &eZ80::c, &eZ80::d, &eZ80::e,
+	&eZ80::h, &eZ80::l, &eZ80::reg_unused, &eZ80::a
+};
+
 //=============================================================================
 //	eZ80::eZ80
 //-----------------------------------------------------------------------------
 eZ80::eZ80(eMemory* _m, eDevices* _d, dword _frame_tacts)
 	: memory(_m), ula(_d->Get<eUla>()), devices(_d)
 	, t(0), im(0), eipos(0)
-	, frame_tacts(_frame_tacts), fetches(0), reg_unused(0)
+	, frame_tacts(_frame_tacts), fetches(0), frozen(false), reg_unused(0)
 {
 	pc = sp = ir = memptr = ix = iy = 0;
 	bc = de = hl = af = alt.bc = alt.de = alt.hl = alt.af = 0;
 	int_flags = 0;
-
-	InitOpNoPrefix();
-	InitOpCB();
-	InitOpDD();
-	InitOpED();
-	InitOpFD();
-	InitOpDDCB();
-
-	// offsets to b,c,d,e,h,l,<unused>,a  from cpu.c
-	const REGP r_offset[] =
-	{
-		&eZ80::b, &eZ80::c, &eZ80::d, &eZ80::e,
-		&eZ80::h, &eZ80::l, &eZ80::reg_unused, &eZ80::a
-	};
-	memcpy(reg_offset, r_offset, sizeof(r_offset));
 }
 //=============================================================================
 //	eZ80::Reset
@@ -94,8 +86,22 @@ void eZ80::Step()
 //-----------------------------------------------------------------------------
 void eZ80::Update(int int_len, int* nmi_pending)
 {
-	if(!iff1 && halted)
+	FrameStart(int_len);
+	FrameUpdate(frame_tacts);
+	FrameEnd();
+}
+//=============================================================================
+//	eZ80::FrameStart
+//-----------------------------------------------------------------------------
+void eZ80::FrameStart(int int_len)
+{
+	frozen = !iff1 && halted;
+	if(frozen)
+	{
+		if(handler.io)
+			RecordFrame();
 		return;
+	}
 	// INT check separated from main Z80 loop to improve emulation speed
 	while(t < int_len)
 	{
@@ -109,16 +115,37 @@ void eZ80::Update(int int_len, int* nmi_pending)
 			break;
 	}
 	eipos = -1;
+	if(handler.io)
+		RecordFrame();
+}
+//=============================================================================
+//	eZ80::RecordFrame
+//	frame start is reached by replay only with Replay() so io handler here
+//	is .rzx recorder, INT itself has no fetches & port reads
+//-----------------------------------------------------------------------------
+void eZ80::RecordFrame()
+{
+	handler.io->Z80_Frame(-fetches, t);
+	fetches = 0;
+}
+//=============================================================================
+//	eZ80::FrameUpdate
+//	executes frame up to end_tact, may be called several times per frame
+//-----------------------------------------------------------------------------
+void eZ80::FrameUpdate(int end_tact)
+{
+	if(frozen)
+		return;
 	if(handler.step)
 	{
-		while(t < frame_tacts)
+		while(t < end_tact)
 		{
 			StepF();
 		}
 	}
 	else
 	{
-		while(t < frame_tacts)
+		while(t < end_tact)
 		{
 			Step();
 //			if(*nmi_pending)
@@ -132,6 +159,14 @@ void eZ80::Update(int int_len, int* nmi_pending)
 //			}
 		}
 	}
+}
+//=============================================================================
+//	eZ80::FrameEnd
+//-----------------------------------------------------------------------------
+void eZ80::FrameEnd()
+{
+	if(frozen)
+		return;
 	t -= frame_tacts;
 	eipos -= frame_tacts;
 }
@@ -82,6 +82,11 @@ public:
 	void Update(int int_len, int* nmi_pending);
 	void Replay(int fetches);
 
+	// frame split to parts (Update() does the same at once)
+	void FrameStart(int int_len);
+	void FrameUpdate(int end_tact);
+	void FrameEnd();
+
 	dword FrameTacts() const { return frame_tacts; }
 	dword T() const { return t; }
 
@@ -89,8 +94,11 @@ public:
 	{
 	public:
 		virtual byte Z80_IoRead(word port, int tact) = 0;
+		// .rzx frame passed (interrupt point), fetches since previous one
+		virtual void Z80_Frame(int fetches, int tact) {}
 	};
-	void HandlerIo(eHandlerIo* h) { handler.io = h; }
+	// step handlers skip emulation, so they're dropped while io is recorded or replayed
+	void HandlerIo(eHandlerIo* h) { handler.io = h; fetches = 0; if(h) handler.step = NULL; }
 	eHandlerIo* HandlerIo() const { return handler.io; }
 
 	class eHandlerStep
@@ -98,12 +106,13 @@ public:
 	public:
 		virtual void Z80_Step(eZ80* z80) = 0;
 	};
-	void HandlerStep(eHandlerStep* h) { handler.step = h; }
+	void HandlerStep(eHandlerStep* h) { handler.step = handler.io ? NULL : h; }
 	eHandlerStep* HandlerStep() const { return handler.step; }
 
 protected:
 	void Int();
 	void Nmi();
+	void RecordFrame();
 	void Step();
 	void StepF();
 	byte Fetch()
@@ -129,12 +138,13 @@ protected:
 	#include "z80_op_fd.h"
 	#include "z80_op_ddcb.h"
 
-	void InitOpNoPrefix();
-	void InitOpCB();
-	void InitOpDD();
-	void InitOpED();
-	void InitOpFD();
-	void InitOpDDCB();
+	// shared by all instances, filled at compile time
+	static const CALLFUNC normal_opcodes[0x100];
+	static const CALLFUNC logic_opcodes[0x100];
+	static const CALLFUNC ix_opcodes[0x100];
+	static const CALLFUNC iy_opcodes[0x100];
+	static const CALLFUNC ext_opcodes[0x100];
+	static const CALLFUNCI logic_ix_opcodes[0x100];
 
 protected:
 	eMemory*	memory;
@@ -153,7 +163,8 @@ protected:
 	int		im;
 	int		eipos;
 	int		frame_tacts; 	// t-states per frame
-	int		fetches;		// .rzx replay fetches
+	int		fetches;		// .rzx replay fetches (counted down while recording)
+	bool	frozen;			// DI + HALT at frame start - frame skipped
 
 	DECLARE_REG16(pc, pc_l, pc_h)
 	DECLARE_REG16(sp, sp_l, sp_h)
@@ -185,15 +196,8 @@ protected:
 		DECLARE_REG16(af, f, a)
 	} alt;
 
-	CALLFUNC normal_opcodes[0x100];
-	CALLFUNC logic_opcodes[0x100];
-	CALLFUNC ix_opcodes[0x100];
-	CALLFUNC iy_opcodes[0x100];
-	CALLFUNC ext_opcodes[0x100];
-	CALLFUNCI logic_ix_opcodes[0x100];
-
 	typedef byte (eZ80::*REGP);
-	REGP reg_offset[8];
+	static const REGP reg_offset[8];
 	byte reg_unused;
 };
 
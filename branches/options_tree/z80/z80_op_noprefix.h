@@ -494,13 +494,16 @@ void Op76() { // halt
 	halted = 1;
 	unsigned int st = (frame_tacts - t-1)/4+1;
 	t += 4*st;
-	if(handler.io) // replay is active
+	if(handler.io && fetches >= 0) // replay is active
 	{
 		r_low += fetches;
 		fetches = 0;
 	}
 	else
+	{
 		r_low += st;
+		fetches -= st;
+	}
 }
 void Op77() { // ld (hl),a
 	t += 3;